@@ -50,14 +50,23 @@
 #include <stdlib.h>
 #include <signal.h>
 #include <iostream>
+#include <sstream>
 #include <vector>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <fstream>
+#include <iterator>
 #ifdef _WIN32
 #include <conio.h>
 #endif
 
 
 #include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/program_options.hpp>
+#include <boost/filesystem.hpp>
 #include <boost/scoped_ptr.hpp>
 #include <boost/interprocess/sync/scoped_lock.hpp>
 
@@ -68,6 +77,11 @@
 
 #include "glfw_rendermanager.h"
 #include "utVisualization/utRenderAPI.h"
+#include "utVisualization/utShaderManager.h"
+#include "utVisualization/utResourcePool.h"
+#include "utVisualization/utGeometryCache.h"
+#include "utVisualization/utPresentationGroup.h"
+#include "utVisualization/utRemoteCamera.h"
 #include <utVision/OpenCLManager.h>
 
 
@@ -75,11 +89,183 @@
 using namespace Ubitrack;
 using namespace Ubitrack::Visualization;
 
-bool bStop = false;
+// written from signal handlers
+volatile sig_atomic_t bStop = 0;
+volatile sig_atomic_t bReload = 0;
+
+// presentation group per camera title, from the command line
+std::map< std::string, std::string > g_presentationGroups;
+
+// seconds the windows of a reload wait for cameras whose setup keeps failing
+static const double g_keptWindowTimeout = 10.0;
 
 void ctrlC ( int i )
 {
-	bStop = true;
+	bStop = 1;
+}
+
+#ifndef _WIN32
+void sigHup ( int i )
+{
+	bReload = 1;
+}
+#endif
+
+// builds the registered shader programs on the hidden shared context
+void warmUpShaders( GLFWwindow* pShareWindow )
+{
+	glfwMakeContextCurrent( pShareWindow );
+	ShaderManager::singleton().warm_up( pShareWindow );
+	glfwMakeContextCurrent( NULL );
+}
+
+// frees what the caches still hold for the shared context's share group and destroys the context
+void destroySharedContext( GLFWwindow* pShareWindow )
+{
+	if ( pShareWindow == NULL )
+		return;
+	glfwMakeContextCurrent( pShareWindow );
+	GeometryCache::singleton().collect_garbage( pShareWindow );
+	ResourcePool::singleton().collect_garbage( pShareWindow );
+	glfwMakeContextCurrent( NULL );
+	GeometryCache::singleton().drop_share_group( pShareWindow );
+	ShaderManager::singleton().drop_share_group( pShareWindow );
+	ResourcePool::singleton().drop_share_group( pShareWindow );
+	glfwDestroyWindow( pShareWindow );
+}
+
+double millisecondsSince( const boost::posix_time::ptime& start )
+{
+	return ( boost::posix_time::microsec_clock::universal_time() - start ).total_microseconds() / 1000.0;
+}
+
+// prints the duration of each startup step to measure cold start and restart time
+class StartupTimer
+{
+public:
+	StartupTimer()
+		: m_start( boost::posix_time::microsec_clock::universal_time() )
+		, m_last( m_start )
+	{}
+
+	void step( const std::string& name )
+	{
+		std::cout << "Startup: " << name << " took " << millisecondsSince( m_last ) << " ms (total "
+			<< millisecondsSince( m_start ) << " ms)" << std::endl;
+		m_last = boost::posix_time::microsec_clock::universal_time();
+	}
+
+private:
+	boost::posix_time::ptime m_start;
+	boost::posix_time::ptime m_last;
+};
+
+// loads the components and the dataflow on a background thread while windows are prepared
+struct DataflowLoader
+{
+	std::string sComponentsPath;
+	std::string sUtqlFile;
+	std::string sExtraUtqlFile;
+	std::string sServerAddress;
+
+	boost::scoped_ptr< Facade::AdvancedFacade > pFacade;
+	std::string sError;
+	double dComponentsTime;
+	double dDataflowTime;
+
+	DataflowLoader()
+		: dComponentsTime( 0 )
+		, dDataflowTime( 0 )
+	{}
+
+	void run()
+	{
+		try
+		{
+			boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+			std::cout << "Loading components..." << std::endl << std::flush;
+			pFacade.reset( new Facade::AdvancedFacade( sComponentsPath ) );
+			dComponentsTime = millisecondsSince( start );
+
+			start = boost::posix_time::microsec_clock::universal_time();
+			if ( sServerAddress.empty() )
+			{
+				std::cout << "Instantiating dataflow network from " << sUtqlFile << "..." << std::endl << std::flush;
+				pFacade->loadDataflow( sUtqlFile );
+			}
+			else
+			{
+				if ( !sExtraUtqlFile.empty() )
+					pFacade->loadDataflow( sExtraUtqlFile, false );
+
+				std::cout << "Connecting to server " << sServerAddress << "..." << std::endl << std::flush;
+				pFacade->connectToServer( sServerAddress );
+
+				std::cout << "Sending UTQL to to server " << sUtqlFile << "..." << std::endl << std::flush;
+				pFacade->sendUtqlToServer( sUtqlFile );
+			}
+			dDataflowTime = millisecondsSince( start );
+		}
+		catch( Util::Exception& e )
+		{
+			std::ostringstream ss;
+			ss << e;
+			sError = ss.str();
+		}
+		catch( std::exception& e )
+		{
+			sError = e.what();
+		}
+	}
+};
+
+// opens windows for all cameras waiting for setup, returns the number of windows opened
+/** creates or takes over the window of one camera, called by RenderManager::process_setup */
+bool setupCamera( boost::shared_ptr<CameraHandle>& cam, RenderManager& renderManager, const AdaptiveResolution::Settings& resolutionSettings )
+{
+	std::cout << "Camera setup: " << cam->title() << std::endl;
+	if (g_presentationGroups.count(cam->title())) {
+		cam->set_presentation_group(g_presentationGroups[cam->title()]);
+	}
+
+	// after a reload, a camera with the same title takes over the existing window
+	boost::shared_ptr<GLFWWindowImpl> win = boost::dynamic_pointer_cast<GLFWWindowImpl>(renderManager.take_kept_window(cam->title()));
+	bool kept = ( win.get() != NULL );
+	if (!kept) {
+		win.reset(new GLFWWindowImpl(cam->initial_width(),
+									 cam->initial_height(),
+									 cam->title()));
+		win->adaptive_resolution().set_settings(resolutionSettings);
+	}
+
+	// XXX can this be simplified ??
+	boost::shared_ptr<VirtualWindow> win_ = boost::dynamic_pointer_cast<VirtualWindow>(win);
+	if (!cam->setup(win_)) {
+		// a kept window waits for the retry, a fresh one is opened again then
+		cam->detach_window();
+		if (kept)
+			renderManager.return_kept_window(cam->title(), win_);
+		else
+			win->destroy();
+		return false;
+	}
+	win->initGL(cam);
+	// initGL closes the window when GLEW cannot be initialized
+	if (!win->is_valid()) {
+		cam->detach_window();
+		return false;
+	}
+#ifdef WIN32
+	Util::sleep(30);
+#endif
+	glfwPollEvents();
+	return true;
+}
+
+/** sets up the cameras that are due, failed ones are retried later without blocking the render loop */
+unsigned int setupPendingCameras( RenderManager& renderManager, const AdaptiveResolution::Settings& resolutionSettings )
+{
+	return renderManager.process_setup( boost::bind( &setupCamera, _1, boost::ref( renderManager ), boost::cref( resolutionSettings ) ) );
 }
 
 void CheckForGLErrors(std::string a_szMessage)
@@ -92,9 +278,323 @@ void CheckForGLErrors(std::string a_szMessage)
     }
 }
 
+// renders all members of a presentation group with the same measurement time and swaps them back to back
+void renderPresentationGroup( PresentationGroup& group, const std::vector< boost::shared_ptr<CameraHandle> >& members, int ellapsed_time )
+{
+	std::vector< boost::shared_ptr<CameraHandle> > cams;
+	std::vector< boost::shared_ptr<GLFWWindowImpl> > wins;
+	for (std::size_t i = 0; i < members.size(); i++) {
+		boost::shared_ptr<GLFWWindowImpl> win = boost::dynamic_pointer_cast<GLFWWindowImpl>(members[i]->get_window());
+		if ((win) && (win->is_valid())) {
+			cams.push_back(members[i]);
+			wins.push_back(win);
+		}
+	}
+	if (cams.empty())
+		return;
+
+	group.latch(cams);
+	std::vector< double > swapTimes(cams.size(), 0.0);
+
+	// camera handles render on the main GL thread only, so finish all frames first to keep the swaps themselves short
+	for (std::size_t i = 0; i < cams.size(); i++) {
+		wins[i]->pre_render();
+		cams[i]->render(ellapsed_time);
+		wins[i]->finish_render();
+		glFinish();
+		CheckForGLErrors("Render Error");
+	}
+	for (std::size_t i = 0; i < cams.size(); i++) {
+		wins[i]->make_current();
+		wins[i]->swap();
+		swapTimes[i] = glfwGetTime();
+	}
+	group.record_swaps(swapTimes);
+}
+
+std::string readTextFile( const std::string& sFile )
+{
+	std::ifstream file( sFile.c_str(), std::ios::in | std::ios::binary );
+	return std::string( ( std::istreambuf_iterator< char >( file ) ), std::istreambuf_iterator< char >() );
+}
+
+// loads the dataflow that ran before a failed reload again, from a temporary copy since the file has changed
+bool restoreDataflow( Facade::AdvancedFacade& utFacade, const std::string& sPreviousUtql )
+{
+	utFacade.clearDataflow();
+	if ( sPreviousUtql.empty() )
+		return false;
+
+	boost::system::error_code ec;
+	boost::filesystem::path tmp = boost::filesystem::temp_directory_path( ec ) / boost::filesystem::unique_path( "utql-%%%%%%%%.xml", ec );
+	{
+		std::ofstream file( tmp.string().c_str(), std::ios::out | std::ios::binary | std::ios::trunc );
+		file << sPreviousUtql;
+		if ( !file )
+			return false;
+	}
+	bool restored = true;
+	try
+	{
+		utFacade.loadDataflow( tmp.string() );
+	}
+	catch( Util::Exception& e )
+	{
+		std::cerr << "Error restoring the previous dataflow: " << e << std::endl;
+		utFacade.clearDataflow();
+		restored = false;
+	}
+	boost::filesystem::remove( tmp, ec );
+	return restored;
+}
+
+// replaces the running dataflow, windows of cameras that come back under the same title stay open.
+// If the new dataflow does not load, the previous one (sLoadedUtql) is restored.
+// Returns true while windows are kept for cameras still waiting for setup, the caller then ends the reload.
+bool reloadDataflow( Facade::AdvancedFacade& utFacade, RenderManager& renderManager, const std::string& sUtqlFile,
+	std::string& sLoadedUtql, const AdaptiveResolution::Settings& resolutionSettings, unsigned int& windows_opened )
+{
+	boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+	std::cout << "Reloading dataflow from " << sUtqlFile << "..." << std::endl << std::flush;
+
+	std::string sUtql = readTextFile( sUtqlFile );
+	utFacade.stopDataflow();
+	renderManager.begin_reload();
+	bool loaded = true;
+	try
+	{
+		utFacade.loadDataflow( sUtqlFile );
+		sLoadedUtql = sUtql;
+	}
+	catch( Util::Exception& e )
+	{
+		std::cerr << "Error reloading dataflow: " << e << std::endl;
+		loaded = false;
+	}
+	if ( !loaded )
+	{
+		// cameras of the partially loaded dataflow must not take over the windows
+		renderManager.begin_reload();
+		if ( !restoreDataflow( utFacade, sLoadedUtql ) )
+		{
+			std::cerr << "No dataflow could be loaded, closing its windows" << std::endl;
+			renderManager.end_reload();
+			return false;
+		}
+		std::cout << "Restored the previous dataflow" << std::endl;
+	}
+	utFacade.startDataflow();
+
+	windows_opened += setupPendingCameras( renderManager, resolutionSettings );
+	std::cout << "Reload took " << millisecondsSince( start ) << " ms" << std::endl;
+	if ( renderManager.pending_setup_count() == 0 )
+	{
+		renderManager.end_reload();
+		return false;
+	}
+	return true;
+}
+
+/** prints the pooled render target memory per window */
+void reportRenderTargetMemory()
+{
+	ResourcePool& pool = ResourcePool::singleton();
+	std::map< std::string, std::size_t > usage;
+	pool.usage_by_owner( usage );
+
+	const std::size_t mb = 1024 * 1024;
+	std::cout << "Render targets: " << pool.memory_usage() / mb << " of " << pool.memory_budget() / mb << " MB ("
+		<< pool.idle_memory() / mb << " MB idle, " << pool.allocations() << " allocations, " << pool.reuses() << " reuses)" << std::endl;
+	for ( std::map< std::string, std::size_t >::iterator it = usage.begin(); it != usage.end(); ++it )
+		std::cout << "  " << it->first << ": " << it->second / mb << " MB" << std::endl;
+}
+
+/** prints CPU submission and GPU execution time of the render pass per window */
+void reportRenderTiming( RenderManager& renderManager )
+{
+	for ( CameraHandleMap::iterator it = renderManager.cameras_begin(); it != renderManager.cameras_end(); ++it )
+	{
+		if ( !it->second || !it->second->get_window() )
+			continue;
+		RenderTiming& timing = it->second->get_window()->render_timing();
+		std::cout << "Window " << it->second->title() << ": cpu " << timing.cpu_time() << " ms, gpu ";
+		if ( timing.gpu_time() >= 0.0 )
+			std::cout << timing.gpu_time() << " ms";
+		else
+			std::cout << ( timing.gpu_supported() ? "pending" : "n/a" );
+		if ( timing.skipped_frames() > 0 )
+			std::cout << " (" << timing.skipped_frames() << " frames not measured)";
+		std::cout << std::endl;
+	}
+}
+
+/** split mode, the cameras of the dataflow only publish to the render server */
+bool setupRemoteCamera( boost::shared_ptr<CameraHandle>& cam )
+{
+	if ( !boost::dynamic_pointer_cast<RemoteCameraHandle>( cam ) )
+	{
+		// nothing to retry, the component renders itself and needs a window in this process
+		std::cerr << "Camera " << cam->title() << " does not support the split mode and is not shown" << std::endl;
+		return true;
+	}
+	boost::shared_ptr<VirtualWindow> noWindow;
+	return cam->setup( noWindow );
+}
+
+/** runs the dataflow without any window, a render server started with --render_server shows the cameras */
+int runSplitDataflow( DataflowLoader& loader )
+{
+	RenderManager& renderManager = RenderManager::singleton();
+	renderManager.set_split_mode( true );
+
+	loader.run();
+	if ( !loader.sError.empty() )
+	{
+		std::cerr << loader.sError << std::endl;
+		return 1;
+	}
+	std::cout << "Starting dataflow, cameras publish to the render server" << std::endl;
+	loader.pFacade->startDataflow();
+
+	while ( !bStop )
+	{
+		renderManager.process_setup( &setupRemoteCamera );
+		renderManager.wait_for_event( 100 );
+	}
+
+	// withdraw the rings first, so the render server closes the windows
+	renderManager.teardown();
+	std::cout << "Stopping dataflow..." << std::endl << std::flush;
+	loader.pFacade->stopDataflow();
+	return 0;
+}
+
+/**
+ * opens a camera for every ring the dataflow process announces and drops cameras whose ring was withdrawn
+ * or created again. Rings whose window the user closed stay closed until the dataflow creates them again.
+ */
+void syncRemoteCameras( boost::shared_ptr<SharedFrameRegistry>& registry, RenderManager& renderManager,
+	std::map< std::string, unsigned int >& cameras, const std::map< std::string, unsigned int >& closed )
+{
+	if ( !registry )
+		registry = SharedFrameRegistry::open( false );
+	std::vector< SharedFrameRegistry::Entry > entries;
+	if ( registry )
+		registry->list( entries );
+
+	std::map< std::string, unsigned int > announced;
+	for ( std::size_t i = 0; i < entries.size(); i++ )
+		announced[ entries[ i ].ring ] = entries[ i ].generation;
+
+	for ( std::map< std::string, unsigned int >::iterator it = cameras.begin(); it != cameras.end(); )
+	{
+		boost::shared_ptr<SharedFrameCamera> cam = boost::dynamic_pointer_cast<SharedFrameCamera>( renderManager.get_camera( it->second ) );
+		std::map< std::string, unsigned int >::iterator entry = announced.find( it->first );
+		if ( cam && entry != announced.end() && entry->second == cam->generation() )
+		{
+			++it;
+			continue;
+		}
+		if ( cam )
+		{
+			std::cout << "Render server: " << cam->title() << " was withdrawn" << std::endl;
+			cam->teardown();
+		}
+		renderManager.unregister_camera( it->second );
+		cameras.erase( it++ );
+	}
+
+	for ( std::size_t i = 0; i < entries.size(); i++ )
+	{
+		const SharedFrameRegistry::Entry& entry = entries[ i ];
+		std::map< std::string, unsigned int >::const_iterator closedEntry = closed.find( entry.ring );
+		if ( cameras.count( entry.ring ) || ( closedEntry != closed.end() && closedEntry->second == entry.generation ) )
+			continue;
+		std::string title = entry.title;
+		boost::shared_ptr<CameraHandle> cam( new SharedFrameCamera( title, entry.width, entry.height, entry.ring, entry.generation ) );
+		cameras[ entry.ring ] = renderManager.register_camera( cam );
+		std::cout << "Render server: showing " << title << std::endl;
+	}
+}
+
+/** renders the cameras published by a dataflow running with --split, until interrupted */
+int runRenderServer( const AdaptiveResolution::Settings& resolutionSettings )
+{
+	glfwInit();
+	glfwWindowHint( GLFW_SAMPLES, 4 );
+	glfwWindowHint( GLFW_CONTEXT_VERSION_MAJOR, 2 );
+	glfwWindowHint( GLFW_CONTEXT_VERSION_MINOR, 1 );
+	glfwWindowHint( GLFW_RESIZABLE, GL_TRUE );
+
+	RenderManager& renderManager = RenderManager::singleton();
+	boost::shared_ptr<SharedFrameRegistry> registry;
+	// ring name to camera id, and ring name to the generation whose window was closed
+	std::map< std::string, unsigned int > cameras;
+	std::map< std::string, unsigned int > closed;
+	// ids of the cameras whose window has been open
+	std::set< unsigned int > shown;
+	double lastPoll = -1.0;
+	std::cout << "Render server waiting for cameras, start the dataflow with --split or run utSplitPublisher" << std::endl;
+
+	while ( !bStop )
+	{
+		if ( glfwGetTime() - lastPoll > 1.0 )
+		{
+			lastPoll = glfwGetTime();
+			syncRemoteCameras( registry, renderManager, cameras, closed );
+		}
+		setupPendingCameras( renderManager, resolutionSettings );
+
+		int ellapsed_time = (int)(glfwGetTime() * 1000.);
+		bool rendered = false;
+		for ( std::map< std::string, unsigned int >::iterator it = cameras.begin(); it != cameras.end(); )
+		{
+			boost::shared_ptr<CameraHandle> cam = renderManager.get_camera( it->second );
+			boost::shared_ptr<GLFWWindowImpl> win;
+			if ( cam )
+				win = boost::dynamic_pointer_cast<GLFWWindowImpl>( cam->get_window() );
+			if ( win && win->is_valid() )
+			{
+				win->pre_render();
+				cam->render( ellapsed_time );
+				win->post_render();
+				CheckForGLErrors( "Render Error" );
+				rendered = true;
+				shown.insert( it->second );
+			}
+			else if ( shown.count( it->second ) )
+			{
+				// closed by the user, windows still waiting for their setup are not shown yet
+				boost::shared_ptr<SharedFrameCamera> shared = boost::dynamic_pointer_cast<SharedFrameCamera>( cam );
+				if ( shared )
+					closed[ it->first ] = shared->generation();
+				if ( cam )
+					cam->teardown();
+				renderManager.unregister_camera( it->second );
+				shown.erase( it->second );
+				cameras.erase( it++ );
+				continue;
+			}
+			++it;
+		}
+		glfwPollEvents();
+
+		// with windows the swaps pace the loop
+		if ( !rendered )
+			Util::sleep( 50 );
+	}
+
+	renderManager.teardown();
+	glfwTerminate();
+	return 0;
+}
+
 int main( int ac, char** av )
 {
 	signal ( SIGINT, &ctrlC );
+#ifndef _WIN32
+	signal ( SIGHUP, &sigHup );
+#endif
 	
 	try
 	{
@@ -105,7 +605,17 @@ int main( int ac, char** av )
 		std::string sExtraUtqlFile;
 		std::string sComponentsPath;
 		std::string sLogConfig = "log4cpp.conf";
+		std::string sShaderCache = ( boost::filesystem::temp_directory_path() / "ubitrack_shader_cache" ).string();
+		unsigned int iPrewarmWindows = 1;
+		std::size_t iRenderTargetBudget = 0;
+		bool bMemoryReport;
+		bool bTimingReport;
+		bool bSplit;
+		bool bRenderServer;
+		bool bWatchUtql;
+		std::vector< std::string > presentationGroupOptions;
 		bool bNoExit;
+		AdaptiveResolution::Settings resolutionSettings;
 
 		try
 		{
@@ -121,6 +631,19 @@ int main( int ac, char** av )
 					"Without specifying this option, the UTQL file can also be given directly on the command line." )
 				( "extra-dataflow", po::value< std::string >( &sExtraUtqlFile ), "Additional UTQL response file to be loaded directly without using the server" )
 				( "noexit", "do not exit on return" )
+				( "watch", "reload the dataflow without closing windows when the UTQL file changes (SIGHUP also triggers a reload)" )
+				( "presentation_group", po::value< std::vector< std::string > >( &presentationGroupOptions )->composing(), "Present windows in sync, as <group>:<window title>,<window title>,... (may be given several times)" )
+				( "prewarm_windows", po::value< unsigned int >( &iPrewarmWindows ), "Number of window contexts created while the dataflow loads (default 1)" )
+				( "shader_cache", po::value< std::string >( &sShaderCache ), "Directory for cached shader program binaries, empty to disable" )
+				( "render_target_budget", po::value< std::size_t >( &iRenderTargetBudget ), "Memory budget for pooled render targets in MB (default 512)" )
+				( "memory_report", "Print the render target memory used per window every 10 seconds" )
+				( "timing_report", "Print the CPU and GPU render time per window every 10 seconds" )
+				( "split", "Run the dataflow without windows, cameras publish through shared memory to a separate render server" )
+				( "render_server", "Run no dataflow, show the cameras of a dataflow started with --split" )
+				( "frame_budget", po::value< double >( &resolutionSettings.targetFrameTime ), "Render time budget per window in ms, enables dynamic resolution scaling" )
+				( "min_resolution_scale", po::value< double >( &resolutionSettings.minScale ), "Lower bound of the dynamic resolution scale (default 0.25)" )
+				( "max_resolution_scale", po::value< double >( &resolutionSettings.maxScale ), "Upper bound of the dynamic resolution scale (default 1.0)" )
+				( "resolution_hysteresis", po::value< unsigned int >( &resolutionSettings.hysteresisFrames ), "Frames over or under budget before the resolution scale changes (default 10)" )
 				( "path", "path to ubitrack bin directory" )
 				#ifdef _WIN32
 				( "priority", po::value< int >( 0 ),"set priority of console thread, -1: lower, 0: normal, 1: higher, 2: real time (needs admin)" )
@@ -161,9 +684,26 @@ int main( int ac, char** av )
 			#endif
 
 			bNoExit = poOptions.count( "noexit" ) != 0;
+			bWatchUtql = poOptions.count( "watch" ) != 0;
+			bMemoryReport = poOptions.count( "memory_report" ) != 0;
+			bTimingReport = poOptions.count( "timing_report" ) != 0;
+			bSplit = poOptions.count( "split" ) != 0;
+			bRenderServer = poOptions.count( "render_server" ) != 0;
+
+			for ( std::size_t i = 0; i < presentationGroupOptions.size(); i++ )
+			{
+				std::string::size_type colon = presentationGroupOptions[ i ].find( ':' );
+				if ( colon == std::string::npos )
+					throw std::runtime_error( "invalid presentation group " + presentationGroupOptions[ i ] );
+				std::string group = presentationGroupOptions[ i ].substr( 0, colon );
+				std::istringstream titles( presentationGroupOptions[ i ].substr( colon + 1 ) );
+				std::string title;
+				while ( std::getline( titles, title, ',' ) )
+					g_presentationGroups[ title ] = group;
+			}
 			
 			// print help message if nothing specified
-			if ( poOptions.count( "help" ) || sUtqlFile.empty() )
+			if ( poOptions.count( "help" ) || ( sUtqlFile.empty() && !bRenderServer ) || ( bSplit && bRenderServer ) )
 			{
 				std::cout << "Syntax: utConsole [options] [--utql] <UTQL file>" << std::endl << std::endl;
 				std::cout << poDesc << std::endl;
@@ -181,6 +721,21 @@ int main( int ac, char** av )
 			return 1;
 		}
 
+		if ( bRenderServer )
+			return runRenderServer( resolutionSettings );
+
+		if ( bSplit )
+		{
+			DataflowLoader loader;
+			loader.sComponentsPath = sComponentsPath;
+			loader.sUtqlFile = sUtqlFile;
+			loader.sExtraUtqlFile = sExtraUtqlFile;
+			loader.sServerAddress = sServerAddress;
+			return runSplitDataflow( loader );
+		}
+
+		StartupTimer startupTimer;
+
 		// Init GLFW
 		glfwInit();
 
@@ -189,65 +744,101 @@ int main( int ac, char** av )
 		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
 
 		glfwWindowHint(GLFW_RESIZABLE, GL_TRUE);
+		startupTimer.step( "GLFW initialization" );
 
-		// set windows visible
-		glfwWindowHint(GLFW_VISIBLE, 1);
+		// configure ubitrack in the background, component loading dominates the startup time
+		DataflowLoader loader;
+		loader.sComponentsPath = sComponentsPath;
+		loader.sUtqlFile = sUtqlFile;
+		loader.sExtraUtqlFile = sExtraUtqlFile;
+		loader.sServerAddress = sServerAddress;
+		boost::thread loaderThread( boost::bind( &DataflowLoader::run, &loader ) );
 
 		// create and register render manager
 		RenderManager& pRenderManager = RenderManager::singleton();
 
-		// configure ubitrack
-		std::cout << "Loading components..." << std::endl << std::flush;
-		Facade::AdvancedFacade utFacade( sComponentsPath );
-
-		if ( sServerAddress.empty() )
-		{
-			std::cout << "Instantiating dataflow network from " << sUtqlFile << "..." << std::endl << std::flush;
-			utFacade.loadDataflow( sUtqlFile );
+		// hidden window whose context shares GL objects with all camera windows
+		glfwWindowHint(GLFW_VISIBLE, 0);
+		GLFWwindow* pShareWindow = glfwCreateWindow(1, 1, "utGLFWConsole shared context", NULL, NULL);
+		if (pShareWindow != NULL) {
+			glfwMakeContextCurrent(pShareWindow);
+			GLFWWindowImpl::initGLEW();
+			glfwMakeContextCurrent(NULL);
 		}
-		else
+		pRenderManager.setSharedOpenGLContext(pShareWindow);
+		startupTimer.step( "shared context creation" );
+
+		// contexts for the windows of the first cameras
+		GLFWWindowImpl::prewarm( iPrewarmWindows );
+		startupTimer.step( "window pre-creation" );
+
+		// set windows visible
+		glfwWindowHint(GLFW_VISIBLE, 1);
+
+		// cameras register while their components are still being constructed, so their windows are
+		// only set up once loadDataflow() has returned; the contexts created above already overlap the loading
+		unsigned int windows_opened = 0;
+		while ( !loaderThread.timed_join( boost::posix_time::milliseconds( 10 ) ) )
+			glfwPollEvents();
+		std::cout << "Startup: component loading took " << loader.dComponentsTime << " ms, dataflow loading took "
+			<< loader.dDataflowTime << " ms" << std::endl;
+		startupTimer.step( "waiting for the dataflow" );
+
+		if ( !loader.sError.empty() )
 		{
-			if ( !sExtraUtqlFile.empty() )
-				utFacade.loadDataflow( sExtraUtqlFile, false );
-				
-			std::cout << "Connecting to server " << sServerAddress << "..." << std::endl << std::flush;
-			utFacade.connectToServer( sServerAddress );
-			
-			std::cout << "Sending UTQL to to server " << sUtqlFile << "..." << std::endl << std::flush;
-			utFacade.sendUtqlToServer( sUtqlFile );
+			std::cerr << loader.sError << std::endl;
+			pRenderManager.teardown();
+			GLFWWindowImpl::release_prewarmed();
+			pRenderManager.setSharedOpenGLContext(NULL);
+			destroySharedContext(pShareWindow);
+			glfwTerminate();
+			return 1;
 		}
+		Facade::AdvancedFacade& utFacade = *loader.pFacade;
+		// a failed reload falls back to this dataflow
+		std::string sLoadedUtql;
+		if ( sServerAddress.empty() )
+			sLoadedUtql = readTextFile( sUtqlFile );
 
+		// build shader programs known after loading the dataflow while the components start
+		ShaderManager::singleton().set_cache_directory( sShaderCache );
+		if ( iRenderTargetBudget > 0 )
+			ResourcePool::singleton().set_memory_budget( iRenderTargetBudget * 1024 * 1024 );
+		boost::scoped_ptr< boost::thread > pShaderThread;
+		if ( pShareWindow != NULL )
+			pShaderThread.reset( new boost::thread( &warmUpShaders, pShareWindow ) );
 
 		std::cout << "Starting dataflow" << std::endl;
 		utFacade.startDataflow();
 
+		if ( pShaderThread )
+			pShaderThread->join();
+		startupTimer.step( "dataflow start" );
+
 		// setup rendermanager
 		pRenderManager.setup();
-		unsigned int windows_opened = 0;
-
-		while( !bStop && (( windows_opened == 0 ) || ( pRenderManager.any_windows_valid() )))
+		bool bFirstFrame = true;
+
+		boost::system::error_code ec;
+		std::time_t utqlWriteTime = boost::filesystem::last_write_time( sUtqlFile, ec );
+		double lastWatchTime = glfwGetTime();
+		// start of a reload whose windows are still kept for cameras in setup, negative if none
+		double reloadPendingSince = -1.0;
+		double lastSkewReport = glfwGetTime();
+		double lastMemoryReport = glfwGetTime();
+		double lastTimingReport = glfwGetTime();
+		std::map< std::string, std::vector< boost::shared_ptr<CameraHandle> > > groupedCameras;
+
+		// cameras waiting for a setup retry keep the console running even while no window is open
+		while( !bStop && (( windows_opened == 0 ) || ( pRenderManager.any_windows_valid() ) || ( pRenderManager.pending_setup_count() > 0 )))
 		{
 			boost::shared_ptr<CameraHandle> cam;
 			boost::shared_ptr<GLFWWindowImpl> win;
-			while (pRenderManager.need_setup()) {
-				cam = pRenderManager.setup_pop_front();
-				std::cout << "Camera setup: " << cam->title() << std::endl;
-				win.reset(new GLFWWindowImpl(cam->initial_width(),
-											 cam->initial_height(),
-											 cam->title()));
-
-				// XXX can this be simplified ??
-				boost::shared_ptr<VirtualWindow> win_ = boost::dynamic_pointer_cast<VirtualWindow>(win);
-				if (!cam->setup(win_)) {
-					pRenderManager.setup_push_back(cam);
-				} else {
-					win->initGL(cam);
-#ifdef WIN32
-					Util::sleep(30);
-#endif
-					windows_opened++;
-				}
-                glfwPollEvents();
+			windows_opened += setupPendingCameras( pRenderManager, resolutionSettings );
+			if ( reloadPendingSince >= 0.0 && ( pRenderManager.pending_setup_count() == 0 || glfwGetTime() - reloadPendingSince > g_keptWindowTimeout ) )
+			{
+				pRenderManager.end_reload();
+				reloadPendingSince = -1.0;
 			}
 
 			std::vector< unsigned int > chToDelete;
@@ -255,29 +846,69 @@ int main( int ac, char** av )
 			CameraHandleMap::iterator end = pRenderManager.cameras_end();
 			int ellapsed_time = (int)(glfwGetTime() * 1000.);
 			while ( pos != end ) {
+				// a camera whose setup failed has no window yet and is retried later, it must not be deleted
+				if (pRenderManager.setup_pending(pos->first)) {
+					pos++;
+					continue;
+				}
 				bool is_valid = false;
 				if (pos->second) {
 					cam = pos->second;
 					if (cam->get_window()) {
 						win = boost::dynamic_pointer_cast<GLFWWindowImpl>(cam->get_window());
 						if ((win) && (win->is_valid())) {
-                            win->pre_render();
-//							cam->pre_render();
-							cam->render(ellapsed_time);
-							//cam->post_render(); ??
 							is_valid = true;
-                            win->post_render();  // make this loop through all current windows??
-                            CheckForGLErrors("Render Error");
+							// members of presentation groups are rendered together below
+							if (cam->presentation_group().empty()) {
+								win->pre_render();
+//								cam->pre_render();
+								cam->render(ellapsed_time);
+								//cam->post_render(); ??
+								win->post_render();  // make this loop through all current windows??
+								CheckForGLErrors("Render Error");
+							}
 						}
 					}
 				}
 				if (!is_valid) {
 					chToDelete.push_back(pos->first);
 				}
+				else if (bFirstFrame) {
+					startupTimer.step( "first frame" );
+					bFirstFrame = false;
+				}
 				pos++;
 				glfwPollEvents();
 			}
 
+			pRenderManager.presentation_groups(groupedCameras);
+			for (std::map< std::string, std::vector< boost::shared_ptr<CameraHandle> > >::iterator it = groupedCameras.begin();
+				it != groupedCameras.end(); ++it) {
+				boost::shared_ptr<PresentationGroup> group = pRenderManager.get_presentation_group(it->first);
+				renderPresentationGroup(*group, it->second, ellapsed_time);
+			}
+
+			// report the swap skew of the presentation groups every 10 seconds
+			if (!groupedCameras.empty() && glfwGetTime() - lastSkewReport > 10.0) {
+				lastSkewReport = glfwGetTime();
+				for (std::map< std::string, std::vector< boost::shared_ptr<CameraHandle> > >::iterator it = groupedCameras.begin();
+					it != groupedCameras.end(); ++it) {
+					boost::shared_ptr<PresentationGroup> group = pRenderManager.get_presentation_group(it->first);
+					std::cout << "Presentation group " << it->first << ": swap skew " << group->last_skew() << " ms (mean "
+						<< group->mean_skew() << " ms, max " << group->max_skew() << " ms over " << group->frames() << " frames)" << std::endl;
+				}
+			}
+
+			if (bMemoryReport && glfwGetTime() - lastMemoryReport > 10.0) {
+				lastMemoryReport = glfwGetTime();
+				reportRenderTargetMemory();
+			}
+
+			if (bTimingReport && glfwGetTime() - lastTimingReport > 10.0) {
+				lastTimingReport = glfwGetTime();
+				reportRenderTiming(pRenderManager);
+			}
+
 			if (chToDelete.size() > 0) {
 				for (unsigned int i = 0; i < chToDelete.size(); i++) {
 					unsigned int cam_id = chToDelete.at(i);
@@ -288,6 +919,26 @@ int main( int ac, char** av )
 			}
 			// need a way to exit the loop here ..
 			pRenderManager.wait_for_event(100);
+
+			if ( bWatchUtql && glfwGetTime() - lastWatchTime > 1.0 )
+			{
+				lastWatchTime = glfwGetTime();
+				std::time_t writeTime = boost::filesystem::last_write_time( sUtqlFile, ec );
+				if ( !ec && writeTime != utqlWriteTime )
+				{
+					utqlWriteTime = writeTime;
+					bReload = 1;
+				}
+			}
+			if ( bReload )
+			{
+				bReload = 0;
+				if ( sServerAddress.empty() )
+					reloadPendingSince = reloadDataflow( utFacade, pRenderManager, sUtqlFile, sLoadedUtql, resolutionSettings, windows_opened )
+						? glfwGetTime() : -1.0;
+				else
+					std::cout << "Reloading is not supported with a server connection" << std::endl;
+			}
 		}
 
 		// teardown rendermanager
@@ -296,6 +947,9 @@ int main( int ac, char** av )
 		std::cout << "Stopping dataflow..." << std::endl << std::flush;
 		utFacade.stopDataflow();
 
+		GLFWWindowImpl::release_prewarmed();
+		pRenderManager.setSharedOpenGLContext(NULL);
+		destroySharedContext(pShareWindow);
 		glfwTerminate();
 
 		std::cout << "Finished, cleaning up..." << std::endl << std::flush;
@@ -4,7 +4,11 @@
 
 #include "glfw_rendermanager.h"
 
+#include <utVisualization/utGeometryCache.h>
+#include <utVisualization/utResourcePool.h>
+#include <utVisualization/utShaderManager.h>
 #include <utVision/OpenCLManager.h>
+#include <utMeasurement/Timestamp.h>
 #include <utUtil/TracingProvider.h>
 
 #ifdef HAVE_OPENCL
@@ -20,9 +24,14 @@
 
 using namespace Ubitrack::Visualization;
 
+std::deque<GLFWwindow*> GLFWWindowImpl::s_prewarmedWindows;
+
+// GLEW's function pointers are process wide, contexts with the same pixel format need only one glewInit
+static bool g_bGlewInitialized = false;
+
 
 GLFWWindowImpl::GLFWWindowImpl(int _width, int _height, const std::string &_title)
-        : VirtualWindow(_width, _height, _title), m_pWindow(NULL)
+        : VirtualWindow(_width, _height, _title), m_pWindow(NULL), m_pShareWindow(NULL), m_renderStart(0.0), m_lastSwapTime(0.0)
 {
 
 }
@@ -37,6 +46,10 @@ bool GLFWWindowImpl::is_valid() {
 }
 
 bool GLFWWindowImpl::create() {
+	// a window kept across a dataflow reload is reused as it is
+	if (m_pWindow != NULL) {
+		return true;
+	}
 	std::cout << "Create GLFW Window." << std::endl;
 
 	// access OCL Manager and initialize if needed
@@ -50,7 +63,23 @@ bool GLFWWindowImpl::create() {
 		std::cout << "OCL Manager initialized: " << oclManager.isInitialized() << std::endl;
 	}
 
-	m_pWindow = glfwCreateWindow(m_width, m_height, m_title.c_str(), NULL, NULL);
+	// share GL objects (e.g. cached geometry) with the context provided by the application
+	m_pShareWindow = static_cast<GLFWwindow*>(RenderManager::singleton().getSharedOpenGLContext());
+	if (!s_prewarmedWindows.empty()) {
+		// reuse a hidden window whose context has been created ahead of time
+		m_pWindow = s_prewarmedWindows.front();
+		s_prewarmedWindows.pop_front();
+		glfwSetWindowTitle(m_pWindow, m_title.c_str());
+		glfwSetWindowSize(m_pWindow, m_width, m_height);
+		glfwShowWindow(m_pWindow);
+	} else {
+		m_pWindow = glfwCreateWindow(m_width, m_height, m_title.c_str(), NULL, m_pShareWindow);
+	}
+	if (m_pWindow != NULL) {
+		// the framebuffer may be larger than the window on high dpi displays
+		glfwGetFramebufferSize(m_pWindow, &m_width, &m_height);
+		m_adaptiveResolution->set_resource_owner(share_group(), m_title);
+	}
 
 	// set fullscreen ?
     return m_pWindow != NULL;
@@ -73,7 +102,9 @@ void GLFWWindowImpl::setFullscreen(bool fullscreen) {
 	}
 	else {
 		CameraHandle *cam = static_cast<CameraHandle*>(glfwGetWindowUserPointer(m_pWindow));
-		glfwSetWindowMonitor(m_pWindow, NULL, 0, 0, cam->initial_width(), cam->initial_height(), 0);
+		if (cam != NULL) {
+			glfwSetWindowMonitor(m_pWindow, NULL, 0, 0, cam->initial_width(), cam->initial_height(), 0);
+		}
 	}
 #else
 	std::cout << "GLFW Version below 3.2 does not support switching to fullscreen during runtime" << std::endl;
@@ -94,31 +125,29 @@ void GLFWWindowImpl::initGL(boost::shared_ptr<CameraHandle>& event_handler) {
 
 	glfwMakeContextCurrent(m_pWindow);
 
-#ifdef HAVE_GLEW
-    // Init GLEW for this context:
-	std::cout << "Initialize GLEW." << std::endl;
-	GLenum err = glewInit();
-    if (err != GLEW_OK)
-    {
-        // a problem occured when trying to init glew, report it:
-        std::cout << "GLEW Error occured, Description: " <<  glewGetErrorString(err) << std::endl;
+    if (!initGLEW()) {
         glfwDestroyWindow(m_pWindow);
+        m_pWindow = NULL;
         return;
     }
-#endif
 
 
+    // a kept or fresh context, the state set below goes through the cache so it is known afterwards
+    GLStateCache& state = *m_stateCache;
+    state.invalidate();
+    GLStateCache::set_current(&state);
+
     // GL: enable and set colors
-    glEnable(GL_COLOR_MATERIAL);
+    state.enable(GL_COLOR_MATERIAL);
     glClearColor(0.0, 0.0, 0.0, 1.0); // TODO: make this configurable (but black is best for optical see-through ar!)
 
     // GL: enable and set depth parameters
-    glEnable(GL_DEPTH_TEST);
+    state.enable(GL_DEPTH_TEST);
     glClearDepth(1.0);
 
     // GL: disable backface culling
     glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-    glDisable(GL_CULL_FACE);
+    state.disable(GL_CULL_FACE);
 
     // GL: light parameters
     GLfloat light_pos[] = {1.0f, 1.0f, 1.0f, 0.0f};
@@ -129,20 +158,20 @@ void GLFWWindowImpl::initGL(boost::shared_ptr<CameraHandle>& event_handler) {
     glLightfv(GL_LIGHT0, GL_POSITION, light_pos);
     glLightfv(GL_LIGHT0, GL_AMBIENT, light_amb);
     glLightfv(GL_LIGHT0, GL_DIFFUSE, light_dif);
-    glEnable(GL_LIGHTING);
-    glEnable(GL_LIGHT0);
+    state.enable(GL_LIGHTING);
+    state.enable(GL_LIGHT0);
 
     // GL: bitmap handling
     glPixelStorei(GL_PACK_ALIGNMENT, 1);
     glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
     // GL: alpha blending
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glEnable(GL_BLEND);
+    state.blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    state.enable(GL_BLEND);
 
     // GL: misc stuff
     glShadeModel(GL_SMOOTH);
-    glEnable(GL_NORMALIZE);
+    state.enable(GL_NORMALIZE);
 
     // setup callbacks:
     m_pEventHandler = event_handler;
@@ -158,8 +187,33 @@ void GLFWWindowImpl::initGL(boost::shared_ptr<CameraHandle>& event_handler) {
 
 }
 
+void GLFWWindowImpl::release_handler() {
+    if (m_pWindow != NULL) {
+        glfwSetWindowUserPointer(m_pWindow, NULL);
+    }
+    m_pEventHandler.reset();
+}
+
+void* GLFWWindowImpl::share_group() {
+    if (m_pShareWindow != NULL)
+        return m_pShareWindow;
+    return VirtualWindow::share_group();
+}
+
 void GLFWWindowImpl::destroy() {
     if (m_pWindow != NULL) {
+        // objects of a private context die with the window
+        if (m_pShareWindow == NULL) {
+            GeometryCache::singleton().drop_share_group(share_group());
+            ShaderManager::singleton().drop_share_group(share_group());
+            ResourcePool::singleton().drop_share_group(share_group());
+        }
+        glfwMakeContextCurrent(m_pWindow);
+        m_adaptiveResolution->release_gl();
+        m_performanceHud->release_gl();
+        m_renderTiming->release_gl();
+        if (GLStateCache::current() == m_stateCache.get())
+            GLStateCache::set_current(NULL);
         glfwSetWindowUserPointer(m_pWindow, NULL);
         glfwDestroyWindow(m_pWindow);
         m_pWindow = NULL;
@@ -168,10 +222,99 @@ void GLFWWindowImpl::destroy() {
 }
 
 
+bool GLFWWindowImpl::initGLEW() {
+#ifdef HAVE_GLEW
+    if (g_bGlewInitialized)
+        return true;
+
+    // Init GLEW for the current context:
+	std::cout << "Initialize GLEW." << std::endl;
+	GLenum err = glewInit();
+    if (err != GLEW_OK)
+    {
+        // a problem occured when trying to init glew, report it:
+        std::cout << "GLEW Error occured, Description: " <<  glewGetErrorString(err) << std::endl;
+        return false;
+    }
+    g_bGlewInitialized = true;
+#endif
+    return true;
+}
+
+void GLFWWindowImpl::prewarm(unsigned int count) {
+    GLFWwindow* share = static_cast<GLFWwindow*>(RenderManager::singleton().getSharedOpenGLContext());
+    glfwWindowHint(GLFW_VISIBLE, 0);
+    for (unsigned int i = 0; i < count; i++) {
+        GLFWwindow* window = glfwCreateWindow(640, 480, "", NULL, share);
+        if (window == NULL)
+            break;
+        s_prewarmedWindows.push_back(window);
+    }
+    glfwWindowHint(GLFW_VISIBLE, 1);
+}
+
+void GLFWWindowImpl::release_prewarmed() {
+    while (!s_prewarmedWindows.empty()) {
+        glfwDestroyWindow(s_prewarmedWindows.front());
+        s_prewarmedWindows.pop_front();
+    }
+}
+
 void GLFWWindowImpl::pre_render() {
     glfwMakeContextCurrent(m_pWindow);
+    // components may have changed GL state behind the cache since the last frame
+    m_stateCache->invalidate(GLStateCache::STATE_ALL);
+    GLStateCache::set_current(m_stateCache.get());
+    m_renderStart = glfwGetTime();
+    ResourcePool::singleton().collect_garbage(share_group());
+    // results of earlier frames only, the query of this frame is read a few frames later
+    m_renderTiming->poll();
+    m_renderTiming->begin();
+    m_adaptiveResolution->begin_frame(m_width, m_height);
 }
 
 void GLFWWindowImpl::post_render() {
+    finish_render();
+    swap();
+}
+
+void GLFWWindowImpl::make_current() {
+    glfwMakeContextCurrent(m_pWindow);
+    GLStateCache::set_current(m_stateCache.get());
+}
+
+void GLFWWindowImpl::finish_render() {
+    if (m_adaptiveResolution->enabled()) {
+        m_adaptiveResolution->end_frame();
+        m_stateCache->invalidate(GLStateCache::STATE_VIEWPORT | GLStateCache::STATE_FRAMEBUFFER);
+    }
+    double now = glfwGetTime();
+    double renderTime = (now - m_renderStart) * 1000.;
+    m_renderTiming->end(renderTime);
+    if (m_adaptiveResolution->update(renderTime)) {
+        std::cout << "Window " << m_title << ": resolution scale " << m_adaptiveResolution->scale() << std::endl;
+    }
+
+    // the overlay is drawn at window resolution, on top of a scaled frame
+    m_performanceHud->record_frame(now, renderTime, m_lastSwapTime);
+    m_performanceHud->set_gpu_time(m_renderTiming->gpu_time());
+    if (m_performanceHud->visible()) {
+        if (m_pEventHandler) {
+            unsigned long long timestamp = m_pEventHandler->render_timestamp();
+            if (timestamp == 0)
+                timestamp = m_pEventHandler->latest_timestamp();
+            double dataAge = -1.0;
+            Ubitrack::Measurement::Timestamp current = Ubitrack::Measurement::now();
+            if (timestamp > 0 && timestamp <= current)
+                dataAge = (current - timestamp) * 1e-6;
+            m_performanceHud->set_data_statistics(dataAge, m_pEventHandler->dropped_frames(), m_pEventHandler->queue_depth());
+        }
+        m_performanceHud->draw(m_width, m_height);
+    }
+}
+
+void GLFWWindowImpl::swap() {
+    double start = glfwGetTime();
     glfwSwapBuffers(m_pWindow);
+    m_lastSwapTime = (glfwGetTime() - start) * 1000.;
 }
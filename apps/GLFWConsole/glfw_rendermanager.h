@@ -6,6 +6,7 @@
 #define UBITRACK_GLFW_RENDERMANAGER_H
 
 #include <string>
+#include <deque>
 
 #ifdef HAVE_GLEW
 	#include "GL/glew.h"
@@ -13,6 +14,10 @@
 #include <GLFW/glfw3.h>
 
 #include <utVisualization/utRenderAPI.h>
+#include <utVisualization/utAdaptiveResolution.h>
+#include <utVisualization/utGLStateCache.h>
+#include <utVisualization/utPerformanceHud.h>
+#include <utVisualization/utRenderTiming.h>
 
 namespace Ubitrack {
     namespace Visualization {
@@ -26,6 +31,11 @@ namespace Ubitrack {
             virtual void pre_render();
             virtual void post_render();
 
+            // post_render split for synchronized presentation: finish the frame, swap later
+            void make_current();
+            void finish_render();
+            void swap();
+
 			virtual void reshape(int w, int h);
 
 			//custom extensions
@@ -38,9 +48,27 @@ namespace Ubitrack {
             virtual bool create();
             virtual void initGL(boost::shared_ptr<CameraHandle>& cam);
             virtual void destroy();
+            virtual void* share_group();
+            virtual void release_handler();
+
+            /**
+             * create hidden windows ahead of time, sharing with the render manager's shared context.
+             * Context creation is the slow part of opening a window; create() takes windows from this pool.
+             * Main thread only, like all window creation.
+             */
+            static void prewarm(unsigned int count);
+            static void release_prewarmed();
+
+            /** initialize GLEW once for the current context, returns false if it failed */
+            static bool initGLEW();
 
         private:
+            static std::deque<GLFWwindow*> s_prewarmedWindows;
+
             GLFWwindow*	m_pWindow;
+            GLFWwindow*	m_pShareWindow;
+            double m_renderStart;
+            double m_lastSwapTime;
             boost::shared_ptr<CameraHandle> m_pEventHandler;
         };
 
@@ -50,16 +78,22 @@ namespace Ubitrack {
                 int w,
                 int h) {
             CameraHandle *cam = static_cast<CameraHandle*>(glfwGetWindowUserPointer(win));
+            if (cam == NULL)
+                return;
             cam->on_window_size(w, h);
         }
 
         inline static void WindowRefreshCallback(GLFWwindow *win) {
             CameraHandle *cam = static_cast<CameraHandle*>(glfwGetWindowUserPointer(win));
+            if (cam == NULL)
+                return;
             cam->on_render(glfwGetTime());
         }
 
         inline static void WindowCloseCallback(GLFWwindow *win) {
             CameraHandle *cam = static_cast<CameraHandle*>(glfwGetWindowUserPointer(win));
+            if (cam == NULL)
+                return;
             cam->on_window_close();
         }
 
@@ -69,6 +103,8 @@ namespace Ubitrack {
                                              int action,
                                              int mods) {
             CameraHandle *cam = static_cast<CameraHandle*>(glfwGetWindowUserPointer(win));
+            if (cam == NULL)
+                return;
 			if ((action == GLFW_PRESS) && (mods & GLFW_MOD_ALT)) {
 				switch (key) {
 				case GLFW_KEY_F:
@@ -95,6 +131,8 @@ namespace Ubitrack {
                                              double xpos,
                                              double ypos) {
             CameraHandle *cam = static_cast<CameraHandle*>(glfwGetWindowUserPointer(win));
+            if (cam == NULL)
+                return;
             cam->on_cursorpos(xpos, ypos);
         }
 
@@ -0,0 +1,242 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * Benchmark for the GL state cache.
+ *
+ * Draws a scene of many small objects the way camera handles typically do,
+ * each setting and resetting its state defensively, once with direct GL calls
+ * and once through the GLStateCache, and reports driver calls and frame time.
+ * The cache is invalidated before every frame, as the console does.
+ */
+
+#include <utVisualization/utOpenGL.h>
+#include <GLFW/glfw3.h>
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <cstdlib>
+
+#include <utVisualization/utGLStateCache.h>
+
+using namespace Ubitrack::Visualization;
+
+// passes every state change to the driver, counting the calls
+struct DirectState
+{
+	unsigned long long calls;
+
+	DirectState() : calls( 0 ) {}
+
+	void enable( GLenum cap ) { glEnable( cap ); calls++; }
+	void disable( GLenum cap ) { glDisable( cap ); calls++; }
+	void blend_func( GLenum src, GLenum dst ) { glBlendFunc( src, dst ); calls++; }
+	void depth_mask( bool write ) { glDepthMask( write ? GL_TRUE : GL_FALSE ); calls++; }
+	void viewport( GLint x, GLint y, GLsizei w, GLsizei h ) { glViewport( x, y, w, h ); calls++; }
+	void bind_texture( GLenum target, GLuint texture ) { glBindTexture( target, texture ); calls++; }
+	void bind_buffer( GLenum target, GLuint buffer ) { glBindBuffer( target, buffer ); calls++; }
+	void invalidate() {}
+	unsigned long long issued_calls() const { return calls; }
+};
+
+struct SceneObject
+{
+	GLuint texture;
+	bool transparent;
+	bool lit;
+	float position[ 3 ];
+};
+
+static const int g_windowSize = 256;
+
+// one frame of a representative overlay: video background, tracked objects, annotations
+template< class State >
+void drawFrame( State& state, const std::vector< SceneObject >& objects, GLuint vertexBuffer, GLuint indexBuffer, GLuint background )
+{
+	state.viewport( 0, 0, g_windowSize, g_windowSize );
+	glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+
+	// background image
+	state.disable( GL_LIGHTING );
+	state.disable( GL_DEPTH_TEST );
+	state.enable( GL_TEXTURE_2D );
+	state.bind_texture( GL_TEXTURE_2D, background );
+	glBegin( GL_QUADS );
+	glTexCoord2f( 0, 0 ); glVertex2f( -1, -1 );
+	glTexCoord2f( 1, 0 ); glVertex2f( 1, -1 );
+	glTexCoord2f( 1, 1 ); glVertex2f( 1, 1 );
+	glTexCoord2f( 0, 1 ); glVertex2f( -1, 1 );
+	glEnd();
+	state.bind_texture( GL_TEXTURE_2D, 0 );
+	state.disable( GL_TEXTURE_2D );
+	state.enable( GL_DEPTH_TEST );
+	state.enable( GL_LIGHTING );
+
+	glEnableClientState( GL_VERTEX_ARRAY );
+	for ( std::size_t i = 0; i < objects.size(); i++ )
+	{
+		const SceneObject& o = objects[ i ];
+
+		// every object sets up everything it needs ...
+		state.viewport( 0, 0, g_windowSize, g_windowSize );
+		state.enable( GL_DEPTH_TEST );
+		state.depth_mask( !o.transparent );
+		if ( o.lit ) state.enable( GL_LIGHTING ); else state.disable( GL_LIGHTING );
+		if ( o.transparent )
+		{
+			state.enable( GL_BLEND );
+			state.blend_func( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA );
+		}
+		if ( o.texture )
+		{
+			state.enable( GL_TEXTURE_2D );
+			state.bind_texture( GL_TEXTURE_2D, o.texture );
+		}
+		state.bind_buffer( GL_ARRAY_BUFFER, vertexBuffer );
+		state.bind_buffer( GL_ELEMENT_ARRAY_BUFFER, indexBuffer );
+
+		glPushMatrix();
+		glTranslatef( o.position[ 0 ], o.position[ 1 ], o.position[ 2 ] );
+		glVertexPointer( 3, GL_FLOAT, 0, 0 );
+		glDrawElements( GL_TRIANGLES, 3, GL_UNSIGNED_SHORT, 0 );
+		glPopMatrix();
+
+		// ... and resets it defensively afterwards
+		state.bind_buffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
+		state.bind_buffer( GL_ARRAY_BUFFER, 0 );
+		if ( o.texture )
+		{
+			state.bind_texture( GL_TEXTURE_2D, 0 );
+			state.disable( GL_TEXTURE_2D );
+		}
+		if ( o.transparent )
+			state.disable( GL_BLEND );
+		state.depth_mask( true );
+		state.enable( GL_LIGHTING );
+	}
+	glDisableClientState( GL_VERTEX_ARRAY );
+}
+
+template< class State >
+void run( const char* name, State& state, const std::vector< SceneObject >& objects, GLuint vertexBuffer, GLuint indexBuffer,
+	GLuint background, int frames, GLFWwindow* window )
+{
+	// warm up the driver before measuring
+	state.invalidate();
+	drawFrame( state, objects, vertexBuffer, indexBuffer, background );
+	glFinish();
+
+	unsigned long long before = state.issued_calls();
+	double start = glfwGetTime();
+	for ( int f = 0; f < frames; f++ )
+	{
+		// the console forgets all state at the start of every frame, so savings only come from within one frame
+		state.invalidate();
+		drawFrame( state, objects, vertexBuffer, indexBuffer, background );
+		glfwSwapBuffers( window );
+	}
+	glFinish();
+	double elapsed = ( glfwGetTime() - start ) * 1000.0 / frames;
+	unsigned long long calls = ( state.issued_calls() - before ) / frames;
+
+	std::cout << std::setw( 10 ) << name << std::setw( 16 ) << calls << std::setw( 16 ) << std::fixed << std::setprecision( 3 )
+		<< elapsed << std::endl;
+}
+
+int main( int ac, char** av )
+{
+	int objectCount = ac > 1 ? std::atoi( av[ 1 ] ) : 1000;
+	int frames = ac > 2 ? std::atoi( av[ 2 ] ) : 200;
+
+	if ( !glfwInit() )
+	{
+		std::cerr << "Cannot initialize GLFW" << std::endl;
+		return 1;
+	}
+	glfwWindowHint( GLFW_VISIBLE, 0 );
+	GLFWwindow* window = glfwCreateWindow( g_windowSize, g_windowSize, "utGLStateBenchmark", NULL, NULL );
+	if ( window == NULL )
+	{
+		std::cerr << "Cannot create an OpenGL context" << std::endl;
+		glfwTerminate();
+		return 1;
+	}
+	glfwMakeContextCurrent( window );
+	glfwSwapInterval( 0 );
+#ifdef HAVE_GLEW
+	glewInit();
+#endif
+	std::cout << "Renderer: " << glGetString( GL_RENDERER ) << std::endl;
+
+	// a single triangle is enough, the benchmark is about state changes
+	GLfloat vertices[] = { 0, 0, 0, 0.01f, 0, 0, 0, 0.01f, 0 };
+	GLushort indices[] = { 0, 1, 2 };
+	GLuint buffers[ 2 ];
+	glGenBuffers( 2, buffers );
+	glBindBuffer( GL_ARRAY_BUFFER, buffers[ 0 ] );
+	glBufferData( GL_ARRAY_BUFFER, sizeof( vertices ), vertices, GL_STATIC_DRAW );
+	glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, buffers[ 1 ] );
+	glBufferData( GL_ELEMENT_ARRAY_BUFFER, sizeof( indices ), indices, GL_STATIC_DRAW );
+	glBindBuffer( GL_ARRAY_BUFFER, 0 );
+	glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
+
+	GLuint textures[ 4 ];
+	glGenTextures( 4, textures );
+	unsigned char pixels[ 4 * 4 * 4 ] = { 0 };
+	for ( int t = 0; t < 4; t++ )
+	{
+		glBindTexture( GL_TEXTURE_2D, textures[ t ] );
+		glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA, 4, 4, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels );
+	}
+	glBindTexture( GL_TEXTURE_2D, 0 );
+
+	// mostly opaque untextured markers, some labels and transparent error ellipsoids
+	std::vector< SceneObject > objects( objectCount );
+	std::srand( 42 );
+	for ( int i = 0; i < objectCount; i++ )
+	{
+		objects[ i ].texture = ( i % 10 == 0 ) ? textures[ 1 + i % 3 ] : 0;
+		objects[ i ].transparent = ( i % 4 == 0 );
+		objects[ i ].lit = ( i % 10 != 0 );
+		for ( int k = 0; k < 3; k++ )
+			objects[ i ].position[ k ] = ( std::rand() % 2000 ) / 1000.0f - 1.0f;
+	}
+
+	std::cout << objectCount << " objects, " << frames << " frames" << std::endl;
+	std::cout << std::setw( 10 ) << "mode" << std::setw( 16 ) << "calls/frame" << std::setw( 16 ) << "ms/frame" << std::endl;
+
+	DirectState direct;
+	run( "direct", direct, objects, buffers[ 0 ], buffers[ 1 ], textures[ 0 ], frames, window );
+
+	GLStateCache cache;
+	run( "cached", cache, objects, buffers[ 0 ], buffers[ 1 ], textures[ 0 ], frames, window );
+	std::cout << "elided " << cache.elided_calls() * 100 / ( cache.elided_calls() + cache.issued_calls() )
+		<< "% of the state changes" << std::endl;
+
+	glDeleteTextures( 4, textures );
+	glDeleteBuffers( 2, buffers );
+	glfwDestroyWindow( window );
+	glfwTerminate();
+	return 0;
+}
@@ -0,0 +1,202 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * Benchmark for the scene index.
+ *
+ * Renders scenes of growing size with a fraction of the objects moving every
+ * frame, once submitting every object to the instance batch and once culling
+ * against the camera frustum through a SceneIndex, and reports how the frame
+ * time scales with the number of objects.
+ */
+
+#include <utVisualization/utOpenGL.h>
+#include <GLFW/glfw3.h>
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+
+#include <utVisualization/utInstanceBatch.h>
+#include <utVisualization/utSceneIndex.h>
+
+using namespace Ubitrack::Visualization;
+
+struct SceneObject
+{
+	SceneIndex::ObjectId id;
+	float pose[ 16 ];
+	float scale[ 3 ];
+	float color[ 4 ];
+};
+
+static const int g_windowSize = 256;
+
+// objects are spread over a cube of this half size around the camera
+static const float g_sceneExtent = 100.0f;
+
+// share of the objects receiving a new pose per frame, like tracked annotations
+static const int g_movingPercent = 5;
+
+float randomCoordinate()
+{
+	return ( std::rand() % 20001 ) / 10000.0f * g_sceneExtent - g_sceneExtent;
+}
+
+void moveObjects( std::vector< SceneObject >& objects, SceneIndex& scene )
+{
+	for ( std::size_t i = 0; i < objects.size() * g_movingPercent / 100; i++ )
+	{
+		SceneObject& o = objects[ std::rand() % objects.size() ];
+		for ( int k = 0; k < 3; k++ )
+			o.pose[ 12 + k ] += ( std::rand() % 201 - 100 ) / 1000.0f;
+		scene.set_pose( o.id, o.pose );
+	}
+}
+
+struct Result
+{
+	double frameTime;
+	double cullTime;
+	std::size_t submitted;
+};
+
+Result run( bool culled, std::vector< SceneObject >& objects, SceneIndex& scene, InstanceBatch& batch, int frames, GLFWwindow* window )
+{
+	Result result = { 0.0, 0.0, 0 };
+	for ( int f = -1; f < frames; f++ )
+	{
+		// the first frame warms up the driver and builds the hierarchy
+		if ( f == 0 )
+		{
+			glFinish();
+			result = Result();
+		}
+		double start = glfwGetTime();
+		moveObjects( objects, scene );
+
+		glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+		batch.clear();
+		if ( culled )
+		{
+			double cullStart = glfwGetTime();
+			result.submitted += scene.submit( batch );
+			result.cullTime += glfwGetTime() - cullStart;
+		}
+		else
+		{
+			for ( std::size_t i = 0; i < objects.size(); i++ )
+				batch.add( InstanceBatch::SHAPE_BOX, objects[ i ].pose, objects[ i ].scale, objects[ i ].color );
+			result.submitted += objects.size();
+		}
+		batch.draw();
+		glfwSwapBuffers( window );
+		glFinish();
+		result.frameTime += glfwGetTime() - start;
+	}
+	result.frameTime *= 1000.0 / frames;
+	result.cullTime *= 1000.0 / frames;
+	result.submitted /= frames;
+	return result;
+}
+
+int main( int ac, char** av )
+{
+	int maxObjects = ac > 1 ? std::atoi( av[ 1 ] ) : 64000;
+	int frames = ac > 2 ? std::atoi( av[ 2 ] ) : 100;
+
+	if ( !glfwInit() )
+	{
+		std::cerr << "Cannot initialize GLFW" << std::endl;
+		return 1;
+	}
+	glfwWindowHint( GLFW_VISIBLE, 0 );
+	GLFWwindow* window = glfwCreateWindow( g_windowSize, g_windowSize, "utSceneBenchmark", NULL, NULL );
+	if ( window == NULL )
+	{
+		std::cerr << "Cannot create an OpenGL context" << std::endl;
+		glfwTerminate();
+		return 1;
+	}
+	glfwMakeContextCurrent( window );
+	glfwSwapInterval( 0 );
+#ifdef HAVE_GLEW
+	glewInit();
+#endif
+	std::cout << "Renderer: " << glGetString( GL_RENDERER ) << std::endl;
+
+	// 60 degree perspective camera at the centre of the scene, looking down -z
+	const float zNear = 0.1f;
+	const float zFar = 2.0f * g_sceneExtent;
+	const float f = 1.0f / std::tan( 30.0f * 3.14159265f / 180.0f );
+	const GLfloat projection[ 16 ] = {
+		f, 0, 0, 0,
+		0, f, 0, 0,
+		0, 0, ( zFar + zNear ) / ( zNear - zFar ), -1,
+		0, 0, 2 * zFar * zNear / ( zNear - zFar ), 0
+	};
+	glViewport( 0, 0, g_windowSize, g_windowSize );
+	glMatrixMode( GL_PROJECTION );
+	glLoadMatrixf( projection );
+	glMatrixMode( GL_MODELVIEW );
+	glLoadIdentity();
+	glEnable( GL_DEPTH_TEST );
+
+	std::cout << frames << " frames per run, " << g_movingPercent << "% of the objects move per frame" << std::endl;
+	std::cout << std::setw( 10 ) << "objects" << std::setw( 12 ) << "visible" << std::setw( 16 ) << "all ms/frame"
+		<< std::setw( 16 ) << "culled ms/frame" << std::setw( 12 ) << "cull ms" << std::endl;
+
+	InstanceBatch batch;
+	std::srand( 42 );
+	for ( int count = 1000; count <= maxObjects; count *= 2 )
+	{
+		SceneIndex scene;
+		std::vector< SceneObject > objects( count );
+		for ( int i = 0; i < count; i++ )
+		{
+			SceneObject& o = objects[ i ];
+			const float pose[ 16 ] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, randomCoordinate(), randomCoordinate(), randomCoordinate(), 1 };
+			std::copy( pose, pose + 16, o.pose );
+			std::fill( o.scale, o.scale + 3, 0.2f );
+			o.color[ 0 ] = ( i % 3 ) / 2.0f;
+			o.color[ 1 ] = ( i % 5 ) / 4.0f;
+			o.color[ 2 ] = ( i % 7 ) / 6.0f;
+			o.color[ 3 ] = 1.0f;
+			o.id = scene.insert( InstanceBatch::SHAPE_BOX, o.pose, o.scale, o.color );
+		}
+
+		Result all = run( false, objects, scene, batch, frames, window );
+		Result culled = run( true, objects, scene, batch, frames, window );
+		std::cout << std::setw( 10 ) << count << std::setw( 12 ) << culled.submitted << std::fixed << std::setprecision( 3 )
+			<< std::setw( 16 ) << all.frameTime << std::setw( 16 ) << culled.frameTime << std::setw( 12 ) << culled.cullTime << std::endl;
+	}
+	std::cout << "index rebuilds are included in the culled frame time" << std::endl;
+
+	batch.release_gl();
+	glfwDestroyWindow( window );
+	glfwTerminate();
+	return 0;
+}
@@ -0,0 +1,166 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * Test publisher for the split mode.
+ *
+ * Stands in for a dataflow started with utGLFWConsole --split: it registers
+ * RemoteCameraHandles the way camera components do and publishes a moving
+ * test pattern and a rotating pose through shared memory, so a render server
+ * started with utGLFWConsole --render_server has something to show.
+ */
+
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+#include <csignal>
+
+#include <boost/thread.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include <utMeasurement/Timestamp.h>
+#include <utVisualization/utRenderAPI.h>
+#include <utVisualization/utRemoteCamera.h>
+
+using namespace Ubitrack;
+using namespace Ubitrack::Visualization;
+
+volatile sig_atomic_t bStop = 0;
+
+void ctrlC ( int i )
+{
+	bStop = 1;
+}
+
+// the rings only need the shared memory, there is no window in this process
+bool setupPublisher( boost::shared_ptr<CameraHandle>& cam )
+{
+	boost::shared_ptr<VirtualWindow> noWindow;
+	return cam->setup( noWindow );
+}
+
+// column major perspective projection
+void perspective( float fovy, float aspect, float zNear, float zFar, float m[ 16 ] )
+{
+	float f = 1.0f / std::tan( fovy * 0.5f * 3.14159265f / 180.0f );
+	for ( int i = 0; i < 16; i++ )
+		m[ i ] = 0.0f;
+	m[ 0 ] = f / aspect;
+	m[ 5 ] = f;
+	m[ 10 ] = ( zFar + zNear ) / ( zNear - zFar );
+	m[ 11 ] = -1.0f;
+	m[ 14 ] = 2.0f * zFar * zNear / ( zNear - zFar );
+}
+
+// column major model view of an object rotating about the y axis half a meter in front of the camera
+void rotatingPose( float angle, float m[ 16 ] )
+{
+	float c = std::cos( angle );
+	float s = std::sin( angle );
+	float pose[ 16 ] = {
+		c, 0.0f, -s, 0.0f,
+		0.0f, 1.0f, 0.0f, 0.0f,
+		s, 0.0f, c, 0.0f,
+		0.0f, 0.0f, -0.5f, 1.0f };
+	for ( int i = 0; i < 16; i++ )
+		m[ i ] = pose[ i ];
+}
+
+// BGR color bars scrolling by one column per frame
+void testPattern( int width, int height, unsigned long frame, std::vector< unsigned char >& pixels )
+{
+	static const unsigned char bars[ 8 ][ 3 ] = {
+		{ 255, 255, 255 }, { 0, 255, 255 }, { 255, 255, 0 }, { 0, 255, 0 },
+		{ 255, 0, 255 }, { 0, 0, 255 }, { 255, 0, 0 }, { 0, 0, 0 } };
+	pixels.resize( static_cast< std::size_t >( width ) * height * 3 );
+	for ( int y = 0; y < height; y++ )
+	{
+		unsigned char* row = &pixels[ static_cast< std::size_t >( y ) * width * 3 ];
+		for ( int x = 0; x < width; x++ )
+		{
+			const unsigned char* bar = bars[ ( ( x + frame ) % width ) * 8 / width ];
+			row[ 3 * x ] = bar[ 0 ];
+			row[ 3 * x + 1 ] = bar[ 1 ];
+			row[ 3 * x + 2 ] = bar[ 2 ];
+		}
+	}
+}
+
+int main( int ac, char** av )
+{
+	int cameraCount = ac > 1 ? std::atoi( av[ 1 ] ) : 1;
+	int width = ac > 2 ? std::atoi( av[ 2 ] ) : 640;
+	int height = ac > 3 ? std::atoi( av[ 3 ] ) : 480;
+	int fps = ac > 4 ? std::atoi( av[ 4 ] ) : 30;
+	if ( cameraCount < 1 || width < 8 || height < 1 || fps < 1 )
+	{
+		std::cerr << "Usage: " << av[ 0 ] << " [cameras] [width] [height] [fps]" << std::endl;
+		return 1;
+	}
+
+	signal( SIGINT, &ctrlC );
+	signal( SIGTERM, &ctrlC );
+
+	RenderManager& renderManager = RenderManager::singleton();
+	renderManager.set_split_mode( true );
+
+	float projection[ 16 ];
+	perspective( 60.0f, static_cast< float >( width ) / height, 0.01f, 100.0f, projection );
+	std::vector< boost::shared_ptr<RemoteCameraHandle> > cameras;
+	for ( int i = 0; i < cameraCount; i++ )
+	{
+		std::ostringstream title;
+		title << "Split test pattern " << i + 1;
+		std::string name = title.str();
+		boost::shared_ptr<RemoteCameraHandle> remote( new RemoteCameraHandle( name, width, height ) );
+		remote->set_projection( projection );
+		boost::shared_ptr<CameraHandle> cam( remote );
+		renderManager.register_camera( cam );
+		cameras.push_back( remote );
+	}
+	std::cout << "Publishing " << cameraCount << " camera(s), start utGLFWConsole --render_server to show them" << std::endl;
+
+	std::vector< unsigned char > pixels;
+	float pose[ 1 ][ 16 ];
+	for ( unsigned long frame = 0; !bStop; frame++ )
+	{
+		// setups that fail, e.g. while the registry cannot be created, are retried with a growing delay
+		renderManager.process_setup( &setupPublisher );
+
+		testPattern( width, height, frame, pixels );
+		Measurement::Timestamp timestamp = Measurement::now();
+		for ( std::size_t i = 0; i < cameras.size(); i++ )
+		{
+			rotatingPose( frame * 0.02f + i, pose[ 0 ] );
+			cameras[ i ]->set_poses( pose, 1 );
+			cameras[ i ]->publish_image( timestamp, width, height, 3, &pixels[ 0 ] );
+		}
+		boost::this_thread::sleep( boost::posix_time::milliseconds( 1000 / fps ) );
+	}
+
+	// withdraw the rings, so the render server closes the windows
+	renderManager.teardown();
+	return 0;
+}
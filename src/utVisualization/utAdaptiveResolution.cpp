@@ -0,0 +1,240 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+#include "utAdaptiveResolution.h"
+
+#include <algorithm>
+
+#include <log4cpp/Category.hh>
+
+using namespace Ubitrack;
+using namespace Ubitrack::Visualization;
+
+static log4cpp::Category& logger(log4cpp::Category::getInstance("utVisualization.AdaptiveResolution"));
+
+// offscreen targets are rounded up to this granularity so small scale changes do not reallocate
+static const int g_sizeGranularity = 16;
+
+// weight of the newest sample in the frame time average
+static const double g_smoothing = 0.2;
+
+
+AdaptiveResolution::Settings::Settings()
+        : targetFrameTime(0.0)
+        , minScale(0.25)
+        , maxScale(1.0)
+        , stepDown(0.1)
+        , stepUp(0.05)
+        , headroom(0.75)
+        , hysteresisFrames(10)
+{
+}
+
+
+AdaptiveResolution::AdaptiveResolution()
+        : m_scale(1.0)
+        , m_averageFrameTime(0.0)
+        , m_overBudget(0)
+        , m_underBudget(0)
+        , m_bSupported(true)
+        , m_bActive(false)
+        , m_windowWidth(0)
+        , m_windowHeight(0)
+        , m_renderWidth(0)
+        , m_renderHeight(0)
+        , m_targetWidth(0)
+        , m_targetHeight(0)
+        , m_pShareGroup(NULL)
+        , m_framebuffer(0)
+{
+}
+
+AdaptiveResolution::~AdaptiveResolution() {
+    // GL resources must be released explicitly with release_gl(), the context may be gone here
+}
+
+void AdaptiveResolution::set_settings(const Settings& settings) {
+    m_settings = settings;
+    m_settings.minScale = std::max(0.05, std::min(m_settings.minScale, 1.0));
+    m_settings.maxScale = std::max(m_settings.minScale, std::min(m_settings.maxScale, 1.0));
+    m_scale = std::max(m_settings.minScale, std::min(m_scale, m_settings.maxScale));
+    m_overBudget = 0;
+    m_underBudget = 0;
+}
+
+void AdaptiveResolution::set_resource_owner(void* share_group, const std::string& owner) {
+    m_pShareGroup = share_group;
+    m_sOwner = owner;
+}
+
+bool AdaptiveResolution::allocate(int width, int height) {
+    if (m_framebuffer == 0) {
+        if (!hasGLVersion(3, 0) && !hasGLExtension("GL_ARB_framebuffer_object")) {
+            LOG4CPP_WARN(logger, "Framebuffer objects are not supported, adaptive resolution disabled");
+            m_bSupported = false;
+            return false;
+        }
+        glGenFramebuffers(1, &m_framebuffer);
+    }
+
+    // the previous target goes back to the pool first, shrinking and growing again reuses it
+    m_pColorTexture.reset();
+    m_pDepthBuffer.reset();
+    ResourcePool& pool = ResourcePool::singleton();
+    void* shareGroup = m_pShareGroup ? m_pShareGroup : this;
+    m_pColorTexture = pool.acquire_texture(shareGroup, GL_RGBA8, width, height, m_sOwner);
+    m_pDepthBuffer = pool.acquire_renderbuffer(shareGroup, GL_DEPTH24_STENCIL8, width, height, 0, m_sOwner);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_pColorTexture->id(), 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, m_pDepthBuffer->id());
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        LOG4CPP_WARN(logger, "Offscreen target incomplete (status " << status << "), adaptive resolution disabled");
+        release_gl();
+        m_bSupported = false;
+        return false;
+    }
+
+    m_targetWidth = width;
+    m_targetHeight = height;
+    LOG4CPP_DEBUG(logger, "Allocated offscreen target " << width << "x" << height);
+    return true;
+}
+
+bool AdaptiveResolution::begin_frame(int windowWidth, int windowHeight) {
+    m_bActive = false;
+    m_windowWidth = windowWidth;
+    m_windowHeight = windowHeight;
+    m_renderWidth = windowWidth;
+    m_renderHeight = windowHeight;
+    if (!enabled() || windowWidth <= 0 || windowHeight <= 0)
+        return false;
+
+    // at full scale there is nothing to gain from the indirection
+    if (m_scale >= 1.0) {
+        glViewport(0, 0, windowWidth, windowHeight);
+        return false;
+    }
+
+    m_renderWidth = std::max(1, static_cast< int >(windowWidth * m_scale + 0.5));
+    m_renderHeight = std::max(1, static_cast< int >(windowHeight * m_scale + 0.5));
+    int width = ((m_renderWidth + g_sizeGranularity - 1) / g_sizeGranularity) * g_sizeGranularity;
+    int height = ((m_renderHeight + g_sizeGranularity - 1) / g_sizeGranularity) * g_sizeGranularity;
+    if ((width > m_targetWidth || height > m_targetHeight || m_framebuffer == 0) && !allocate(width, height)) {
+        m_renderWidth = windowWidth;
+        m_renderHeight = windowHeight;
+        return false;
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+    glViewport(0, 0, m_renderWidth, m_renderHeight);
+    m_bActive = true;
+    return true;
+}
+
+void AdaptiveResolution::end_frame() {
+    if (!m_bActive)
+        return;
+    m_bActive = false;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, m_windowWidth, m_windowHeight);
+
+    // a textured quad also works for multisampled window framebuffers, unlike glBlitFramebuffer
+    glPushAttrib(GL_ENABLE_BIT | GL_TEXTURE_BIT | GL_CURRENT_BIT);
+    glDisable(GL_LIGHTING);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_BLEND);
+    glEnable(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, m_pColorTexture->id());
+    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+    glColor4f(1.0f, 1.0f, 1.0f, 1.0f);
+
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadIdentity();
+
+    float u = static_cast< float >(m_renderWidth) / m_targetWidth;
+    float v = static_cast< float >(m_renderHeight) / m_targetHeight;
+    glBegin(GL_QUADS);
+    glTexCoord2f(0, 0); glVertex2f(-1, -1);
+    glTexCoord2f(u, 0); glVertex2f(1, -1);
+    glTexCoord2f(u, v); glVertex2f(1, 1);
+    glTexCoord2f(0, v); glVertex2f(-1, 1);
+    glEnd();
+
+    glPopMatrix();
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glPopAttrib();
+}
+
+bool AdaptiveResolution::update(double frameTime) {
+    if (!enabled())
+        return false;
+
+    m_averageFrameTime = (m_averageFrameTime == 0.0) ? frameTime
+        : (1.0 - g_smoothing) * m_averageFrameTime + g_smoothing * frameTime;
+
+    double scale = m_scale;
+    if (m_averageFrameTime > m_settings.targetFrameTime) {
+        m_underBudget = 0;
+        if (++m_overBudget >= m_settings.hysteresisFrames) {
+            scale = std::max(m_settings.minScale, m_scale - m_settings.stepDown);
+            m_overBudget = 0;
+        }
+    } else if (m_averageFrameTime < m_settings.targetFrameTime * m_settings.headroom) {
+        m_overBudget = 0;
+        if (++m_underBudget >= m_settings.hysteresisFrames) {
+            scale = std::min(m_settings.maxScale, m_scale + m_settings.stepUp);
+            m_underBudget = 0;
+        }
+    } else {
+        m_overBudget = 0;
+        m_underBudget = 0;
+    }
+
+    if (scale == m_scale)
+        return false;
+    m_scale = scale;
+    return true;
+}
+
+void AdaptiveResolution::release_gl() {
+    if (m_framebuffer != 0)
+        glDeleteFramebuffers(1, &m_framebuffer);
+    m_framebuffer = 0;
+    m_pColorTexture.reset();
+    m_pDepthBuffer.reset();
+    m_targetWidth = 0;
+    m_targetHeight = 0;
+}
@@ -0,0 +1,138 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @ingroup visualization
+ * @file
+ * Dynamic resolution scaling of a window under a frame time budget.
+ *
+ * When enabled, the scene is rendered into an offscreen target whose size is
+ * the window size times a scale factor. The factor is lowered when measured
+ * frame times exceed the budget and raised again when there is headroom; the
+ * target is stretched over the window when the frame is presented.
+ */
+
+#ifndef UBITRACK_UTADAPTIVERESOLUTION_H
+#define UBITRACK_UTADAPTIVERESOLUTION_H
+
+#include <string>
+#include <boost/shared_ptr.hpp>
+
+#include <utVisualization/Config.h>
+#include <utVisualization/utOpenGL.h>
+#include <utVisualization/utResourcePool.h>
+
+namespace Ubitrack {
+    namespace Visualization {
+
+        class UBITRACK_EXPORT AdaptiveResolution {
+
+        public:
+
+            struct Settings {
+                /** frame time budget in milliseconds, 0 disables adaptive resolution */
+                double targetFrameTime;
+                double minScale;
+                double maxScale;
+                /** scale change per adjustment when over / under budget */
+                double stepDown;
+                double stepUp;
+                /** the scale is only raised if the frame time is below targetFrameTime * headroom */
+                double headroom;
+                /** number of consecutive frames over / under budget before the scale changes */
+                unsigned int hysteresisFrames;
+
+                Settings();
+            };
+
+            AdaptiveResolution();
+            ~AdaptiveResolution();
+
+            void set_settings(const Settings& settings);
+            const Settings& settings() const {
+                return m_settings;
+            }
+
+            /** share group and owner name under which the offscreen target is taken from the ResourcePool */
+            void set_resource_owner(void* share_group, const std::string& owner);
+
+            bool enabled() const {
+                return m_settings.targetFrameTime > 0.0 && m_bSupported;
+            }
+
+            /**
+             * binds the offscreen target for a window of the given size and sets the viewport.
+             * Returns false if rendering goes directly to the window.
+             */
+            bool begin_frame(int windowWidth, int windowHeight);
+
+            /** stretches the offscreen target over the window, call before swapping buffers */
+            void end_frame();
+
+            /** feed a measured frame time in milliseconds, returns true if the scale changed */
+            bool update(double frameTime);
+
+            double scale() const {
+                return m_scale;
+            }
+
+            /** size of the offscreen target of the current frame */
+            int render_width() const {
+                return m_renderWidth;
+            }
+
+            int render_height() const {
+                return m_renderHeight;
+            }
+
+            /** release the GL resources, call with the context current before it is destroyed */
+            void release_gl();
+
+        protected:
+            bool allocate(int width, int height);
+
+            Settings m_settings;
+            double m_scale;
+            double m_averageFrameTime;
+            unsigned int m_overBudget;
+            unsigned int m_underBudget;
+
+            bool m_bSupported;
+            bool m_bActive;
+            int m_windowWidth;
+            int m_windowHeight;
+            int m_renderWidth;
+            int m_renderHeight;
+            int m_targetWidth;
+            int m_targetHeight;
+            void* m_pShareGroup;
+            std::string m_sOwner;
+            GLuint m_framebuffer;
+            boost::shared_ptr< PooledResource > m_pColorTexture;
+            boost::shared_ptr< PooledResource > m_pDepthBuffer;
+        };
+
+    }
+}
+
+#endif //UBITRACK_UTADAPTIVERESOLUTION_H
@@ -0,0 +1,238 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+#include "utDirtyRegionTexture.h"
+#include "utGLStateCache.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <log4cpp/Category.hh>
+
+using namespace Ubitrack;
+using namespace Ubitrack::Visualization;
+
+static log4cpp::Category& logger(log4cpp::Category::getInstance("utVisualization.DirtyRegionTexture"));
+
+
+namespace {
+
+    int bytesPerPixel(GLenum format) {
+        switch (format) {
+            case GL_LUMINANCE:
+            case GL_ALPHA:
+            case GL_RED:
+                return 1;
+            case GL_LUMINANCE_ALPHA:
+                return 2;
+            case GL_RGB:
+            case GL_BGR:
+                return 3;
+            default:
+                return 4;
+        }
+    }
+
+    GLint internalFormat(GLenum format) {
+        switch (format) {
+            case GL_LUMINANCE:
+            case GL_RED:
+                return GL_LUMINANCE;
+            case GL_ALPHA:
+                return GL_ALPHA;
+            case GL_LUMINANCE_ALPHA:
+                return GL_LUMINANCE_ALPHA;
+            case GL_RGB:
+            case GL_BGR:
+                return GL_RGB;
+            default:
+                return GL_RGBA;
+        }
+    }
+
+    // word-wise multiplicative hash, fast enough to be memory bound
+    inline unsigned long long hashBytes(const unsigned char* data, std::size_t length, unsigned long long h) {
+        const unsigned long long m = 0x9E3779B97F4A7C15ULL;
+        std::size_t i = 0;
+        for (; i + 8 <= length; i += 8) {
+            unsigned long long word;
+            std::memcpy(&word, data + i, 8);
+            h = (h ^ word) * m;
+            h ^= h >> 29;
+        }
+        for (; i < length; i++)
+            h = (h ^ data[i]) * m;
+        return h;
+    }
+
+}
+
+
+DirtyRegionTexture::DirtyRegionTexture(int tileSize)
+        : m_tileSize(std::max(8, tileSize))
+        , m_texture(0)
+        , m_width(0)
+        , m_height(0)
+        , m_format(GL_RGB)
+        , m_bytesPerPixel(3)
+        , m_bValid(false)
+        , m_lastUploadBytes(0)
+        , m_totalUploadBytes(0)
+        , m_totalImageBytes(0)
+{
+}
+
+DirtyRegionTexture::~DirtyRegionTexture() {
+    // GL resources must be released explicitly with release_gl(), the context may be gone here
+}
+
+void DirtyRegionTexture::invalidate() {
+    m_bValid = false;
+}
+
+bool DirtyRegionTexture::prepare(const unsigned char* data, int width, int height, int stride, GLenum format) {
+    // returns true if the complete image has been uploaded because the texture had to be (re)allocated
+    m_lastUploadBytes = 0;
+    m_totalImageBytes += static_cast< unsigned long long >(width) * height * bytesPerPixel(format);
+
+    if (m_texture == 0) {
+        glGenTextures(1, &m_texture);
+        glBindTexture(GL_TEXTURE_2D, m_texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    } else {
+        glBindTexture(GL_TEXTURE_2D, m_texture);
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, stride / bytesPerPixel(format));
+
+    if (m_bValid && width == m_width && height == m_height && format == m_format)
+        return false;
+
+    LOG4CPP_DEBUG(logger, "Allocating texture " << width << "x" << height);
+    m_width = width;
+    m_height = height;
+    m_format = format;
+    m_bytesPerPixel = bytesPerPixel(format);
+    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat(format), width, height, 0, format, GL_UNSIGNED_BYTE, data);
+    m_lastUploadBytes = static_cast< std::size_t >(width) * height * m_bytesPerPixel;
+    m_bValid = true;
+
+    // tile hashes of the new image are computed by the next hashing update
+    m_tileHashes.clear();
+    return true;
+}
+
+void DirtyRegionTexture::upload(const unsigned char* data, int stride, const Rect& rect) {
+    // GL_UNPACK_ROW_LENGTH lets GL read the sub rectangle directly from the source image
+    const unsigned char* first = data + static_cast< std::size_t >(rect.y) * stride + rect.x * m_bytesPerPixel;
+    glTexSubImage2D(GL_TEXTURE_2D, 0, rect.x, rect.y, rect.width, rect.height, m_format, GL_UNSIGNED_BYTE, first);
+    m_lastUploadBytes += static_cast< std::size_t >(rect.width) * rect.height * m_bytesPerPixel;
+}
+
+void DirtyRegionTexture::finish() {
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    GLStateCache::invalidate_current(GLStateCache::STATE_TEXTURES);
+    m_totalUploadBytes += m_lastUploadBytes;
+}
+
+void DirtyRegionTexture::update(const unsigned char* data, int width, int height, int stride, GLenum format) {
+    bool uploaded = prepare(data, width, height, stride, format);
+
+    int tilesX = (width + m_tileSize - 1) / m_tileSize;
+    int tilesY = (height + m_tileSize - 1) / m_tileSize;
+    bool haveHashes = m_tileHashes.size() == static_cast< std::size_t >(tilesX * tilesY);
+    if (!haveHashes)
+        m_tileHashes.assign(tilesX * tilesY, 0);
+
+    int bpp = m_bytesPerPixel;
+    std::vector< unsigned long long > hashes(tilesX, 0);
+    for (int ty = 0; ty < tilesY; ty++) {
+        int y0 = ty * m_tileSize;
+        int rows = std::min(m_tileSize, height - y0);
+
+        // hash all tiles of the row in one pass over the image rows
+        std::fill(hashes.begin(), hashes.end(), 0xCBF29CE484222325ULL);
+        for (int y = y0; y < y0 + rows; y++) {
+            const unsigned char* line = data + static_cast< std::size_t >(y) * stride;
+            for (int tx = 0; tx < tilesX; tx++) {
+                int x0 = tx * m_tileSize;
+                int cols = std::min(m_tileSize, width - x0);
+                hashes[tx] = hashBytes(line + x0 * bpp, cols * bpp, hashes[tx]);
+            }
+        }
+
+        // merge runs of changed tiles in this row into one upload
+        int runStart = -1;
+        for (int tx = 0; tx <= tilesX; tx++) {
+            bool changed = false;
+            if (tx < tilesX) {
+                unsigned long long& stored = m_tileHashes[ty * tilesX + tx];
+                changed = !haveHashes || stored != hashes[tx];
+                stored = hashes[tx];
+            }
+            if (changed && runStart < 0) {
+                runStart = tx;
+            } else if (!changed && runStart >= 0) {
+                if (!uploaded) {
+                    int x0 = runStart * m_tileSize;
+                    int x1 = std::min(tx * m_tileSize, width);
+                    upload(data, stride, Rect(x0, y0, x1 - x0, rows));
+                }
+                runStart = -1;
+            }
+        }
+    }
+    finish();
+}
+
+void DirtyRegionTexture::update(const unsigned char* data, int width, int height, int stride, GLenum format, const std::vector< Rect >& dirty) {
+    if (!prepare(data, width, height, stride, format)) {
+        for (std::vector< Rect >::const_iterator it = dirty.begin(); it != dirty.end(); ++it) {
+            // clip to the image
+            int x0 = std::max(0, it->x);
+            int y0 = std::max(0, it->y);
+            int x1 = std::min(width, it->x + it->width);
+            int y1 = std::min(height, it->y + it->height);
+            if (x1 > x0 && y1 > y0)
+                upload(data, stride, Rect(x0, y0, x1 - x0, y1 - y0));
+        }
+    }
+    // the tiles no longer match the texture content
+    m_tileHashes.clear();
+    finish();
+}
+
+void DirtyRegionTexture::release_gl() {
+    if (m_texture != 0)
+        glDeleteTextures(1, &m_texture);
+    m_texture = 0;
+    m_bValid = false;
+    // the name may be reused by the next texture created
+    GLStateCache::invalidate_current(GLStateCache::STATE_TEXTURES);
+    m_tileHashes.clear();
+}
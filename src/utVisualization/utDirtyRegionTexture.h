@@ -0,0 +1,130 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @ingroup visualization
+ * @file
+ * Texture upload that only transfers the changed parts of an image.
+ *
+ * Callers either pass the dirty rectangles they know about, or let the
+ * texture find them by hashing fixed size tiles and comparing the hashes with
+ * the previous frame. Changed tiles are uploaded with glTexSubImage2D straight
+ * from the source image, neighbouring tiles in a row are merged into one call.
+ */
+
+#ifndef UBITRACK_UTDIRTYREGIONTEXTURE_H
+#define UBITRACK_UTDIRTYREGIONTEXTURE_H
+
+#include <vector>
+
+#include <utVisualization/Config.h>
+#include <utVisualization/utOpenGL.h>
+
+namespace Ubitrack {
+    namespace Visualization {
+
+        class UBITRACK_EXPORT DirtyRegionTexture {
+
+        public:
+
+            struct Rect {
+                int x;
+                int y;
+                int width;
+                int height;
+
+                Rect(int _x = 0, int _y = 0, int _width = 0, int _height = 0)
+                    : x(_x), y(_y), width(_width), height(_height) {
+                }
+            };
+
+            /** @param tileSize edge length in pixels of the tiles compared by hashing */
+            DirtyRegionTexture(int tileSize = 64);
+            ~DirtyRegionTexture();
+
+            /**
+             * uploads the tiles of the image that changed since the last update.
+             * @param data first pixel of the image, rows are stride bytes apart (a multiple of the pixel size)
+             * @param format pixel format of the data, e.g. GL_BGR or GL_LUMINANCE, with one byte per channel
+             */
+            void update(const unsigned char* data, int width, int height, int stride, GLenum format);
+
+            /** uploads only the given rectangles, the caller guarantees that everything else is unchanged */
+            void update(const unsigned char* data, int width, int height, int stride, GLenum format, const std::vector< Rect >& dirty);
+
+            /** forces the next update to upload the complete image */
+            void invalidate();
+
+            /** texture name, valid after the first update */
+            GLuint texture() const {
+                return m_texture;
+            }
+
+            int width() const {
+                return m_width;
+            }
+
+            int height() const {
+                return m_height;
+            }
+
+            /** bytes transferred by the last update and in total */
+            std::size_t last_upload_bytes() const {
+                return m_lastUploadBytes;
+            }
+
+            unsigned long long total_upload_bytes() const {
+                return m_totalUploadBytes;
+            }
+
+            /** bytes that full uploads would have transferred in total */
+            unsigned long long total_image_bytes() const {
+                return m_totalImageBytes;
+            }
+
+            /** release the GL texture, call with the context current before it is destroyed */
+            void release_gl();
+
+        protected:
+            bool prepare(const unsigned char* data, int width, int height, int stride, GLenum format);
+            void upload(const unsigned char* data, int stride, const Rect& rect);
+            void finish();
+
+            int m_tileSize;
+            GLuint m_texture;
+            int m_width;
+            int m_height;
+            GLenum m_format;
+            int m_bytesPerPixel;
+            bool m_bValid;
+            std::vector< unsigned long long > m_tileHashes;
+
+            std::size_t m_lastUploadBytes;
+            unsigned long long m_totalUploadBytes;
+            unsigned long long m_totalImageBytes;
+        };
+
+    }
+}
+
+#endif //UBITRACK_UTDIRTYREGIONTEXTURE_H
@@ -0,0 +1,169 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+#include "utEmbeddedWindow.h"
+#include "utGLStateCache.h"
+
+#include <log4cpp/Category.hh>
+
+using namespace Ubitrack;
+using namespace Ubitrack::Visualization;
+
+static log4cpp::Category& logger(log4cpp::Category::getInstance("utVisualization.EmbeddedWindow"));
+
+
+RenderTarget::RenderTarget()
+        : type(FRAMEBUFFER)
+        , id(0)
+        , width(0)
+        , height(0)
+{
+}
+
+RenderTarget RenderTarget::framebuffer(GLuint fbo, int width, int height) {
+    RenderTarget target;
+    target.type = FRAMEBUFFER;
+    target.id = fbo;
+    target.width = width;
+    target.height = height;
+    return target;
+}
+
+RenderTarget RenderTarget::texture(GLuint texture, int width, int height) {
+    RenderTarget target;
+    target.type = TEXTURE;
+    target.id = texture;
+    target.width = width;
+    target.height = height;
+    return target;
+}
+
+
+EmbeddedWindow::EmbeddedWindow(int _width, int _height, const std::string& _title, void* hostContext)
+        : VirtualWindow(_width, _height, _title)
+        , m_bValid(false)
+        , m_pHostContext(hostContext)
+        , m_framebuffer(0)
+        , m_attachedTexture(0)
+        , m_bBound(false)
+        , m_hostFramebuffer(0)
+{
+    m_hostViewport[0] = m_hostViewport[1] = m_hostViewport[2] = m_hostViewport[3] = 0;
+}
+
+EmbeddedWindow::~EmbeddedWindow() {
+    // GL resources must be released explicitly with release_gl(), the context may be gone here
+}
+
+bool EmbeddedWindow::is_valid() {
+    return m_bValid;
+}
+
+bool EmbeddedWindow::create() {
+    // the host owns the context, nothing to open
+    m_bValid = true;
+    return true;
+}
+
+void EmbeddedWindow::destroy() {
+    release_gl();
+    m_bValid = false;
+}
+
+void* EmbeddedWindow::share_group() {
+    return m_pHostContext ? m_pHostContext : this;
+}
+
+bool EmbeddedWindow::attach_texture(GLuint texture, int width, int height) {
+    if (m_framebuffer == 0) {
+        if (!hasGLVersion(3, 0) && !hasGLExtension("GL_ARB_framebuffer_object")) {
+            LOG4CPP_ERROR(logger, "Framebuffer objects are not supported, cannot render " << m_title << " into a texture");
+            return false;
+        }
+        glGenFramebuffers(1, &m_framebuffer);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+    if (!m_pDepthBuffer || width != m_pDepthBuffer->width() || height != m_pDepthBuffer->height()) {
+        m_pDepthBuffer.reset();
+        m_pDepthBuffer = ResourcePool::singleton().acquire_renderbuffer(share_group(), GL_DEPTH24_STENCIL8, width, height, 0, m_title);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, m_pDepthBuffer->id());
+        // force the completeness check below
+        m_attachedTexture = 0;
+    }
+    if (texture == m_attachedTexture)
+        return true;
+
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        LOG4CPP_ERROR(logger, "Cannot render " << m_title << " into texture " << texture << " (status " << status << ")");
+        m_attachedTexture = 0;
+        return false;
+    }
+    m_attachedTexture = texture;
+    return true;
+}
+
+bool EmbeddedWindow::bind(const RenderTarget& target) {
+    if (target.width <= 0 || target.height <= 0)
+        return false;
+
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &m_hostFramebuffer);
+    glGetIntegerv(GL_VIEWPORT, m_hostViewport);
+
+    if (target.type == RenderTarget::TEXTURE) {
+        if (!attach_texture(target.id, target.width, target.height)) {
+            glBindFramebuffer(GL_FRAMEBUFFER, m_hostFramebuffer);
+            return false;
+        }
+    } else {
+        glBindFramebuffer(GL_FRAMEBUFFER, target.id);
+    }
+    glViewport(0, 0, target.width, target.height);
+
+    // the host may have changed anything since the last frame
+    m_stateCache->invalidate();
+    GLStateCache::set_current(m_stateCache.get());
+    m_bBound = true;
+    return true;
+}
+
+void EmbeddedWindow::unbind() {
+    if (!m_bBound)
+        return;
+    m_bBound = false;
+    glBindFramebuffer(GL_FRAMEBUFFER, m_hostFramebuffer);
+    glViewport(m_hostViewport[0], m_hostViewport[1], m_hostViewport[2], m_hostViewport[3]);
+    m_stateCache->invalidate(GLStateCache::STATE_FRAMEBUFFER | GLStateCache::STATE_VIEWPORT);
+    // the host's context is not tracked outside of render_to_target()
+    GLStateCache::set_current(NULL);
+}
+
+void EmbeddedWindow::release_gl() {
+    if (m_framebuffer != 0)
+        glDeleteFramebuffers(1, &m_framebuffer);
+    m_framebuffer = 0;
+    m_pDepthBuffer.reset();
+    m_attachedTexture = 0;
+}
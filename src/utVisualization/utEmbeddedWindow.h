@@ -0,0 +1,115 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @ingroup visualization
+ * @file
+ * Rendering cameras into framebuffers or textures owned by a host application.
+ *
+ * Hosts that run their own render loop do not open utVisualization windows.
+ * They call CameraHandle::render_to_target() on their own context with the
+ * framebuffer or texture the camera should draw into, which then stands in
+ * for the window: no extra context, no copy of the rendered frame.
+ */
+
+#ifndef UBITRACK_UTEMBEDDEDWINDOW_H
+#define UBITRACK_UTEMBEDDEDWINDOW_H
+
+#include <string>
+
+#include <utVisualization/Config.h>
+#include <utVisualization/utOpenGL.h>
+#include <utVisualization/utRenderAPI.h>
+#include <utVisualization/utResourcePool.h>
+
+namespace Ubitrack {
+    namespace Visualization {
+
+        /** framebuffer or texture of the host application a camera renders into */
+        struct UBITRACK_EXPORT RenderTarget {
+
+            enum Type {
+                /** a complete framebuffer object of the host, 0 for the host's default framebuffer */
+                FRAMEBUFFER,
+                /** a 2D color texture, depth is provided by an internal renderbuffer */
+                TEXTURE
+            };
+
+            Type type;
+            GLuint id;
+            int width;
+            int height;
+
+            RenderTarget();
+
+            static RenderTarget framebuffer(GLuint fbo, int width, int height);
+            static RenderTarget texture(GLuint texture, int width, int height);
+        };
+
+
+        /**
+         * window stand-in for a camera that renders into host targets.
+         * Created by CameraHandle::render_to_target(), all methods must be called on the host's render thread.
+         */
+        class UBITRACK_EXPORT EmbeddedWindow : public VirtualWindow {
+
+        public:
+            EmbeddedWindow(int _width, int _height, const std::string& _title, void* hostContext);
+            ~EmbeddedWindow();
+
+            virtual bool is_valid();
+            virtual bool create();
+            /** releases the GL objects, the host context must be current */
+            virtual void destroy();
+
+            /** the host context, objects cached by share group are shared with it */
+            virtual void* share_group();
+
+            /**
+             * binds the target and sets the viewport to its size.
+             * The host's framebuffer binding and viewport are saved and restored by unbind().
+             */
+            bool bind(const RenderTarget& target);
+            void unbind();
+
+            void release_gl();
+
+        protected:
+            bool attach_texture(GLuint texture, int width, int height);
+
+            bool m_bValid;
+            void* m_pHostContext;
+
+            GLuint m_framebuffer;
+            boost::shared_ptr< PooledResource > m_pDepthBuffer;
+            GLuint m_attachedTexture;
+
+            bool m_bBound;
+            GLint m_hostFramebuffer;
+            GLint m_hostViewport[4];
+        };
+
+    }
+}
+
+#endif //UBITRACK_UTEMBEDDEDWINDOW_H
@@ -0,0 +1,206 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+#include "utGLStateCache.h"
+
+using namespace Ubitrack;
+using namespace Ubitrack::Visualization;
+
+// set by the windowing frontend, rendering happens on one thread only
+static GLStateCache* g_pCurrent = NULL;
+
+
+GLStateCache::GLStateCache()
+        : m_bBlendKnown(false)
+        , m_blendSrc(GL_ONE)
+        , m_blendDst(GL_ZERO)
+        , m_bDepthFuncKnown(false)
+        , m_depthFunc(GL_LESS)
+        , m_bDepthMaskKnown(false)
+        , m_depthMask(true)
+        , m_bViewportKnown(false)
+        , m_bActiveTextureKnown(false)
+        , m_activeTexture(GL_TEXTURE0)
+        , m_bProgramKnown(false)
+        , m_program(0)
+        , m_bFramebufferKnown(false)
+        , m_framebuffer(0)
+        , m_issued(0)
+        , m_elided(0)
+{
+    m_viewport[0] = m_viewport[1] = m_viewport[2] = m_viewport[3] = 0;
+}
+
+GLStateCache::~GLStateCache() {
+    if (g_pCurrent == this)
+        g_pCurrent = NULL;
+}
+
+bool GLStateCache::changed(bool known, bool equal) {
+    if (known && equal) {
+        m_elided++;
+        return false;
+    }
+    m_issued++;
+    return true;
+}
+
+void GLStateCache::set_enabled(GLenum cap, bool enabled) {
+    std::map< GLenum, bool >::iterator it = m_capabilities.find(cap);
+    if (!changed(it != m_capabilities.end(), it != m_capabilities.end() && it->second == enabled))
+        return;
+    if (enabled)
+        glEnable(cap);
+    else
+        glDisable(cap);
+    m_capabilities[cap] = enabled;
+}
+
+void GLStateCache::enable(GLenum cap) {
+    set_enabled(cap, true);
+}
+
+void GLStateCache::disable(GLenum cap) {
+    set_enabled(cap, false);
+}
+
+void GLStateCache::blend_func(GLenum src, GLenum dst) {
+    if (!changed(m_bBlendKnown, m_blendSrc == src && m_blendDst == dst))
+        return;
+    glBlendFunc(src, dst);
+    m_bBlendKnown = true;
+    m_blendSrc = src;
+    m_blendDst = dst;
+}
+
+void GLStateCache::depth_func(GLenum func) {
+    if (!changed(m_bDepthFuncKnown, m_depthFunc == func))
+        return;
+    glDepthFunc(func);
+    m_bDepthFuncKnown = true;
+    m_depthFunc = func;
+}
+
+void GLStateCache::depth_mask(bool write) {
+    if (!changed(m_bDepthMaskKnown, m_depthMask == write))
+        return;
+    glDepthMask(write ? GL_TRUE : GL_FALSE);
+    m_bDepthMaskKnown = true;
+    m_depthMask = write;
+}
+
+void GLStateCache::viewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+    if (!changed(m_bViewportKnown, m_viewport[0] == x && m_viewport[1] == y && m_viewport[2] == width && m_viewport[3] == height))
+        return;
+    glViewport(x, y, width, height);
+    m_bViewportKnown = true;
+    m_viewport[0] = x;
+    m_viewport[1] = y;
+    m_viewport[2] = width;
+    m_viewport[3] = height;
+}
+
+void GLStateCache::active_texture(GLenum unit) {
+    if (!changed(m_bActiveTextureKnown, m_activeTexture == unit))
+        return;
+    glActiveTexture(unit);
+    m_bActiveTextureKnown = true;
+    m_activeTexture = unit;
+}
+
+void GLStateCache::bind_texture(GLenum target, GLuint texture) {
+    // bindings are per texture unit, an unknown active unit makes the binding unknown as well
+    std::pair< GLenum, GLenum > key(m_activeTexture, target);
+    std::map< std::pair< GLenum, GLenum >, GLuint >::iterator it = m_textures.find(key);
+    bool known = m_bActiveTextureKnown && it != m_textures.end();
+    if (!changed(known, known && it->second == texture))
+        return;
+    glBindTexture(target, texture);
+    if (m_bActiveTextureKnown)
+        m_textures[key] = texture;
+}
+
+void GLStateCache::bind_buffer(GLenum target, GLuint buffer) {
+    std::map< GLenum, GLuint >::iterator it = m_buffers.find(target);
+    if (!changed(it != m_buffers.end(), it != m_buffers.end() && it->second == buffer))
+        return;
+    glBindBuffer(target, buffer);
+    m_buffers[target] = buffer;
+}
+
+void GLStateCache::use_program(GLuint program) {
+    if (!changed(m_bProgramKnown, m_program == program))
+        return;
+    glUseProgram(program);
+    m_bProgramKnown = true;
+    m_program = program;
+}
+
+void GLStateCache::bind_framebuffer(GLuint framebuffer) {
+    if (!changed(m_bFramebufferKnown, m_framebuffer == framebuffer))
+        return;
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    m_bFramebufferKnown = true;
+    m_framebuffer = framebuffer;
+}
+
+void GLStateCache::invalidate(int groups) {
+    if (groups & STATE_CAPABILITIES)
+        m_capabilities.clear();
+    if (groups & STATE_BLEND)
+        m_bBlendKnown = false;
+    if (groups & STATE_DEPTH) {
+        m_bDepthFuncKnown = false;
+        m_bDepthMaskKnown = false;
+    }
+    if (groups & STATE_VIEWPORT)
+        m_bViewportKnown = false;
+    if (groups & STATE_TEXTURES) {
+        m_bActiveTextureKnown = false;
+        m_textures.clear();
+    }
+    if (groups & STATE_BUFFERS)
+        m_buffers.clear();
+    if (groups & STATE_PROGRAM)
+        m_bProgramKnown = false;
+    if (groups & STATE_FRAMEBUFFER)
+        m_bFramebufferKnown = false;
+}
+
+GLStateCache* GLStateCache::current() {
+    return g_pCurrent;
+}
+
+void GLStateCache::set_current(GLStateCache* cache) {
+    g_pCurrent = cache;
+}
+
+void GLStateCache::invalidate_current(int groups) {
+    if (g_pCurrent)
+        g_pCurrent->invalidate(groups);
+}
+
+void GLStateCache::reset_statistics() {
+    m_issued = 0;
+    m_elided = 0;
+}
@@ -0,0 +1,142 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @ingroup visualization
+ * @file
+ * Shadow copy of frequently changed OpenGL state of one context.
+ *
+ * Camera handles tend to set and reset state defensively around everything
+ * they draw. Routing these changes through the cache turns changes to the
+ * value the context already has into no-ops and counts the driver calls saved.
+ * State changed with raw GL calls must be announced with invalidate().
+ * The windowing frontends make the cache of the window being rendered the
+ * current one; renderables of this library that bind with raw GL calls
+ * announce it through invalidate_current().
+ */
+
+#ifndef UBITRACK_UTGLSTATECACHE_H
+#define UBITRACK_UTGLSTATECACHE_H
+
+#include <map>
+#include <utility>
+
+#include <utVisualization/Config.h>
+#include <utVisualization/utOpenGL.h>
+
+namespace Ubitrack {
+    namespace Visualization {
+
+        class UBITRACK_EXPORT GLStateCache {
+
+        public:
+
+            /** groups of state for partial invalidation */
+            enum StateGroup {
+                STATE_CAPABILITIES = 1,
+                STATE_BLEND = 2,
+                STATE_DEPTH = 4,
+                STATE_VIEWPORT = 8,
+                STATE_TEXTURES = 16,
+                STATE_BUFFERS = 32,
+                STATE_PROGRAM = 64,
+                STATE_FRAMEBUFFER = 128,
+                STATE_ALL = 255
+            };
+
+            GLStateCache();
+            ~GLStateCache();
+
+            void enable(GLenum cap);
+            void disable(GLenum cap);
+            void set_enabled(GLenum cap, bool enabled);
+
+            void blend_func(GLenum src, GLenum dst);
+            void depth_func(GLenum func);
+            void depth_mask(bool write);
+            void viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+
+            void active_texture(GLenum unit);
+            void bind_texture(GLenum target, GLuint texture);
+            void bind_buffer(GLenum target, GLuint buffer);
+            void use_program(GLuint program);
+            void bind_framebuffer(GLuint framebuffer);
+
+            /** forget the cached values of the given state groups, e.g. after raw GL calls or glPopAttrib */
+            void invalidate(int groups = STATE_ALL);
+
+            /** cache of the context that is being rendered, NULL if none. Render thread only */
+            static GLStateCache* current();
+            static void set_current(GLStateCache* cache);
+
+            /** invalidate() on the current cache, if there is one */
+            static void invalidate_current(int groups);
+
+            /** number of state changes passed to the driver and skipped because they were redundant */
+            unsigned long long issued_calls() const {
+                return m_issued;
+            }
+
+            unsigned long long elided_calls() const {
+                return m_elided;
+            }
+
+            void reset_statistics();
+
+        protected:
+            bool changed(bool known, bool equal);
+
+            std::map< GLenum, bool > m_capabilities;
+
+            bool m_bBlendKnown;
+            GLenum m_blendSrc;
+            GLenum m_blendDst;
+
+            bool m_bDepthFuncKnown;
+            GLenum m_depthFunc;
+            bool m_bDepthMaskKnown;
+            bool m_depthMask;
+
+            bool m_bViewportKnown;
+            GLint m_viewport[4];
+
+            bool m_bActiveTextureKnown;
+            GLenum m_activeTexture;
+            std::map< std::pair< GLenum, GLenum >, GLuint > m_textures;
+
+            std::map< GLenum, GLuint > m_buffers;
+
+            bool m_bProgramKnown;
+            GLuint m_program;
+
+            bool m_bFramebufferKnown;
+            GLuint m_framebuffer;
+
+            unsigned long long m_issued;
+            unsigned long long m_elided;
+        };
+
+    }
+}
+
+#endif //UBITRACK_UTGLSTATECACHE_H
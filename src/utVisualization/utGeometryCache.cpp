@@ -0,0 +1,533 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+#include "utGeometryCache.h"
+#include "utGLStateCache.h"
+
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <boost/scoped_ptr.hpp>
+#include <boost/bind.hpp>
+#include <boost/filesystem.hpp>
+
+#include <log4cpp/Category.hh>
+
+using namespace Ubitrack;
+using namespace Ubitrack::Visualization;
+
+static log4cpp::Category& logger(log4cpp::Category::getInstance("utVisualization.GeometryCache"));
+
+// the singleton geometry cache object
+static boost::scoped_ptr< GeometryCache > g_pGeometryCache;
+
+// default budget for parsed meshes and GL buffers: 256 MB
+static const std::size_t g_defaultMemoryBudget = 256 * 1024 * 1024;
+
+
+namespace {
+
+    // 64 bit FNV-1a hash of the file content
+    unsigned long long contentHash(const std::string& content) {
+        unsigned long long h = 14695981039346656037ULL;
+        for (std::string::const_iterator it = content.begin(); it != content.end(); ++it) {
+            h ^= static_cast< unsigned char >(*it);
+            h *= 1099511628211ULL;
+        }
+        return h;
+    }
+
+    std::string fileExtension(const std::string& filename) {
+        std::string::size_type pos = filename.find_last_of('.');
+        if (pos == std::string::npos)
+            return std::string();
+        std::string ext = filename.substr(pos + 1);
+        std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+        return ext;
+    }
+
+    // releases the reference of a handle returned by the cache
+    struct MeshReleaser {
+        unsigned long long key;
+        // keeps the mesh alive even if the cache entry goes away first
+        boost::shared_ptr< Mesh > mesh;
+        boost::function< void ( unsigned long long ) > release;
+
+        void operator()(const Mesh*) {
+            release(key);
+        }
+    };
+
+    struct BuffersReleaser {
+        unsigned long long key;
+        void* shareGroup;
+        boost::function< void ( unsigned long long, void* ) > release;
+
+        void operator()(MeshBuffers* buffers) {
+            delete buffers;
+            release(key, shareGroup);
+        }
+    };
+
+}
+
+
+Mesh::Mesh() {
+    for (int i = 0; i < 3; i++) {
+        bboxMin[i] = 0.0f;
+        bboxMax[i] = 0.0f;
+    }
+}
+
+void Mesh::update_bounds() {
+    for (std::size_t v = 0; v < vertex_count(); v++) {
+        for (int i = 0; i < 3; i++) {
+            float c = vertices[v * 6 + i];
+            if (v == 0 || c < bboxMin[i])
+                bboxMin[i] = c;
+            if (v == 0 || c > bboxMax[i])
+                bboxMax[i] = c;
+        }
+    }
+}
+
+
+MeshBuffers::MeshBuffers()
+        : m_vertexBuffer(0)
+        , m_indexBuffer(0)
+        , m_indexCount(0)
+{
+}
+
+void MeshBuffers::draw() const {
+    if (m_indexCount == 0)
+        return;
+
+    glBindBuffer(GL_ARRAY_BUFFER, m_vertexBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indexBuffer);
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+    glVertexPointer(3, GL_FLOAT, 6 * sizeof(float), 0);
+    glNormalPointer(GL_FLOAT, 6 * sizeof(float), reinterpret_cast< const GLvoid* >(3 * sizeof(float)));
+
+    glDrawElements(GL_TRIANGLES, m_indexCount, GL_UNSIGNED_INT, 0);
+
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    GLStateCache::invalidate_current(GLStateCache::STATE_BUFFERS);
+}
+
+
+GeometryCache& GeometryCache::singleton()
+{
+    // prevent from race condition
+    static boost::mutex singletonMutex;
+    boost::mutex::scoped_lock l( singletonMutex );
+
+    // create a new singleton if necessary
+    if ( !g_pGeometryCache )
+        g_pGeometryCache.reset( new GeometryCache() );
+
+    return *g_pGeometryCache;
+}
+
+GeometryCache::GeometryCache()
+        : m_memoryBudget(g_defaultMemoryBudget)
+        , m_memoryUsage(0)
+{
+    m_loaders["obj"] = &loadWavefrontObj;
+}
+
+GeometryCache::~GeometryCache() {
+    // GL buffers cannot be deleted here, the contexts are gone when the process terminates
+}
+
+void GeometryCache::register_loader(const std::string& extension, LoaderType loader) {
+    boost::mutex::scoped_lock lock( m_mutex );
+    std::string ext(extension);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    m_loaders[ext] = loader;
+}
+
+bool GeometryCache::read_file(const std::string& filename, std::string& content) {
+    std::ifstream file(filename.c_str(), std::ios::in | std::ios::binary);
+    if (!file) {
+        LOG4CPP_ERROR(logger, "Cannot open model file: " << filename);
+        return false;
+    }
+    std::ostringstream ss;
+    ss << file.rdbuf();
+    content = ss.str();
+    return true;
+}
+
+GeometryCache::EntryMap::iterator GeometryCache::find_or_load(const std::string& filename, boost::mutex::scoped_lock& lock) {
+    // file system access and parsing run unlocked, other threads keep using the cache meanwhile
+    lock.unlock();
+    boost::system::error_code ec;
+    FileStamp stamp;
+    stamp.mtime = boost::filesystem::last_write_time(filename, ec);
+    if (!ec)
+        stamp.size = boost::filesystem::file_size(filename, ec);
+    bool stamped = !ec;
+    lock.lock();
+
+    // an unchanged file is not read and hashed again
+    std::map< std::string, FileStamp >::iterator known = m_files.find(filename);
+    if (stamped && known != m_files.end() && known->second.mtime == stamp.mtime && known->second.size == stamp.size) {
+        EntryMap::iterator it = m_entries.find(known->second.key);
+        if (it != m_entries.end()) {
+            LOG4CPP_DEBUG(logger, "Cache hit for " << filename);
+            return it;
+        }
+    }
+
+    lock.unlock();
+    std::string content;
+    bool read = read_file(filename, content);
+    unsigned long long key = read ? contentHash(content) : 0;
+    lock.lock();
+    if (!read)
+        return m_entries.end();
+
+    // same content under a different name is shared, changed files get a new entry
+    EntryMap::iterator it = m_entries.find(key);
+    if (it != m_entries.end()) {
+        LOG4CPP_DEBUG(logger, "Cache hit for " << filename << " by content");
+    } else {
+        std::map< std::string, LoaderType >::iterator loader = m_loaders.find(fileExtension(filename));
+        if (loader == m_loaders.end()) {
+            LOG4CPP_ERROR(logger, "No loader registered for model file: " << filename);
+            return m_entries.end();
+        }
+        LoaderType load = loader->second;
+
+        lock.unlock();
+        boost::shared_ptr< Mesh > mesh(new Mesh());
+        bool parsed = load(content, *mesh);
+        if (parsed)
+            mesh->update_bounds();
+        lock.lock();
+        if (!parsed) {
+            LOG4CPP_ERROR(logger, "Cannot parse model file: " << filename);
+            return m_entries.end();
+        }
+
+        // another thread may have loaded the same content while the lock was released
+        it = m_entries.find(key);
+        if (it == m_entries.end()) {
+            Entry& entry = m_entries[key];
+            entry.filename = filename;
+            entry.mesh = mesh;
+            entry.refCount = 0;
+            entry.lruPos = m_lru.insert(m_lru.end(), key);
+            m_memoryUsage += mesh->byte_size();
+            it = m_entries.find(key);
+
+            LOG4CPP_INFO(logger, "Loaded " << filename << ": " << mesh->vertex_count() << " vertices, "
+                << mesh->indices.size() / 3 << " triangles");
+        }
+    }
+
+    if (stamped) {
+        stamp.key = key;
+        m_files[filename] = stamp;
+    }
+    return it;
+}
+
+void GeometryCache::touch(EntryMap::iterator it) {
+    m_lru.splice(m_lru.end(), m_lru, it->second.lruPos);
+}
+
+boost::shared_ptr< const Mesh > GeometryCache::load_mesh(const std::string& filename) {
+    boost::mutex::scoped_lock lock( m_mutex );
+    EntryMap::iterator it = find_or_load(filename, lock);
+    if (it == m_entries.end())
+        return boost::shared_ptr< const Mesh >();
+
+    touch(it);
+    it->second.refCount++;
+
+    MeshReleaser releaser;
+    releaser.key = it->first;
+    releaser.mesh = it->second.mesh;
+    releaser.release = boost::bind(&GeometryCache::release_mesh, this, _1);
+    boost::shared_ptr< const Mesh > handle(it->second.mesh.get(), releaser);
+
+    enforce_budget();
+    return handle;
+}
+
+boost::shared_ptr< MeshBuffers > GeometryCache::acquire(const std::string& filename, void* share_group) {
+    boost::mutex::scoped_lock lock( m_mutex );
+    EntryMap::iterator it = find_or_load(filename, lock);
+    if (it == m_entries.end())
+        return boost::shared_ptr< MeshBuffers >();
+
+    touch(it);
+    Entry& entry = it->second;
+    std::map< void*, GpuRecord >::iterator gpu = entry.gpu.find(share_group);
+    if (gpu == entry.gpu.end()) {
+        GpuRecord record;
+        record.refCount = 0;
+        glGenBuffers(1, &record.vertexBuffer);
+        glGenBuffers(1, &record.indexBuffer);
+
+        glBindBuffer(GL_ARRAY_BUFFER, record.vertexBuffer);
+        glBufferData(GL_ARRAY_BUFFER, entry.mesh->vertices.size() * sizeof(float),
+            entry.mesh->vertices.empty() ? NULL : &entry.mesh->vertices[0], GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, record.indexBuffer);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, entry.mesh->indices.size() * sizeof(unsigned int),
+            entry.mesh->indices.empty() ? NULL : &entry.mesh->indices[0], GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+        gpu = entry.gpu.insert(std::make_pair(share_group, record)).first;
+        m_memoryUsage += entry.mesh->byte_size();
+        LOG4CPP_DEBUG(logger, "Uploaded " << filename << " to share group " << share_group);
+    }
+    gpu->second.refCount++;
+    entry.refCount++;
+
+    MeshBuffers* buffers = new MeshBuffers();
+    buffers->m_vertexBuffer = gpu->second.vertexBuffer;
+    buffers->m_indexBuffer = gpu->second.indexBuffer;
+    buffers->m_indexCount = static_cast< GLsizei >(entry.mesh->indices.size());
+    buffers->m_pMesh = entry.mesh;
+
+    BuffersReleaser releaser;
+    releaser.key = it->first;
+    releaser.shareGroup = share_group;
+    releaser.release = boost::bind(&GeometryCache::release_buffers, this, _1, _2);
+
+    // buffers queued by earlier evictions can be deleted now that the context is current
+    std::map< void*, std::vector< GLuint > >::iterator pending = m_pendingDeletes.find(share_group);
+    if (pending != m_pendingDeletes.end() && !pending->second.empty()) {
+        glDeleteBuffers(static_cast< GLsizei >(pending->second.size()), &pending->second[0]);
+        m_pendingDeletes.erase(pending);
+    }
+    GLStateCache::invalidate_current(GLStateCache::STATE_BUFFERS);
+
+    enforce_budget();
+    return boost::shared_ptr< MeshBuffers >(buffers, releaser);
+}
+
+void GeometryCache::release_mesh(unsigned long long key) {
+    boost::mutex::scoped_lock lock( m_mutex );
+    EntryMap::iterator it = m_entries.find(key);
+    if (it == m_entries.end())
+        return;
+    it->second.refCount--;
+    enforce_budget();
+}
+
+void GeometryCache::release_buffers(unsigned long long key, void* share_group) {
+    boost::mutex::scoped_lock lock( m_mutex );
+    EntryMap::iterator it = m_entries.find(key);
+    if (it == m_entries.end())
+        return;
+    // references of a dropped share group were already subtracted by drop_share_group()
+    std::map< void*, GpuRecord >::iterator gpu = it->second.gpu.find(share_group);
+    if (gpu == it->second.gpu.end())
+        return;
+    gpu->second.refCount--;
+    it->second.refCount--;
+    enforce_budget();
+}
+
+void GeometryCache::enforce_budget() {
+    // called with m_mutex held, evicts unreferenced entries starting with the least recently used
+    std::list< unsigned long long >::iterator pos = m_lru.begin();
+    while (m_memoryUsage > m_memoryBudget && pos != m_lru.end()) {
+        EntryMap::iterator it = m_entries.find(*pos);
+        ++pos;
+        if (it != m_entries.end() && it->second.refCount == 0) {
+            evict(it);
+        }
+    }
+}
+
+void GeometryCache::evict(EntryMap::iterator it) {
+    Entry& entry = it->second;
+    LOG4CPP_DEBUG(logger, "Evicting " << entry.filename);
+
+    // GL buffers are deleted when a context of their share group is current again
+    for (std::map< void*, GpuRecord >::iterator gpu = entry.gpu.begin(); gpu != entry.gpu.end(); ++gpu) {
+        std::vector< GLuint >& pending = m_pendingDeletes[gpu->first];
+        pending.push_back(gpu->second.vertexBuffer);
+        pending.push_back(gpu->second.indexBuffer);
+        m_memoryUsage -= entry.mesh->byte_size();
+    }
+    m_memoryUsage -= entry.mesh->byte_size();
+    m_lru.erase(entry.lruPos);
+    m_entries.erase(it);
+}
+
+void GeometryCache::collect_garbage(void* share_group) {
+    boost::mutex::scoped_lock lock( m_mutex );
+    std::map< void*, std::vector< GLuint > >::iterator pending = m_pendingDeletes.find(share_group);
+    if (pending != m_pendingDeletes.end()) {
+        if (!pending->second.empty())
+            glDeleteBuffers(static_cast< GLsizei >(pending->second.size()), &pending->second[0]);
+        m_pendingDeletes.erase(pending);
+    }
+}
+
+void GeometryCache::drop_share_group(void* share_group) {
+    boost::mutex::scoped_lock lock( m_mutex );
+    m_pendingDeletes.erase(share_group);
+    for (EntryMap::iterator it = m_entries.begin(); it != m_entries.end(); ++it) {
+        std::map< void*, GpuRecord >::iterator gpu = it->second.gpu.find(share_group);
+        if (gpu == it->second.gpu.end())
+            continue;
+        if (gpu->second.refCount > 0) {
+            LOG4CPP_WARN(logger, "Share group destroyed while " << it->second.filename << " is still referenced");
+            it->second.refCount -= gpu->second.refCount;
+        }
+        m_memoryUsage -= it->second.mesh->byte_size();
+        it->second.gpu.erase(gpu);
+    }
+    enforce_budget();
+}
+
+void GeometryCache::set_memory_budget(std::size_t bytes) {
+    boost::mutex::scoped_lock lock( m_mutex );
+    m_memoryBudget = bytes;
+    enforce_budget();
+}
+
+std::size_t GeometryCache::memory_budget() {
+    return m_memoryBudget;
+}
+
+std::size_t GeometryCache::memory_usage() {
+    boost::mutex::scoped_lock lock( m_mutex );
+    return m_memoryUsage;
+}
+
+std::size_t GeometryCache::entry_count() {
+    boost::mutex::scoped_lock lock( m_mutex );
+    return m_entries.size();
+}
+
+
+namespace {
+
+    // resolves a (possibly negative) OBJ index, returns -1 if out of range
+    long objIndex(const std::string& token, std::size_t count) {
+        long i = std::strtol(token.c_str(), NULL, 10);
+        if (i < 0)
+            i += static_cast< long >(count);
+        else
+            i -= 1;
+        return (i >= 0 && i < static_cast< long >(count)) ? i : -1;
+    }
+
+}
+
+bool Ubitrack::Visualization::loadWavefrontObj(const std::string& content, Mesh& mesh) {
+    std::vector< float > positions;
+    std::vector< float > normals;
+    std::map< std::pair< long, long >, unsigned int > vertexMap;
+    std::vector< std::size_t > faceNeedsNormal;
+
+    std::istringstream stream(content);
+    std::string line;
+    while (std::getline(stream, line)) {
+        std::istringstream ls(line);
+        std::string tag;
+        ls >> tag;
+        if (tag == "v") {
+            float x = 0, y = 0, z = 0;
+            ls >> x >> y >> z;
+            positions.push_back(x);
+            positions.push_back(y);
+            positions.push_back(z);
+        } else if (tag == "vn") {
+            float x = 0, y = 0, z = 1;
+            ls >> x >> y >> z;
+            normals.push_back(x);
+            normals.push_back(y);
+            normals.push_back(z);
+        } else if (tag == "f") {
+            std::vector< unsigned int > polygon;
+            std::string token;
+            bool hasNormals = true;
+            while (ls >> token) {
+                // v, v/vt, v//vn or v/vt/vn
+                std::string::size_type s1 = token.find('/');
+                std::string::size_type s2 = (s1 == std::string::npos) ? s1 : token.find('/', s1 + 1);
+                long p = objIndex(token.substr(0, s1), positions.size() / 3);
+                long n = (s2 == std::string::npos) ? -1 : objIndex(token.substr(s2 + 1), normals.size() / 3);
+                if (p < 0)
+                    return false;
+                hasNormals &= (n >= 0);
+
+                std::pair< long, long > key(p, n);
+                std::map< std::pair< long, long >, unsigned int >::iterator it = vertexMap.find(key);
+                if (it == vertexMap.end()) {
+                    unsigned int idx = static_cast< unsigned int >(mesh.vertex_count());
+                    for (int i = 0; i < 3; i++)
+                        mesh.vertices.push_back(positions[p * 3 + i]);
+                    for (int i = 0; i < 3; i++)
+                        mesh.vertices.push_back(n >= 0 ? normals[n * 3 + i] : 0.0f);
+                    it = vertexMap.insert(std::make_pair(key, idx)).first;
+                }
+                polygon.push_back(it->second);
+            }
+            // triangulate as fan
+            for (std::size_t i = 2; i < polygon.size(); i++) {
+                if (!hasNormals)
+                    faceNeedsNormal.push_back(mesh.indices.size());
+                mesh.indices.push_back(polygon[0]);
+                mesh.indices.push_back(polygon[i - 1]);
+                mesh.indices.push_back(polygon[i]);
+            }
+        }
+    }
+
+    // accumulate face normals for vertices without explicit normals
+    for (std::size_t f = 0; f < faceNeedsNormal.size(); f++) {
+        const unsigned int* tri = &mesh.indices[faceNeedsNormal[f]];
+        const float* a = &mesh.vertices[tri[0] * 6];
+        const float* b = &mesh.vertices[tri[1] * 6];
+        const float* c = &mesh.vertices[tri[2] * 6];
+        float u[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+        float v[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+        float n[3] = { u[1] * v[2] - u[2] * v[1], u[2] * v[0] - u[0] * v[2], u[0] * v[1] - u[1] * v[0] };
+        for (int k = 0; k < 3; k++)
+            for (int i = 0; i < 3; i++)
+                mesh.vertices[tri[k] * 6 + 3 + i] += n[i];
+    }
+    // GL_NORMALIZE is enabled by initGL, accumulated normals need not be unit length
+
+    return !mesh.indices.empty();
+}
@@ -0,0 +1,200 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @ingroup visualization
+ * @file
+ * Process-wide cache for 3D model geometry.
+ *
+ * Parsed meshes are kept once in CPU memory and uploaded once per OpenGL
+ * share group, no matter how many windows or components draw them.
+ * Entries are reference counted; unreferenced entries are evicted in LRU
+ * order whenever the configured memory budget is exceeded.
+ */
+
+#ifndef UBITRACK_UTGEOMETRYCACHE_H
+#define UBITRACK_UTGEOMETRYCACHE_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <list>
+#include <ctime>
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <utVisualization/Config.h>
+#include <utVisualization/utOpenGL.h>
+
+namespace Ubitrack {
+    namespace Visualization {
+
+        /** triangle mesh in CPU memory, vertices and normals are interleaved (x y z nx ny nz) */
+        struct UBITRACK_EXPORT Mesh {
+            std::vector< float > vertices;
+            std::vector< unsigned int > indices;
+            float bboxMin[3];
+            float bboxMax[3];
+
+            Mesh();
+
+            std::size_t vertex_count() const {
+                return vertices.size() / 6;
+            }
+
+            std::size_t byte_size() const {
+                return vertices.size() * sizeof(float) + indices.size() * sizeof(unsigned int);
+            }
+
+            /** recompute the bounding box from the vertex data */
+            void update_bounds();
+        };
+
+
+        /** GL buffers of one mesh in one share group */
+        class UBITRACK_EXPORT MeshBuffers {
+
+        public:
+            MeshBuffers();
+
+            /** draws the mesh with the fixed function pipeline, the share group's context must be current */
+            void draw() const;
+
+            GLuint vertex_buffer() const {
+                return m_vertexBuffer;
+            }
+
+            GLuint index_buffer() const {
+                return m_indexBuffer;
+            }
+
+            GLsizei index_count() const {
+                return m_indexCount;
+            }
+
+            boost::shared_ptr< const Mesh > mesh() const {
+                return m_pMesh;
+            }
+
+        protected:
+            friend class GeometryCache;
+
+            GLuint m_vertexBuffer;
+            GLuint m_indexBuffer;
+            GLsizei m_indexCount;
+            boost::shared_ptr< const Mesh > m_pMesh;
+        };
+
+
+        class UBITRACK_EXPORT GeometryCache {
+
+        public:
+
+            /** parses a model file from its raw content, returns false if the content cannot be read */
+            typedef boost::function< bool ( const std::string& content, Mesh& mesh ) > LoaderType;
+
+            GeometryCache();
+            ~GeometryCache();
+
+            /** register a loader for a (lower case) file extension, e.g. "obj" */
+            void register_loader(const std::string& extension, LoaderType loader);
+
+            /**
+             * returns the parsed mesh of a file, the reference is held until the returned pointer is released.
+             * An empty pointer is returned if the file cannot be read or parsed.
+             */
+            boost::shared_ptr< const Mesh > load_mesh(const std::string& filename);
+
+            /**
+             * returns the GL buffers of a file for the given share group, uploading them on first use.
+             * Must be called from the render thread with a context of the share group being current.
+             */
+            boost::shared_ptr< MeshBuffers > acquire(const std::string& filename, void* share_group);
+
+            /** delete GL buffers of evicted entries, call with a context of the share group being current */
+            void collect_garbage(void* share_group);
+
+            /** forget all GL buffers of a share group whose last context has been destroyed */
+            void drop_share_group(void* share_group);
+
+            void set_memory_budget(std::size_t bytes);
+            std::size_t memory_budget();
+            std::size_t memory_usage();
+            std::size_t entry_count();
+
+            /** get the process-wide geometry cache */
+            static GeometryCache& singleton();
+
+        private:
+
+            struct GpuRecord {
+                GLuint vertexBuffer;
+                GLuint indexBuffer;
+                unsigned int refCount;
+            };
+
+            struct Entry {
+                std::string filename;
+                boost::shared_ptr< Mesh > mesh;
+                std::map< void*, GpuRecord > gpu;
+                unsigned int refCount;
+                std::list< unsigned long long >::iterator lruPos;
+            };
+
+            /** what a file looked like when its content was last hashed */
+            struct FileStamp {
+                std::time_t mtime;
+                boost::uintmax_t size;
+                unsigned long long key;
+            };
+
+            typedef std::map< unsigned long long, Entry > EntryMap;
+
+            bool read_file(const std::string& filename, std::string& content);
+            /** called with the lock held, it is released while the file is read and parsed */
+            EntryMap::iterator find_or_load(const std::string& filename, boost::mutex::scoped_lock& lock);
+            void touch(EntryMap::iterator it);
+            void release_mesh(unsigned long long key);
+            void release_buffers(unsigned long long key, void* share_group);
+            void enforce_budget();
+            void evict(EntryMap::iterator it);
+
+            EntryMap m_entries;
+            std::map< std::string, FileStamp > m_files;
+            std::list< unsigned long long > m_lru;
+            std::map< std::string, LoaderType > m_loaders;
+            std::map< void*, std::vector< GLuint > > m_pendingDeletes;
+            std::size_t m_memoryBudget;
+            std::size_t m_memoryUsage;
+            boost::mutex m_mutex;
+        };
+
+        /** loader for Wavefront OBJ files (positions, normals and polygonal faces) */
+        UBITRACK_EXPORT bool loadWavefrontObj(const std::string& content, Mesh& mesh);
+
+    }
+}
+
+#endif //UBITRACK_UTGEOMETRYCACHE_H
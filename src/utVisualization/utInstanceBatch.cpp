@@ -0,0 +1,558 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+#include "utInstanceBatch.h"
+#include "utRenderAPI.h"
+#include "utShaderManager.h"
+#include "utGLStateCache.h"
+
+#include <cmath>
+#include <cstring>
+
+#include <log4cpp/Category.hh>
+
+using namespace Ubitrack;
+using namespace Ubitrack::Visualization;
+
+static log4cpp::Category& logger(log4cpp::Category::getInstance("utVisualization.InstanceBatch"));
+
+// number of segments in the persistently mapped ring, one is written while the others may still be read
+static const unsigned int g_ringSegments = 3;
+
+static const double g_pi = 3.14159265358979323846;
+
+// vertex layout of the shape geometry: position, normal, rgba colour
+static const int g_vertexFloats = 10;
+
+static const char* g_vertexShader =
+    "#version 120\n"
+    "attribute vec3 a_position;\n"
+    "attribute vec3 a_normal;\n"
+    "attribute vec4 a_color;\n"
+    "attribute vec4 i_model0;\n"
+    "attribute vec4 i_model1;\n"
+    "attribute vec4 i_model2;\n"
+    "attribute vec4 i_model3;\n"
+    "attribute vec4 i_scale;\n"
+    "attribute vec4 i_color;\n"
+    "varying vec4 v_color;\n"
+    "void main() {\n"
+    "    mat4 model = mat4(i_model0, i_model1, i_model2, i_model3);\n"
+    "    gl_Position = gl_ModelViewProjectionMatrix * (model * vec4(a_position * i_scale.xyz, 1.0));\n"
+    "    vec4 color = a_color * i_color;\n"
+    "    if (dot(a_normal, a_normal) > 0.0) {\n"
+    "        vec3 n = normalize(gl_NormalMatrix * (mat3(model) * (a_normal / i_scale.xyz)));\n"
+    "        float d = max(dot(n, normalize(gl_LightSource[0].position.xyz)), 0.0);\n"
+    "        color.rgb *= gl_LightSource[0].ambient.rgb + gl_LightSource[0].diffuse.rgb * d;\n"
+    "    }\n"
+    "    v_color = color;\n"
+    "}\n";
+
+static const char* g_fragmentShader =
+    "#version 120\n"
+    "varying vec4 v_color;\n"
+    "void main() {\n"
+    "    gl_FragColor = v_color;\n"
+    "}\n";
+
+static const char* g_programName = "utVisualization.InstanceBatch";
+
+static const char* g_instanceAttributes[6] = { "i_model0", "i_model1", "i_model2", "i_model3", "i_scale", "i_color" };
+
+
+namespace {
+
+    void pushVertex(std::vector< float >& v, float x, float y, float z, float nx, float ny, float nz,
+        float r = 1.0f, float g = 1.0f, float b = 1.0f) {
+        float data[g_vertexFloats] = { x, y, z, nx, ny, nz, r, g, b, 1.0f };
+        v.insert(v.end(), data, data + g_vertexFloats);
+    }
+
+}
+
+
+InstanceBatch::InstanceBatch()
+        : m_bDirty(true)
+        , m_bUploadNeeded(true)
+        , m_path(PATH_NONE)
+        , m_program(0)
+        , m_attribPosition(-1)
+        , m_attribNormal(-1)
+        , m_attribColor(-1)
+        , m_instanceBuffer(0)
+        , m_capacity(0)
+        , m_pMapped(NULL)
+        , m_segment(0)
+        , m_lastOffset(0)
+        , m_vertexAttribDivisor(NULL)
+        , m_drawElementsInstanced(NULL)
+        , m_drawCalls(0)
+        , m_pShareGroup(NULL)
+{
+    // known up front so the program can be built while the dataflow starts
+    ShaderManager::singleton().register_program(g_programName, g_vertexShader, g_fragmentShader);
+
+    std::memset(m_geometry, 0, sizeof(m_geometry));
+    for (int i = 0; i < 6; i++)
+        m_attribInstance[i] = -1;
+    for (unsigned int i = 0; i < g_ringSegments; i++)
+        m_fences[i] = 0;
+}
+
+InstanceBatch::~InstanceBatch() {
+    // GL resources must be released explicitly with release_gl(), the context may be gone here
+}
+
+void InstanceBatch::clear() {
+    boost::mutex::scoped_lock lock( m_mutex );
+    for (int s = 0; s < SHAPE_COUNT; s++)
+        m_instances[s].clear();
+    m_bDirty = true;
+}
+
+void InstanceBatch::add(Shape shape, const float pose[16], const float scale[3], const float color[4]) {
+    Instance instance;
+    std::memcpy(instance.model, pose, sizeof(instance.model));
+    std::memcpy(instance.scale, scale, 3 * sizeof(float));
+    instance.scale[3] = 1.0f;
+    std::memcpy(instance.color, color, sizeof(instance.color));
+
+    boost::mutex::scoped_lock lock( m_mutex );
+    m_instances[shape].push_back(instance);
+    m_bDirty = true;
+}
+
+void InstanceBatch::add(Shape shape, const float position[3], float size, const float color[4]) {
+    float pose[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, position[0], position[1], position[2], 1 };
+    float scale[3] = { size, size, size };
+    add(shape, pose, scale, color);
+}
+
+void InstanceBatch::set_share_group(void* share_group) {
+    m_pShareGroup = share_group;
+}
+
+void* InstanceBatch::share_group() const {
+    if (m_pShareGroup)
+        return m_pShareGroup;
+    // window contexts of the frontends share their objects with the render manager's context
+    void* shared = RenderManager::singleton().getSharedOpenGLContext();
+    return shared ? shared : const_cast< InstanceBatch* >(this);
+}
+
+std::size_t InstanceBatch::instance_count() {
+    boost::mutex::scoped_lock lock( m_mutex );
+    std::size_t count = 0;
+    for (int s = 0; s < SHAPE_COUNT; s++)
+        count += m_instances[s].size();
+    return count;
+}
+
+void InstanceBatch::init_gl() {
+    create_geometry();
+
+    // select the instancing entry points of the context
+    if (hasGLVersion(3, 3)) {
+        m_vertexAttribDivisor = glVertexAttribDivisor;
+        m_drawElementsInstanced = glDrawElementsInstanced;
+    } else if (hasGLExtension("GL_ARB_instanced_arrays") && hasGLExtension("GL_ARB_draw_instanced")) {
+        m_vertexAttribDivisor = glVertexAttribDivisorARB;
+        m_drawElementsInstanced = glDrawElementsInstancedARB;
+    }
+
+    if (m_vertexAttribDivisor && hasGLVersion(2, 0)) {
+        m_program = ShaderManager::singleton().program(g_programName, share_group());
+        if (m_program == 0) {
+            LOG4CPP_WARN(logger, "Cannot build instancing shader, falling back to immediate drawing");
+        } else {
+            m_attribPosition = glGetAttribLocation(m_program, "a_position");
+            m_attribNormal = glGetAttribLocation(m_program, "a_normal");
+            m_attribColor = glGetAttribLocation(m_program, "a_color");
+            for (int i = 0; i < 6; i++)
+                m_attribInstance[i] = glGetAttribLocation(m_program, g_instanceAttributes[i]);
+        }
+    }
+
+    if (m_program == 0) {
+        m_path = PATH_IMMEDIATE;
+    } else if (hasGLVersion(4, 4) || (hasGLExtension("GL_ARB_buffer_storage") && hasGLVersion(3, 2))) {
+        m_path = PATH_PERSISTENT;
+    } else {
+        m_path = PATH_STREAMING;
+    }
+    LOG4CPP_INFO(logger, "Instance batch uses " << (m_path == PATH_PERSISTENT ? "persistently mapped instancing" :
+        m_path == PATH_STREAMING ? "streamed instancing" : "immediate drawing"));
+}
+
+void InstanceBatch::create_geometry() {
+    std::vector< float > v;
+    std::vector< unsigned short > idx;
+
+    // axes: unlit coloured lines (zero normal)
+    pushVertex(v, 0, 0, 0, 0, 0, 0, 1, 0, 0);
+    pushVertex(v, 1, 0, 0, 0, 0, 0, 1, 0, 0);
+    pushVertex(v, 0, 0, 0, 0, 0, 0, 0, 1, 0);
+    pushVertex(v, 0, 1, 0, 0, 0, 0, 0, 1, 0);
+    pushVertex(v, 0, 0, 0, 0, 0, 0, 0, 0, 1);
+    pushVertex(v, 0, 0, 1, 0, 0, 0, 0, 0, 1);
+    for (unsigned short i = 0; i < 6; i++)
+        idx.push_back(i);
+    upload_shape(SHAPE_AXES, v, idx, GL_LINES);
+
+    // box: four vertices per face for flat normals
+    v.clear();
+    idx.clear();
+    for (int axis = 0; axis < 3; axis++) {
+        for (int sign = -1; sign <= 1; sign += 2) {
+            unsigned short base = static_cast< unsigned short >(v.size() / g_vertexFloats);
+            int u = (axis + 1) % 3;
+            int w = (axis + 2) % 3;
+            static const float corners[4][2] = { { -1, -1 }, { 1, -1 }, { 1, 1 }, { -1, 1 } };
+            for (int c = 0; c < 4; c++) {
+                float p[3];
+                float n[3] = { 0, 0, 0 };
+                p[axis] = static_cast< float >(sign);
+                p[u] = corners[c][0] * sign;
+                p[w] = corners[c][1];
+                n[axis] = static_cast< float >(sign);
+                pushVertex(v, p[0], p[1], p[2], n[0], n[1], n[2]);
+            }
+            unsigned short quad[6] = { 0, 1, 2, 0, 2, 3 };
+            for (int i = 0; i < 6; i++)
+                idx.push_back(base + quad[i]);
+        }
+    }
+    upload_shape(SHAPE_BOX, v, idx, GL_TRIANGLES);
+
+    // sphere: latitude/longitude tesselation, shared by spheres and ellipsoids
+    v.clear();
+    idx.clear();
+    const int stacks = 12;
+    const int slices = 24;
+    for (int i = 0; i <= stacks; i++) {
+        float theta = static_cast< float >(i * g_pi / stacks);
+        for (int j = 0; j <= slices; j++) {
+            float phi = static_cast< float >(j * 2.0 * g_pi / slices);
+            float x = std::sin(theta) * std::cos(phi);
+            float y = std::sin(theta) * std::sin(phi);
+            float z = std::cos(theta);
+            pushVertex(v, x, y, z, x, y, z);
+        }
+    }
+    for (int i = 0; i < stacks; i++) {
+        for (int j = 0; j < slices; j++) {
+            unsigned short a = static_cast< unsigned short >(i * (slices + 1) + j);
+            unsigned short b = static_cast< unsigned short >(a + slices + 1);
+            idx.push_back(a);
+            idx.push_back(b);
+            idx.push_back(a + 1);
+            idx.push_back(a + 1);
+            idx.push_back(b);
+            idx.push_back(b + 1);
+        }
+    }
+    upload_shape(SHAPE_SPHERE, v, idx, GL_TRIANGLES);
+    m_geometry[SHAPE_ELLIPSOID] = m_geometry[SHAPE_SPHERE];
+}
+
+void InstanceBatch::upload_shape(Shape shape, const std::vector< float >& vertices, const std::vector< unsigned short >& indices, GLenum mode) {
+    ShapeGeometry& g = m_geometry[shape];
+    g.mode = mode;
+    g.indexCount = static_cast< GLsizei >(indices.size());
+
+    glGenBuffers(1, &g.vertexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, g.vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), &vertices[0], GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glGenBuffers(1, &g.indexBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g.indexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned short), &indices[0], GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+void InstanceBatch::allocate_instance_buffer(std::size_t capacity) {
+    // called with the instance buffer bound
+    if (m_instanceBuffer != 0) {
+        if (m_pMapped != NULL) {
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+            m_pMapped = NULL;
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glDeleteBuffers(1, &m_instanceBuffer);
+        for (unsigned int i = 0; i < g_ringSegments; i++) {
+            if (m_fences[i] != 0) {
+                glDeleteSync(m_fences[i]);
+                m_fences[i] = 0;
+            }
+        }
+    }
+
+    // grow geometrically to avoid reallocating while the number of objects ramps up
+    m_capacity = 256;
+    while (m_capacity < capacity)
+        m_capacity *= 2;
+
+    glGenBuffers(1, &m_instanceBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, m_instanceBuffer);
+    if (m_path == PATH_PERSISTENT) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        GLsizeiptr size = static_cast< GLsizeiptr >(g_ringSegments * m_capacity * sizeof(Instance));
+        glBufferStorage(GL_ARRAY_BUFFER, size, NULL, flags);
+        m_pMapped = glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+        if (m_pMapped == NULL) {
+            LOG4CPP_WARN(logger, "Cannot map instance buffer persistently, falling back to streaming");
+            m_path = PATH_STREAMING;
+            allocate_instance_buffer(capacity);
+        }
+    } else {
+        glBufferData(GL_ARRAY_BUFFER, m_capacity * sizeof(Instance), NULL, GL_STREAM_DRAW);
+    }
+    m_segment = 0;
+    m_bUploadNeeded = true;
+}
+
+std::size_t InstanceBatch::upload_instances() {
+    // returns the byte offset of the uploaded instances, called with the instance buffer bound
+    std::size_t total = 0;
+    for (int s = 0; s < SHAPE_COUNT; s++)
+        total += m_renderInstances[s].size();
+
+    if (m_instanceBuffer == 0 || total > m_capacity)
+        allocate_instance_buffer(total);
+
+    if (m_path == PATH_PERSISTENT) {
+        if (m_bUploadNeeded) {
+            m_segment = (m_segment + 1) % g_ringSegments;
+            // wait until the GPU has finished reading the segment from its last use
+            if (m_fences[m_segment] != 0) {
+                GLenum result = glClientWaitSync(m_fences[m_segment], GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+                if (result == GL_TIMEOUT_EXPIRED)
+                    glClientWaitSync(m_fences[m_segment], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+                glDeleteSync(m_fences[m_segment]);
+                m_fences[m_segment] = 0;
+            }
+            m_lastOffset = m_segment * m_capacity * sizeof(Instance);
+            char* dst = static_cast< char* >(m_pMapped) + m_lastOffset;
+            for (int s = 0; s < SHAPE_COUNT; s++) {
+                if (m_renderInstances[s].empty())
+                    continue;
+                std::size_t bytes = m_renderInstances[s].size() * sizeof(Instance);
+                std::memcpy(dst, &m_renderInstances[s][0], bytes);
+                dst += bytes;
+            }
+        }
+    } else if (m_bUploadNeeded) {
+        // orphan the old storage so the driver does not synchronize with pending draws
+        glBufferData(GL_ARRAY_BUFFER, m_capacity * sizeof(Instance), NULL, GL_STREAM_DRAW);
+        std::size_t offset = 0;
+        for (int s = 0; s < SHAPE_COUNT; s++) {
+            if (m_renderInstances[s].empty())
+                continue;
+            std::size_t bytes = m_renderInstances[s].size() * sizeof(Instance);
+            glBufferSubData(GL_ARRAY_BUFFER, offset, bytes, &m_renderInstances[s][0]);
+            offset += bytes;
+        }
+        m_lastOffset = 0;
+    }
+    m_bUploadNeeded = false;
+    return m_lastOffset;
+}
+
+void InstanceBatch::draw() {
+    m_drawCalls = 0;
+    if (m_path == PATH_NONE) {
+        init_gl();
+        GLStateCache::invalidate_current(GLStateCache::STATE_BUFFERS | GLStateCache::STATE_PROGRAM);
+    }
+
+    {
+        // take a snapshot so producers are not blocked while drawing
+        boost::mutex::scoped_lock lock( m_mutex );
+        if (m_bDirty) {
+            for (int s = 0; s < SHAPE_COUNT; s++)
+                m_renderInstances[s] = m_instances[s];
+            m_bDirty = false;
+            m_bUploadNeeded = true;
+        }
+    }
+
+    if (m_path == PATH_IMMEDIATE) {
+        draw_immediate();
+        return;
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, m_instanceBuffer);
+    std::size_t baseOffset = upload_instances();
+    draw_instanced(baseOffset);
+
+    if (m_path == PATH_PERSISTENT) {
+        // protect the segment until the GPU has consumed it
+        if (m_fences[m_segment] != 0)
+            glDeleteSync(m_fences[m_segment]);
+        m_fences[m_segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+}
+
+void InstanceBatch::draw_instanced(std::size_t baseOffset) {
+    glUseProgram(m_program);
+
+    std::size_t offset = baseOffset;
+    for (int s = 0; s < SHAPE_COUNT; s++) {
+        GLsizei count = static_cast< GLsizei >(m_renderInstances[s].size());
+        if (count == 0)
+            continue;
+        const ShapeGeometry& g = m_geometry[s];
+
+        glBindBuffer(GL_ARRAY_BUFFER, g.vertexBuffer);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g.indexBuffer);
+        GLint vertexAttribs[3] = { m_attribPosition, m_attribNormal, m_attribColor };
+        GLint vertexSizes[3] = { 3, 3, 4 };
+        std::size_t vertexOffset = 0;
+        for (int a = 0; a < 3; a++) {
+            if (vertexAttribs[a] >= 0) {
+                glEnableVertexAttribArray(vertexAttribs[a]);
+                glVertexAttribPointer(vertexAttribs[a], vertexSizes[a], GL_FLOAT, GL_FALSE, g_vertexFloats * sizeof(float),
+                    reinterpret_cast< const GLvoid* >(vertexOffset));
+            }
+            vertexOffset += vertexSizes[a] * sizeof(float);
+        }
+
+        // each shape reads its own range of the instance buffer, which avoids needing base instance support
+        glBindBuffer(GL_ARRAY_BUFFER, m_instanceBuffer);
+        for (int a = 0; a < 6; a++) {
+            if (m_attribInstance[a] < 0)
+                continue;
+            glEnableVertexAttribArray(m_attribInstance[a]);
+            glVertexAttribPointer(m_attribInstance[a], 4, GL_FLOAT, GL_FALSE, sizeof(Instance),
+                reinterpret_cast< const GLvoid* >(offset + a * 4 * sizeof(float)));
+            m_vertexAttribDivisor(m_attribInstance[a], 1);
+        }
+
+        m_drawElementsInstanced(g.mode, g.indexCount, GL_UNSIGNED_SHORT, 0, count);
+        m_drawCalls++;
+        offset += count * sizeof(Instance);
+    }
+
+    for (int a = 0; a < 6; a++) {
+        if (m_attribInstance[a] < 0)
+            continue;
+        m_vertexAttribDivisor(m_attribInstance[a], 0);
+        glDisableVertexAttribArray(m_attribInstance[a]);
+    }
+    GLint vertexAttribs[3] = { m_attribPosition, m_attribNormal, m_attribColor };
+    for (int a = 0; a < 3; a++) {
+        if (vertexAttribs[a] >= 0)
+            glDisableVertexAttribArray(vertexAttribs[a]);
+    }
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glUseProgram(0);
+    GLStateCache::invalidate_current(GLStateCache::STATE_BUFFERS | GLStateCache::STATE_PROGRAM);
+}
+
+void InstanceBatch::draw_immediate() {
+    // fixed function fallback: one draw per instance, still without re-uploading geometry
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+    for (int s = 0; s < SHAPE_COUNT; s++) {
+        if (m_renderInstances[s].empty())
+            continue;
+        const ShapeGeometry& g = m_geometry[s];
+        glBindBuffer(GL_ARRAY_BUFFER, g.vertexBuffer);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g.indexBuffer);
+        glVertexPointer(3, GL_FLOAT, g_vertexFloats * sizeof(float), 0);
+        glNormalPointer(GL_FLOAT, g_vertexFloats * sizeof(float), reinterpret_cast< const GLvoid* >(3 * sizeof(float)));
+
+        // axes keep their own colours and are not lit
+        bool axes = (s == SHAPE_AXES);
+        if (axes) {
+            glPushAttrib(GL_LIGHTING_BIT);
+            glDisable(GL_LIGHTING);
+            glEnableClientState(GL_COLOR_ARRAY);
+            glColorPointer(4, GL_FLOAT, g_vertexFloats * sizeof(float), reinterpret_cast< const GLvoid* >(6 * sizeof(float)));
+        }
+
+        for (std::vector< Instance >::const_iterator it = m_renderInstances[s].begin(); it != m_renderInstances[s].end(); ++it) {
+            glPushMatrix();
+            glMultMatrixf(it->model);
+            glScalef(it->scale[0], it->scale[1], it->scale[2]);
+            if (!axes)
+                glColor4fv(it->color);
+            glDrawElements(g.mode, g.indexCount, GL_UNSIGNED_SHORT, 0);
+            glPopMatrix();
+            m_drawCalls++;
+        }
+
+        if (axes) {
+            glDisableClientState(GL_COLOR_ARRAY);
+            glPopAttrib();
+        }
+    }
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    GLStateCache::invalidate_current(GLStateCache::STATE_BUFFERS);
+}
+
+void InstanceBatch::release_gl() {
+    if (m_path == PATH_NONE)
+        return;
+
+    for (int s = 0; s < SHAPE_ELLIPSOID; s++) {
+        glDeleteBuffers(1, &m_geometry[s].vertexBuffer);
+        glDeleteBuffers(1, &m_geometry[s].indexBuffer);
+    }
+    std::memset(m_geometry, 0, sizeof(m_geometry));
+
+    if (m_instanceBuffer != 0) {
+        if (m_pMapped != NULL) {
+            glBindBuffer(GL_ARRAY_BUFFER, m_instanceBuffer);
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            m_pMapped = NULL;
+        }
+        glDeleteBuffers(1, &m_instanceBuffer);
+        m_instanceBuffer = 0;
+    }
+    for (unsigned int i = 0; i < g_ringSegments; i++) {
+        if (m_fences[i] != 0) {
+            glDeleteSync(m_fences[i]);
+            m_fences[i] = 0;
+        }
+    }
+    if (m_program != 0) {
+        // the program is private only without any share group, otherwise every batch of the group uses it
+        if (share_group() == static_cast< void* >(this)) {
+            glDeleteProgram(m_program);
+            ShaderManager::singleton().drop_share_group(share_group());
+        }
+        m_program = 0;
+    }
+    m_capacity = 0;
+    m_path = PATH_NONE;
+    m_bUploadNeeded = true;
+    GLStateCache::invalidate_current(GLStateCache::STATE_BUFFERS);
+}
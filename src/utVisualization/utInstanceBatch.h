@@ -0,0 +1,163 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @ingroup visualization
+ * @file
+ * Batched drawing of many simple tracked objects.
+ *
+ * Camera handles submit pose, scale and colour of axes, boxes, spheres and
+ * ellipsoids to an InstanceBatch and draw the whole batch with one instanced
+ * draw call per shape. Instance data is streamed through a persistently
+ * mapped buffer ring where the context supports it.
+ */
+
+#ifndef UBITRACK_UTINSTANCEBATCH_H
+#define UBITRACK_UTINSTANCEBATCH_H
+
+#include <vector>
+#include <boost/thread/mutex.hpp>
+
+#include <utVisualization/Config.h>
+#include <utVisualization/utOpenGL.h>
+
+namespace Ubitrack {
+    namespace Visualization {
+
+        class UBITRACK_EXPORT InstanceBatch {
+
+        public:
+
+            enum Shape {
+                SHAPE_AXES = 0,      // red/green/blue unit axes, colour modulates the axis colours
+                SHAPE_BOX,           // cube spanning [-1, 1], scale gives the half extents
+                SHAPE_SPHERE,        // unit sphere, scale gives the radius
+                SHAPE_ELLIPSOID,     // unit sphere, scale gives the semi axes in the rotated frame of the pose
+                SHAPE_COUNT
+            };
+
+            /** how the batch reaches the GPU in the current context */
+            enum Path {
+                PATH_NONE = 0,       // not initialized yet
+                PATH_PERSISTENT,     // instancing from a persistently mapped ring buffer
+                PATH_STREAMING,      // instancing from an orphaned and re-filled buffer
+                PATH_IMMEDIATE       // one fixed function draw per instance
+            };
+
+            InstanceBatch();
+            ~InstanceBatch();
+
+            /** removes all instances, may be called from any thread */
+            void clear();
+
+            /**
+             * adds an instance, may be called from any thread.
+             * @param pose column major 4x4 model matrix (as used by glMultMatrixf)
+             * @param scale scale along the x, y and z axis of the pose
+             * @param color rgba colour
+             */
+            void add(Shape shape, const float pose[16], const float scale[3], const float color[4]);
+
+            /** convenience for an instance placed at a position without rotation */
+            void add(Shape shape, const float position[3], float size, const float color[4]);
+
+            /** draws all instances, render thread only, with the context current that will be used for all later draws */
+            void draw();
+
+            /** release the GL resources, call with the context current before it is destroyed */
+            void release_gl();
+
+            std::size_t instance_count();
+
+            /**
+             * share the program with other contexts of a share group (see VirtualWindow::share_group), call before the first draw.
+             * Defaults to the render manager's shared context if one is set, otherwise the program is private.
+             */
+            void set_share_group(void* share_group);
+            void* share_group() const;
+
+            /** number of draw calls issued by the last call to draw() */
+            unsigned int draw_calls() const {
+                return m_drawCalls;
+            }
+
+            Path path() const {
+                return m_path;
+            }
+
+        protected:
+
+            // per instance layout in the instance buffer: model matrix, scale (w unused), colour
+            struct Instance {
+                float model[16];
+                float scale[4];
+                float color[4];
+            };
+
+            struct ShapeGeometry {
+                GLenum mode;
+                GLuint vertexBuffer;
+                GLuint indexBuffer;
+                GLsizei indexCount;
+            };
+
+            void init_gl();
+            void create_geometry();
+            void upload_shape(Shape shape, const std::vector< float >& vertices, const std::vector< unsigned short >& indices, GLenum mode);
+            void allocate_instance_buffer(std::size_t capacity);
+            std::size_t upload_instances();
+            void draw_instanced(std::size_t baseOffset);
+            void draw_immediate();
+
+            std::vector< Instance > m_instances[SHAPE_COUNT];
+            std::vector< Instance > m_renderInstances[SHAPE_COUNT];
+            boost::mutex m_mutex;
+            bool m_bDirty;
+            bool m_bUploadNeeded;
+
+            Path m_path;
+            ShapeGeometry m_geometry[SHAPE_COUNT];
+            GLuint m_program;
+            GLint m_attribPosition;
+            GLint m_attribNormal;
+            GLint m_attribColor;
+            GLint m_attribInstance[6];
+
+            GLuint m_instanceBuffer;
+            std::size_t m_capacity;
+            void* m_pMapped;
+            unsigned int m_segment;
+            GLsync m_fences[3];
+            std::size_t m_lastOffset;
+
+            PFNGLVERTEXATTRIBDIVISORPROC m_vertexAttribDivisor;
+            PFNGLDRAWELEMENTSINSTANCEDPROC m_drawElementsInstanced;
+
+            unsigned int m_drawCalls;
+            void* m_pShareGroup;
+        };
+
+    }
+}
+
+#endif //UBITRACK_UTINSTANCEBATCH_H
@@ -0,0 +1,440 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+#include "utMultiView.h"
+#include "utRenderAPI.h"
+#include "utShaderManager.h"
+#include "utGLStateCache.h"
+
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <sstream>
+
+#include <log4cpp/Category.hh>
+
+using namespace Ubitrack;
+using namespace Ubitrack::Visualization;
+
+static log4cpp::Category& logger(log4cpp::Category::getInstance("utVisualization.MultiView"));
+
+// all variants shade the same way, so the views of a stereo pair match
+static const char* g_sequentialVertexShader =
+    "#version 120\n"
+    "attribute vec3 a_position;\n"
+    "attribute vec3 a_normal;\n"
+    "uniform mat4 u_model;\n"
+    "uniform mat4 u_viewProjection[1];\n"
+    "uniform vec4 u_color;\n"
+    "uniform vec3 u_light;\n"
+    "varying vec4 v_color;\n"
+    "void main() {\n"
+    "    gl_Position = u_viewProjection[0] * (u_model * vec4(a_position, 1.0));\n"
+    "    float d = max(dot(normalize(mat3(u_model) * a_normal), u_light), 0.0);\n"
+    "    v_color = vec4(u_color.rgb * (0.2 + 0.8 * d), u_color.a);\n"
+    "}\n";
+
+static const char* g_sequentialFragmentShader =
+    "#version 120\n"
+    "varying vec4 v_color;\n"
+    "void main() {\n"
+    "    gl_FragColor = v_color;\n"
+    "}\n";
+
+// the instance id selects the view, clip space x is squeezed into the view's part of the viewport
+static const char* g_instancedVertexShader =
+    "#version 140\n"
+    "in vec3 a_position;\n"
+    "in vec3 a_normal;\n"
+    "uniform mat4 u_model;\n"
+    "uniform mat4 u_viewProjection[4];\n"
+    "uniform int u_viewCount;\n"
+    "uniform vec4 u_color;\n"
+    "uniform vec3 u_light;\n"
+    "out vec4 v_color;\n"
+    "out float gl_ClipDistance[2];\n"
+    "void main() {\n"
+    "    int view = gl_InstanceID;\n"
+    "    vec4 clip = u_viewProjection[view] * (u_model * vec4(a_position, 1.0));\n"
+    "    gl_ClipDistance[0] = clip.w + clip.x;\n"
+    "    gl_ClipDistance[1] = clip.w - clip.x;\n"
+    "    float n = float(u_viewCount);\n"
+    "    clip.x = (clip.x + clip.w * (2.0 * float(view) + 1.0 - n)) / n;\n"
+    "    gl_Position = clip;\n"
+    "    float d = max(dot(normalize(mat3(u_model) * a_normal), u_light), 0.0);\n"
+    "    v_color = vec4(u_color.rgb * (0.2 + 0.8 * d), u_color.a);\n"
+    "}\n";
+
+static const char* g_instancedFragmentShader =
+    "#version 140\n"
+    "in vec4 v_color;\n"
+    "out vec4 o_color;\n"
+    "void main() {\n"
+    "    o_color = v_color;\n"
+    "}\n";
+
+static const char* g_multiviewFragmentShader =
+    "#version 330\n"
+    "in vec4 v_color;\n"
+    "out vec4 o_color;\n"
+    "void main() {\n"
+    "    o_color = v_color;\n"
+    "}\n";
+
+static const char* g_sequentialProgramName = "utVisualization.MultiView.Sequential";
+static const char* g_instancedProgramName = "utVisualization.MultiView.Instanced";
+
+
+namespace {
+
+    // the number of views is part of the multiview shader, one variant per count
+    std::string multiviewVertexShader(unsigned int views) {
+        std::ostringstream s;
+        s << "#version 330\n"
+          << "#extension GL_OVR_multiview : require\n"
+          << "layout(num_views = " << views << ") in;\n"
+          << "in vec3 a_position;\n"
+          << "in vec3 a_normal;\n"
+          << "uniform mat4 u_model;\n"
+          << "uniform mat4 u_viewProjection[4];\n"
+          << "uniform vec4 u_color;\n"
+          << "uniform vec3 u_light;\n"
+          << "out vec4 v_color;\n"
+          << "void main() {\n"
+          << "    gl_Position = u_viewProjection[gl_ViewID_OVR] * (u_model * vec4(a_position, 1.0));\n"
+          << "    float d = max(dot(normalize(mat3(u_model) * a_normal), u_light), 0.0);\n"
+          << "    v_color = vec4(u_color.rgb * (0.2 + 0.8 * d), u_color.a);\n"
+          << "}\n";
+        return s.str();
+    }
+
+    // column major 4x4 product r = a * b
+    void multiply(const float a[16], const float b[16], float r[16]) {
+        for (int c = 0; c < 4; c++) {
+            for (int row = 0; row < 4; row++) {
+                float sum = 0.0f;
+                for (int k = 0; k < 4; k++)
+                    sum += a[k * 4 + row] * b[c * 4 + k];
+                r[c * 4 + row] = sum;
+            }
+        }
+    }
+
+}
+
+
+MultiViewRenderer::ProgramInfo::ProgramInfo()
+        : program(0)
+        , attribPosition(-1)
+        , attribNormal(-1)
+        , uniformModel(-1)
+        , uniformViewProjection(-1)
+        , uniformViewCount(-1)
+        , uniformColor(-1)
+        , uniformLight(-1)
+{
+}
+
+void MultiViewRenderer::ProgramInfo::resolve(GLuint p) {
+    program = p;
+    if (program == 0)
+        return;
+    attribPosition = glGetAttribLocation(program, "a_position");
+    attribNormal = glGetAttribLocation(program, "a_normal");
+    uniformModel = glGetUniformLocation(program, "u_model");
+    uniformViewProjection = glGetUniformLocation(program, "u_viewProjection");
+    uniformViewCount = glGetUniformLocation(program, "u_viewCount");
+    uniformColor = glGetUniformLocation(program, "u_color");
+    uniformLight = glGetUniformLocation(program, "u_light");
+}
+
+
+MultiViewRenderer::MultiViewRenderer()
+        : m_viewCount(2)
+        , m_bInitialized(false)
+        , m_bInstancingSupported(false)
+        , m_bMultiviewSupported(false)
+        , m_bLayersSupported(false)
+        , m_drawElementsInstanced(NULL)
+        , m_multiviewViews(0)
+        , m_framebuffer(0)
+        , m_savedProgram(0)
+        , m_savedFramebuffer(0)
+        , m_path(PATH_NONE)
+        , m_drawCalls(0)
+        , m_pShareGroup(NULL)
+{
+    // known up front so the programs can be built while the dataflow starts
+    ShaderManager::singleton().register_program(g_sequentialProgramName, g_sequentialVertexShader, g_sequentialFragmentShader);
+    ShaderManager::singleton().register_program(g_instancedProgramName, g_instancedVertexShader, g_instancedFragmentShader);
+
+    static const float identity[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+    for (unsigned int v = 0; v < MAX_VIEWS; v++)
+        std::memcpy(m_viewProjection[v], identity, sizeof(identity));
+    static const float light[3] = { 0.3f, 0.5f, 0.8f };
+    set_light_direction(light);
+    m_savedViewport[0] = m_savedViewport[1] = m_savedViewport[2] = m_savedViewport[3] = 0;
+}
+
+MultiViewRenderer::~MultiViewRenderer() {
+    // GL resources must be released explicitly with release_gl(), the context may be gone here
+}
+
+void MultiViewRenderer::set_view_count(unsigned int count) {
+    m_viewCount = std::max(1u, std::min(count, static_cast< unsigned int >(MAX_VIEWS)));
+}
+
+void MultiViewRenderer::set_view(unsigned int index, const float view[16], const float projection[16]) {
+    if (index >= MAX_VIEWS)
+        return;
+    multiply(projection, view, m_viewProjection[index]);
+}
+
+void MultiViewRenderer::set_light_direction(const float direction[3]) {
+    float length = std::sqrt(direction[0] * direction[0] + direction[1] * direction[1] + direction[2] * direction[2]);
+    for (int i = 0; i < 3; i++)
+        m_light[i] = length > 0.0f ? direction[i] / length : 0.0f;
+}
+
+void MultiViewRenderer::set_share_group(void* share_group) {
+    m_pShareGroup = share_group;
+}
+
+void* MultiViewRenderer::share_group() const {
+    if (m_pShareGroup)
+        return m_pShareGroup;
+    // window contexts of the frontends share their objects with the render manager's context
+    void* shared = RenderManager::singleton().getSharedOpenGLContext();
+    return shared ? shared : const_cast< MultiViewRenderer* >(this);
+}
+
+void MultiViewRenderer::clear() {
+    m_items.clear();
+}
+
+void MultiViewRenderer::add(const MeshBuffers& mesh, const float model[16], const float color[4]) {
+    add(mesh.vertex_buffer(), mesh.index_buffer(), mesh.index_count(), GL_UNSIGNED_INT, model, color);
+}
+
+void MultiViewRenderer::add(GLuint vertexBuffer, GLuint indexBuffer, GLsizei indexCount, GLenum indexType,
+    const float model[16], const float color[4]) {
+    Item item;
+    item.vertexBuffer = vertexBuffer;
+    item.indexBuffer = indexBuffer;
+    item.indexCount = indexCount;
+    item.indexType = indexType;
+    std::memcpy(item.model, model, sizeof(item.model));
+    std::memcpy(item.color, color, sizeof(item.color));
+    m_items.push_back(item);
+}
+
+void MultiViewRenderer::init_gl() {
+    m_bInitialized = true;
+    ShaderManager& shaders = ShaderManager::singleton();
+
+    m_sequential.resolve(shaders.program(g_sequentialProgramName, share_group()));
+    if (m_sequential.program == 0)
+        LOG4CPP_ERROR(logger, "Cannot build the multi-view shader, nothing will be drawn");
+
+    if (hasGLVersion(3, 1)) {
+        m_drawElementsInstanced = glDrawElementsInstanced;
+        m_instanced.resolve(shaders.program(g_instancedProgramName, share_group()));
+        m_bInstancingSupported = (m_instanced.program != 0);
+    }
+
+    m_bLayersSupported = hasGLVersion(3, 0);
+#ifdef GL_OVR_multiview
+    m_bMultiviewSupported = m_bLayersSupported && hasGLVersion(3, 3) && hasGLExtension("GL_OVR_multiview");
+#endif
+    if (m_bLayersSupported) {
+        glGenFramebuffers(1, &m_framebuffer);
+    }
+
+    LOG4CPP_INFO(logger, "Multi-view rendering: side-by-side " << (m_bInstancingSupported ? "instanced" : "sequential")
+        << ", layered " << (m_bMultiviewSupported ? "GL_OVR_multiview" : (m_bLayersSupported ? "sequential" : "not supported")));
+}
+
+bool MultiViewRenderer::use_program(const ProgramInfo& info, unsigned int firstView, unsigned int viewCount) {
+    if (info.program == 0 || info.attribPosition < 0)
+        return false;
+    glUseProgram(info.program);
+    glUniformMatrix4fv(info.uniformViewProjection, viewCount, GL_FALSE, m_viewProjection[firstView]);
+    if (info.uniformViewCount >= 0)
+        glUniform1i(info.uniformViewCount, viewCount);
+    glUniform3fv(info.uniformLight, 1, m_light);
+    return true;
+}
+
+void MultiViewRenderer::draw_items(const ProgramInfo& info, GLsizei instances) {
+    glEnableVertexAttribArray(info.attribPosition);
+    if (info.attribNormal >= 0)
+        glEnableVertexAttribArray(info.attribNormal);
+
+    for (std::vector< Item >::const_iterator it = m_items.begin(); it != m_items.end(); ++it) {
+        if (it->indexCount == 0)
+            continue;
+        glBindBuffer(GL_ARRAY_BUFFER, it->vertexBuffer);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, it->indexBuffer);
+        glVertexAttribPointer(info.attribPosition, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), 0);
+        if (info.attribNormal >= 0)
+            glVertexAttribPointer(info.attribNormal, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float),
+                reinterpret_cast< const GLvoid* >(3 * sizeof(float)));
+        glUniformMatrix4fv(info.uniformModel, 1, GL_FALSE, it->model);
+        glUniform4fv(info.uniformColor, 1, it->color);
+
+        if (instances > 1)
+            m_drawElementsInstanced(GL_TRIANGLES, it->indexCount, it->indexType, 0, instances);
+        else
+            glDrawElements(GL_TRIANGLES, it->indexCount, it->indexType, 0);
+        m_drawCalls++;
+    }
+
+    if (info.attribNormal >= 0)
+        glDisableVertexAttribArray(info.attribNormal);
+    glDisableVertexAttribArray(info.attribPosition);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void MultiViewRenderer::end_draw() {
+    glUseProgram(m_savedProgram);
+    glViewport(m_savedViewport[0], m_savedViewport[1], m_savedViewport[2], m_savedViewport[3]);
+    // program, viewport and framebuffer are back to what they were, the buffer bindings are not
+    GLStateCache::invalidate_current(GLStateCache::STATE_BUFFERS);
+}
+
+bool MultiViewRenderer::draw_side_by_side(int width, int height) {
+    if (!m_bInitialized)
+        init_gl();
+    m_drawCalls = 0;
+    if (width <= 0 || height <= 0)
+        return false;
+
+    glGetIntegerv(GL_CURRENT_PROGRAM, &m_savedProgram);
+    glGetIntegerv(GL_VIEWPORT, m_savedViewport);
+
+    bool ok = false;
+    if (m_bInstancingSupported && m_viewCount > 1) {
+        // one draw per mesh, the clip distances keep each view inside its half
+        glViewport(0, 0, width, height);
+        if (use_program(m_instanced, 0, m_viewCount)) {
+            glEnable(GL_CLIP_DISTANCE0);
+            glEnable(GL_CLIP_DISTANCE1);
+            draw_items(m_instanced, m_viewCount);
+            glDisable(GL_CLIP_DISTANCE1);
+            glDisable(GL_CLIP_DISTANCE0);
+            m_path = PATH_INSTANCED;
+            ok = true;
+        }
+    }
+    if (!ok) {
+        int viewWidth = width / m_viewCount;
+        for (unsigned int v = 0; v < m_viewCount; v++) {
+            glViewport(v * viewWidth, 0, viewWidth, height);
+            if (!use_program(m_sequential, v, 1))
+                break;
+            draw_items(m_sequential, 1);
+            ok = true;
+        }
+        m_path = PATH_SEQUENTIAL;
+    }
+
+    end_draw();
+    return ok;
+}
+
+bool MultiViewRenderer::draw_layered(GLuint colorArray, GLuint depthArray, int width, int height, bool clear) {
+    if (!m_bInitialized)
+        init_gl();
+    m_drawCalls = 0;
+    if (!m_bLayersSupported || width <= 0 || height <= 0)
+        return false;
+
+    glGetIntegerv(GL_CURRENT_PROGRAM, &m_savedProgram);
+    glGetIntegerv(GL_VIEWPORT, m_savedViewport);
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &m_savedFramebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+    glViewport(0, 0, width, height);
+    GLbitfield clearMask = GL_COLOR_BUFFER_BIT | (depthArray != 0 ? GL_DEPTH_BUFFER_BIT : 0);
+
+    bool ok = false;
+#ifdef GL_OVR_multiview
+    if (m_bMultiviewSupported) {
+        // the variant for this number of views is built on first use
+        if (m_multiviewViews != m_viewCount) {
+            std::ostringstream name;
+            name << "utVisualization.MultiView.OVR" << m_viewCount;
+            m_multiview = ProgramInfo();
+            m_multiview.resolve(ShaderManager::singleton().program(name.str(), multiviewVertexShader(m_viewCount),
+                g_multiviewFragmentShader, share_group()));
+            m_multiviewViews = m_viewCount;
+            if (m_multiview.program == 0)
+                LOG4CPP_WARN(logger, "Cannot build the GL_OVR_multiview shader, drawing the views one by one");
+        }
+
+        glFramebufferTextureMultiviewOVR(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, colorArray, 0, 0, m_viewCount);
+        glFramebufferTextureMultiviewOVR(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthArray, 0, 0, m_viewCount);
+        if (m_multiview.program != 0 && glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE
+            && use_program(m_multiview, 0, m_viewCount)) {
+            if (clear)
+                glClear(clearMask);
+            draw_items(m_multiview, 1);
+            m_path = PATH_MULTIVIEW;
+            ok = true;
+        }
+    }
+#endif
+    if (!ok) {
+        for (unsigned int v = 0; v < m_viewCount; v++) {
+            glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, colorArray, 0, v);
+            glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthArray, 0, v);
+            if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+                LOG4CPP_ERROR(logger, "Cannot render into layer " << v << " of texture array " << colorArray);
+                break;
+            }
+            if (clear)
+                glClear(clearMask);
+            if (!use_program(m_sequential, v, 1))
+                break;
+            draw_items(m_sequential, 1);
+            ok = true;
+        }
+        m_path = PATH_SEQUENTIAL;
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, m_savedFramebuffer);
+    end_draw();
+    return ok;
+}
+
+void MultiViewRenderer::release_gl() {
+    if (m_framebuffer != 0)
+        glDeleteFramebuffers(1, &m_framebuffer);
+    m_framebuffer = 0;
+    // programs belong to the ShaderManager
+    m_sequential = ProgramInfo();
+    m_instanced = ProgramInfo();
+    m_multiview = ProgramInfo();
+    m_multiviewViews = 0;
+    m_bInitialized = false;
+}
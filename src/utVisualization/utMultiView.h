@@ -0,0 +1,179 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @ingroup visualization
+ * @file
+ * Single pass rendering of several views, e.g. the two eyes of a stereo display.
+ *
+ * A camera handle sets the view and projection matrix of every view and
+ * submits its geometry once. The renderer draws each submitted mesh into
+ * all views with one call where the context allows: with GL_OVR_multiview
+ * into the layers of a texture array, or with instancing into side-by-side
+ * viewports. Otherwise the submitted list is replayed once per view.
+ */
+
+#ifndef UBITRACK_UTMULTIVIEW_H
+#define UBITRACK_UTMULTIVIEW_H
+
+#include <vector>
+
+#include <utVisualization/Config.h>
+#include <utVisualization/utOpenGL.h>
+#include <utVisualization/utGeometryCache.h>
+
+namespace Ubitrack {
+    namespace Visualization {
+
+        class UBITRACK_EXPORT MultiViewRenderer {
+
+        public:
+
+            /** maximum number of views */
+            enum {
+                MAX_VIEWS = 4
+            };
+
+            /** how the last draw reached the views */
+            enum Path {
+                PATH_NONE = 0,       // nothing drawn yet
+                PATH_MULTIVIEW,      // GL_OVR_multiview, one draw per mesh into all layers
+                PATH_INSTANCED,      // one instance per view, clip space shifted into side-by-side viewports
+                PATH_SEQUENTIAL      // the submitted meshes are drawn once per view
+            };
+
+            MultiViewRenderer();
+            ~MultiViewRenderer();
+
+            /** number of views, between 1 and MAX_VIEWS */
+            void set_view_count(unsigned int count);
+            unsigned int view_count() const {
+                return m_viewCount;
+            }
+
+            /** column major 4x4 view and projection matrix of one view */
+            void set_view(unsigned int index, const float view[16], const float projection[16]);
+
+            /** world space direction towards the light used for diffuse shading */
+            void set_light_direction(const float direction[3]);
+
+            /** removes all submitted meshes */
+            void clear();
+
+            /** submits a cached mesh, the buffers must stay alive until the next clear() */
+            void add(const MeshBuffers& mesh, const float model[16], const float color[4]);
+
+            /** submits indexed triangles with interleaved position and normal (six floats per vertex) as in Mesh */
+            void add(GLuint vertexBuffer, GLuint indexBuffer, GLsizei indexCount, GLenum indexType,
+                const float model[16], const float color[4]);
+
+            /**
+             * draws all views next to each other into the currently bound framebuffer,
+             * each view gets 1 / view_count of the given width. The target is not cleared.
+             */
+            bool draw_side_by_side(int width, int height);
+
+            /**
+             * draws view i into layer i of a 2D texture array (and of a depth texture array, if given).
+             * Both arrays need at least view_count layers of the given size. The layers are cleared if clear is set.
+             */
+            bool draw_layered(GLuint colorArray, GLuint depthArray, int width, int height, bool clear = true);
+
+            /** release the GL resources, call with the context current before it is destroyed */
+            void release_gl();
+
+            /**
+             * share the programs with other contexts of a share group (see VirtualWindow::share_group), call before the first draw.
+             * Defaults to the render manager's shared context if one is set, otherwise the programs are private.
+             */
+            void set_share_group(void* share_group);
+            void* share_group() const;
+
+            Path path() const {
+                return m_path;
+            }
+
+            /** number of draw calls issued by the last draw */
+            unsigned int draw_calls() const {
+                return m_drawCalls;
+            }
+
+        protected:
+
+            struct Item {
+                GLuint vertexBuffer;
+                GLuint indexBuffer;
+                GLsizei indexCount;
+                GLenum indexType;
+                float model[16];
+                float color[4];
+            };
+
+            struct ProgramInfo {
+                GLuint program;
+                GLint attribPosition;
+                GLint attribNormal;
+                GLint uniformModel;
+                GLint uniformViewProjection;
+                GLint uniformViewCount;
+                GLint uniformColor;
+                GLint uniformLight;
+
+                ProgramInfo();
+                void resolve(GLuint program);
+            };
+
+            void init_gl();
+            bool use_program(const ProgramInfo& info, unsigned int firstView, unsigned int viewCount);
+            void draw_items(const ProgramInfo& info, GLsizei instances);
+            void end_draw();
+
+            unsigned int m_viewCount;
+            float m_viewProjection[MAX_VIEWS][16];
+            float m_light[3];
+            std::vector< Item > m_items;
+
+            bool m_bInitialized;
+            bool m_bInstancingSupported;
+            bool m_bMultiviewSupported;
+            bool m_bLayersSupported;
+            PFNGLDRAWELEMENTSINSTANCEDPROC m_drawElementsInstanced;
+            ProgramInfo m_sequential;
+            ProgramInfo m_instanced;
+            ProgramInfo m_multiview;
+            unsigned int m_multiviewViews;
+            GLuint m_framebuffer;
+
+            GLint m_savedProgram;
+            GLint m_savedFramebuffer;
+            GLint m_savedViewport[4];
+
+            Path m_path;
+            unsigned int m_drawCalls;
+            void* m_pShareGroup;
+        };
+
+    }
+}
+
+#endif //UBITRACK_UTMULTIVIEW_H
@@ -0,0 +1,121 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+#include "utOpenGL.h"
+
+#include <cstring>
+#include <cstdio>
+#include <vector>
+
+namespace Ubitrack {
+    namespace Visualization {
+
+bool hasGLExtension(const char* name) {
+    const char* extensions = reinterpret_cast< const char* >(glGetString(GL_EXTENSIONS));
+    if (extensions != NULL) {
+        // match whole words only, some names are prefixes of others
+        std::size_t len = std::strlen(name);
+        for (const char* p = std::strstr(extensions, name); p != NULL; p = std::strstr(p + len, name)) {
+            if ((p == extensions || p[-1] == ' ') && (p[len] == ' ' || p[len] == '\0'))
+                return true;
+        }
+        return false;
+    }
+#ifdef GL_NUM_EXTENSIONS
+    // core profile contexts only provide the indexed query
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++) {
+        const char* ext = reinterpret_cast< const char* >(glGetStringi(GL_EXTENSIONS, i));
+        if (ext != NULL && std::strcmp(ext, name) == 0)
+            return true;
+    }
+#endif
+    return false;
+}
+
+bool hasGLVersion(int major, int minor) {
+    const char* version = reinterpret_cast< const char* >(glGetString(GL_VERSION));
+    int ctxMajor = 0;
+    int ctxMinor = 0;
+    if (version == NULL || std::sscanf(version, "%d.%d", &ctxMajor, &ctxMinor) != 2)
+        return false;
+    return (ctxMajor > major) || ((ctxMajor == major) && (ctxMinor >= minor));
+}
+
+static GLuint compileShader(GLenum type, const char* source, std::string& log) {
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, NULL);
+    glCompileShader(shader);
+
+    GLint status = GL_FALSE;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+    if (status != GL_TRUE) {
+        GLint length = 0;
+        glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+        std::vector< GLchar > buffer(length + 1, 0);
+        glGetShaderInfoLog(shader, length, NULL, &buffer[0]);
+        log = &buffer[0];
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+GLuint compileGLProgram(const char* vertexSource, const char* fragmentSource, std::string& log, bool retrievableBinary) {
+    GLuint vs = compileShader(GL_VERTEX_SHADER, vertexSource, log);
+    if (vs == 0)
+        return 0;
+    GLuint fs = compileShader(GL_FRAGMENT_SHADER, fragmentSource, log);
+    if (fs == 0) {
+        glDeleteShader(vs);
+        return 0;
+    }
+
+    GLuint program = glCreateProgram();
+    glAttachShader(program, vs);
+    glAttachShader(program, fs);
+    if (retrievableBinary)
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(program);
+
+    // the program keeps the compiled code alive
+    glDeleteShader(vs);
+    glDeleteShader(fs);
+
+    GLint status = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (status != GL_TRUE) {
+        GLint length = 0;
+        glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+        std::vector< GLchar > buffer(length + 1, 0);
+        glGetProgramInfoLog(program, length, NULL, &buffer[0]);
+        log = &buffer[0];
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+    }
+}
@@ -0,0 +1,81 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @ingroup visualization
+ * @file
+ * Platform independent inclusion of the OpenGL headers used by utVisualization.
+ */
+
+#ifndef UBITRACK_UTOPENGL_H
+#define UBITRACK_UTOPENGL_H
+
+#ifdef HAVE_GLEW
+	#include "GL/glew.h"
+#endif
+
+#ifdef _WIN32
+	#include <utUtil/CleanWindows.h>
+	#include <GL/gl.h>
+	#include <GL/glu.h>
+#elif __APPLE__
+	#include <OpenGL/OpenGL.h>
+	#include <OpenGL/gl.h>
+	#include <OpenGL/glu.h>
+#else
+	#ifdef HAVE_GLEW
+		// We do not need to include gl headers at all. GLEW takes care of that.
+	#else
+		#ifndef GL_GLEXT_PROTOTYPES
+			#define GL_GLEXT_PROTOTYPES 1
+		#endif
+		#include <GL/gl.h>
+		#include <GL/glext.h> // Linux headers
+		#include <GL/glu.h>
+	#endif
+#endif
+
+#include <string>
+#include <utVisualization/Config.h>
+
+namespace Ubitrack {
+    namespace Visualization {
+
+        /** true if the current context supports the given extension, e.g. "GL_ARB_instanced_arrays" */
+        UBITRACK_EXPORT bool hasGLExtension(const char* name);
+
+        /** true if the current context provides at least the given OpenGL version */
+        UBITRACK_EXPORT bool hasGLVersion(int major, int minor);
+
+        /**
+         * compiles and links a GLSL program in the current context.
+         * Returns 0 and fills the log if compiling or linking fails.
+         * Set retrievableBinary only if the context supports glGetProgramBinary.
+         */
+        UBITRACK_EXPORT GLuint compileGLProgram(const char* vertexSource, const char* fragmentSource, std::string& log,
+            bool retrievableBinary = false);
+
+    }
+}
+
+#endif //UBITRACK_UTOPENGL_H
@@ -0,0 +1,343 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+#include "utPerformanceHud.h"
+#include "utGLStateCache.h"
+
+#include <cctype>
+#include <cstdio>
+
+#include <log4cpp/Category.hh>
+
+using namespace Ubitrack;
+using namespace Ubitrack::Visualization;
+
+static log4cpp::Category& logger(log4cpp::Category::getInstance("utVisualization.PerformanceHud"));
+
+// seconds between refreshes of the displayed values
+static const double g_refreshInterval = 0.25;
+
+// data older than this is shown as a warning (ms)
+static const double g_staleDataAge = 100.0;
+
+
+namespace {
+
+    const int g_glyphWidth = 5;
+    const int g_glyphHeight = 7;
+
+    // atlas cells leave a one pixel border so linear filtering never bleeds into neighbours
+    const int g_cellWidth = g_glyphWidth + 2;
+    const int g_cellHeight = g_glyphHeight + 2;
+    const int g_atlasColumns = 16;
+
+    struct Glyph {
+        char c;
+        const char* rows[g_glyphHeight];
+    };
+
+    // 5x7 font, lower case letters are drawn upper case
+    const Glyph g_font[] = {
+        { '0', { ".###.", "#...#", "#..##", "#.#.#", "##..#", "#...#", ".###." } },
+        { '1', { "..#..", ".##..", "..#..", "..#..", "..#..", "..#..", ".###." } },
+        { '2', { ".###.", "#...#", "....#", "...#.", "..#..", ".#...", "#####" } },
+        { '3', { "#####", "...#.", "..#..", "...#.", "....#", "#...#", ".###." } },
+        { '4', { "...#.", "..##.", ".#.#.", "#..#.", "#####", "...#.", "...#." } },
+        { '5', { "#####", "#....", "####.", "....#", "....#", "#...#", ".###." } },
+        { '6', { "..##.", ".#...", "#....", "####.", "#...#", "#...#", ".###." } },
+        { '7', { "#####", "....#", "...#.", "..#..", ".#...", ".#...", ".#..." } },
+        { '8', { ".###.", "#...#", "#...#", ".###.", "#...#", "#...#", ".###." } },
+        { '9', { ".###.", "#...#", "#...#", ".####", "....#", "...#.", ".##.." } },
+        { 'A', { ".###.", "#...#", "#...#", "#####", "#...#", "#...#", "#...#" } },
+        { 'B', { "####.", "#...#", "#...#", "####.", "#...#", "#...#", "####." } },
+        { 'C', { ".###.", "#...#", "#....", "#....", "#....", "#...#", ".###." } },
+        { 'D', { "###..", "#..#.", "#...#", "#...#", "#...#", "#..#.", "###.." } },
+        { 'E', { "#####", "#....", "#....", "####.", "#....", "#....", "#####" } },
+        { 'F', { "#####", "#....", "#....", "####.", "#....", "#....", "#...." } },
+        { 'G', { ".###.", "#...#", "#....", "#.###", "#...#", "#...#", ".####" } },
+        { 'H', { "#...#", "#...#", "#...#", "#####", "#...#", "#...#", "#...#" } },
+        { 'I', { ".###.", "..#..", "..#..", "..#..", "..#..", "..#..", ".###." } },
+        { 'J', { "..###", "...#.", "...#.", "...#.", "...#.", "#..#.", ".##.." } },
+        { 'K', { "#...#", "#..#.", "#.#..", "##...", "#.#..", "#..#.", "#...#" } },
+        { 'L', { "#....", "#....", "#....", "#....", "#....", "#....", "#####" } },
+        { 'M', { "#...#", "##.##", "#.#.#", "#.#.#", "#...#", "#...#", "#...#" } },
+        { 'N', { "#...#", "#...#", "##..#", "#.#.#", "#..##", "#...#", "#...#" } },
+        { 'O', { ".###.", "#...#", "#...#", "#...#", "#...#", "#...#", ".###." } },
+        { 'P', { "####.", "#...#", "#...#", "####.", "#....", "#....", "#...." } },
+        { 'Q', { ".###.", "#...#", "#...#", "#...#", "#.#.#", "#..#.", ".##.#" } },
+        { 'R', { "####.", "#...#", "#...#", "####.", "#.#..", "#..#.", "#...#" } },
+        { 'S', { ".####", "#....", "#....", ".###.", "....#", "....#", "####." } },
+        { 'T', { "#####", "..#..", "..#..", "..#..", "..#..", "..#..", "..#.." } },
+        { 'U', { "#...#", "#...#", "#...#", "#...#", "#...#", "#...#", ".###." } },
+        { 'V', { "#...#", "#...#", "#...#", "#...#", "#...#", ".#.#.", "..#.." } },
+        { 'W', { "#...#", "#...#", "#...#", "#.#.#", "#.#.#", "#.#.#", ".#.#." } },
+        { 'X', { "#...#", "#...#", ".#.#.", "..#..", ".#.#.", "#...#", "#...#" } },
+        { 'Y', { "#...#", "#...#", ".#.#.", "..#..", "..#..", "..#..", "..#.." } },
+        { 'Z', { "#####", "....#", "...#.", "..#..", ".#...", "#....", "#####" } },
+        { '.', { ".....", ".....", ".....", ".....", ".....", ".##..", ".##.." } },
+        { ':', { ".....", ".##..", ".##..", ".....", ".##..", ".##..", "....." } },
+        { '%', { "##...", "##..#", "...#.", "..#..", ".#...", "#..##", "...##" } },
+        { '/', { ".....", "....#", "...#.", "..#..", ".#...", "#....", "....." } },
+        { '-', { ".....", ".....", ".....", "#####", ".....", ".....", "....." } },
+        { '(', { "...#.", "..#..", ".#...", ".#...", ".#...", "..#..", "...#." } },
+        { ')', { ".#...", "..#..", "...#.", "...#.", "...#.", "..#..", ".#..." } },
+        { '=', { ".....", ".....", "#####", ".....", "#####", ".....", "....." } },
+        // solid cell for the background panel
+        { 127, { "#####", "#####", "#####", "#####", "#####", "#####", "#####" } }
+    };
+
+    // the atlas covers the printable ASCII range plus the solid cell
+    const int g_firstGlyph = 32;
+    const int g_glyphCount = 96;
+    const int g_atlasWidth = g_atlasColumns * g_cellWidth;
+    const int g_atlasHeight = (g_glyphCount / g_atlasColumns) * g_cellHeight;
+
+    // alpha bitmap of the atlas, built on first use and shared by all HUDs
+    const std::vector< unsigned char >& atlasBitmap() {
+        static std::vector< unsigned char > bitmap;
+        if (bitmap.empty()) {
+            bitmap.assign(g_atlasWidth * g_atlasHeight, 0);
+            for (std::size_t i = 0; i < sizeof(g_font) / sizeof(g_font[0]); i++) {
+                int index = static_cast< unsigned char >(g_font[i].c) - g_firstGlyph;
+                int x0 = (index % g_atlasColumns) * g_cellWidth + 1;
+                int y0 = (index / g_atlasColumns) * g_cellHeight + 1;
+                // the solid cell is filled including its border, so the panel edges stay sharp
+                bool solid = (g_font[i].c == 127);
+                for (int y = solid ? -1 : 0; y < (solid ? g_glyphHeight + 1 : g_glyphHeight); y++) {
+                    for (int x = solid ? -1 : 0; x < (solid ? g_glyphWidth + 1 : g_glyphWidth); x++) {
+                        bool set = solid || g_font[i].rows[y][x] == '#';
+                        bitmap[(y0 + y) * g_atlasWidth + x0 + x] = set ? 255 : 0;
+                    }
+                }
+            }
+        }
+        return bitmap;
+    }
+
+}
+
+
+PerformanceHud::Statistics::Statistics()
+        : fps(0.0)
+        , renderTime(0.0)
+        , swapTime(0.0)
+        , gpuTime(-1.0)
+        , dataAge(-1.0)
+        , droppedFrames(0)
+        , queueDepth(0)
+{
+}
+
+
+PerformanceHud::PerformanceHud()
+        : m_bVisible(false)
+        , m_intervalStart(-1.0)
+        , m_intervalFrames(0)
+        , m_intervalRender(0.0)
+        , m_intervalSwap(0.0)
+        , m_bTextDirty(true)
+        , m_layoutScale(0.0f)
+        , m_atlas(0)
+{
+}
+
+PerformanceHud::~PerformanceHud() {
+    // GL resources must be released explicitly with release_gl(), the context may be gone here
+}
+
+void PerformanceHud::set_visible(bool visible) {
+    m_bVisible = visible;
+    m_bTextDirty = true;
+}
+
+void PerformanceHud::toggle() {
+    set_visible(!m_bVisible);
+}
+
+void PerformanceHud::record_frame(double time, double renderTime, double swapTime) {
+    if (m_intervalStart < 0.0) {
+        m_intervalStart = time;
+        return;
+    }
+    m_intervalFrames++;
+    m_intervalRender += renderTime;
+    m_intervalSwap += swapTime;
+
+    double elapsed = time - m_intervalStart;
+    if (elapsed < g_refreshInterval)
+        return;
+
+    m_statistics.fps = m_intervalFrames / elapsed;
+    m_statistics.renderTime = m_intervalRender / m_intervalFrames;
+    m_statistics.swapTime = m_intervalSwap / m_intervalFrames;
+    m_intervalStart = time;
+    m_intervalFrames = 0;
+    m_intervalRender = 0.0;
+    m_intervalSwap = 0.0;
+    m_bTextDirty = true;
+}
+
+void PerformanceHud::set_data_statistics(double dataAge, unsigned long long droppedFrames, unsigned int queueDepth) {
+    // shown with the next refresh of the frame timing, so the numbers do not flicker
+    m_statistics.dataAge = dataAge;
+    m_statistics.droppedFrames = droppedFrames;
+    m_statistics.queueDepth = queueDepth;
+}
+
+void PerformanceHud::set_gpu_time(double gpuTime) {
+    m_statistics.gpuTime = gpuTime;
+}
+
+void PerformanceHud::append_quad(float x0, float y0, float x1, float y1, int glyph, const float color[4]) {
+    int index = glyph - g_firstGlyph;
+    float u0 = static_cast< float >((index % g_atlasColumns) * g_cellWidth + 1) / g_atlasWidth;
+    float v0 = static_cast< float >((index / g_atlasColumns) * g_cellHeight + 1) / g_atlasHeight;
+    float u1 = u0 + static_cast< float >(g_glyphWidth) / g_atlasWidth;
+    float v1 = v0 + static_cast< float >(g_glyphHeight) / g_atlasHeight;
+
+    const float corners[6][4] = {
+        { x0, y0, u0, v0 }, { x1, y0, u1, v0 }, { x1, y1, u1, v1 },
+        { x0, y0, u0, v0 }, { x1, y1, u1, v1 }, { x0, y1, u0, v1 }
+    };
+    for (int i = 0; i < 6; i++) {
+        m_vertices.insert(m_vertices.end(), corners[i], corners[i] + 4);
+        m_vertices.insert(m_vertices.end(), color, color + 4);
+    }
+}
+
+void PerformanceHud::append_text(const std::string& text, float x, float y, float scale, const float color[4]) {
+    for (std::string::const_iterator it = text.begin(); it != text.end(); ++it) {
+        int c = std::toupper(static_cast< unsigned char >(*it));
+        if (c > g_firstGlyph && c < g_firstGlyph + g_glyphCount)
+            append_quad(x, y, x + g_glyphWidth * scale, y + g_glyphHeight * scale, c, color);
+        x += (g_glyphWidth + 1) * scale;
+    }
+}
+
+void PerformanceHud::update_text() {
+    static const float white[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    static const float yellow[4] = { 1.0f, 0.85f, 0.2f, 1.0f };
+    static const float panel[4] = { 0.0f, 0.0f, 0.0f, 0.6f };
+
+    char lines[7][64];
+    std::snprintf(lines[0], sizeof(lines[0]), "FPS     %6.1f", m_statistics.fps);
+    std::snprintf(lines[1], sizeof(lines[1]), "RENDER  %6.2f MS", m_statistics.renderTime);
+    if (m_statistics.gpuTime >= 0.0)
+        std::snprintf(lines[2], sizeof(lines[2]), "GPU     %6.2f MS", m_statistics.gpuTime);
+    else
+        std::snprintf(lines[2], sizeof(lines[2]), "GPU          -");
+    std::snprintf(lines[3], sizeof(lines[3]), "SWAP    %6.2f MS", m_statistics.swapTime);
+    if (m_statistics.dataAge >= 0.0)
+        std::snprintf(lines[4], sizeof(lines[4]), "AGE     %6.1f MS", m_statistics.dataAge);
+    else
+        std::snprintf(lines[4], sizeof(lines[4]), "AGE          -");
+    std::snprintf(lines[5], sizeof(lines[5]), "DROPPED %6llu", m_statistics.droppedFrames);
+    std::snprintf(lines[6], sizeof(lines[6]), "QUEUE   %6u", m_statistics.queueDepth);
+
+    float scale = m_layoutScale;
+    float margin = 4.0f * scale;
+    float lineHeight = (g_glyphHeight + 3) * scale;
+    float panelWidth = 17 * (g_glyphWidth + 1) * scale + 2 * margin;
+
+    m_vertices.clear();
+    append_quad(0.0f, 0.0f, panelWidth, 7 * lineHeight + 2 * margin, 127, panel);
+    for (int i = 0; i < 7; i++) {
+        bool warn = (i == 4 && m_statistics.dataAge > g_staleDataAge) || (i == 5 && m_statistics.droppedFrames > 0);
+        append_text(lines[i], margin, margin + i * lineHeight + scale, scale, warn ? yellow : white);
+    }
+    m_bTextDirty = false;
+}
+
+void PerformanceHud::draw(int width, int height) {
+    if (!m_bVisible || width <= 0 || height <= 0)
+        return;
+
+    if (m_atlas == 0) {
+        const std::vector< unsigned char >& bitmap = atlasBitmap();
+        glGenTextures(1, &m_atlas);
+        glBindTexture(GL_TEXTURE_2D, m_atlas);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA8, g_atlasWidth, g_atlasHeight, 0, GL_ALPHA, GL_UNSIGNED_BYTE, &bitmap[0]);
+        LOG4CPP_DEBUG(logger, "Created glyph atlas " << g_atlasWidth << "x" << g_atlasHeight);
+    }
+
+    // integer scaling keeps the pixel font crisp, larger on high resolution framebuffers
+    float scale = static_cast< float >(height >= 1400 ? 3 : (height >= 700 ? 2 : 1));
+    if (scale != m_layoutScale) {
+        m_layoutScale = scale;
+        m_bTextDirty = true;
+    }
+    if (m_bTextDirty)
+        update_text();
+
+    glPushAttrib(GL_ENABLE_BIT | GL_TEXTURE_BIT | GL_COLOR_BUFFER_BIT | GL_VIEWPORT_BIT | GL_CURRENT_BIT);
+    glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+    glViewport(0, 0, width, height);
+    glDisable(GL_LIGHTING);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_CULL_FACE);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glEnable(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, m_atlas);
+    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    glOrtho(0.0, width, height, 0.0, -1.0, 1.0);
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadIdentity();
+
+    // the whole overlay, panel included, is one draw call from client memory
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glVertexPointer(2, GL_FLOAT, 8 * sizeof(float), &m_vertices[0]);
+    glTexCoordPointer(2, GL_FLOAT, 8 * sizeof(float), &m_vertices[2]);
+    glColorPointer(4, GL_FLOAT, 8 * sizeof(float), &m_vertices[4]);
+    glDrawArrays(GL_TRIANGLES, 0, static_cast< GLsizei >(m_vertices.size() / 8));
+
+    glPopMatrix();
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+
+    glPopClientAttrib();
+    glPopAttrib();
+    // the attribute stack restores everything but the array buffer binding
+    GLStateCache::invalidate_current(GLStateCache::STATE_BUFFERS);
+}
+
+void PerformanceHud::release_gl() {
+    if (m_atlas != 0)
+        glDeleteTextures(1, &m_atlas);
+    m_atlas = 0;
+}
@@ -0,0 +1,119 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @ingroup visualization
+ * @file
+ * On-screen performance overlay of a window.
+ *
+ * Shows frame rate, render and swap times, the age of the rendered data,
+ * dropped frames and the depth of the measurement queue. The text is laid
+ * out from a glyph atlas that is built once, refreshed a few times per
+ * second and drawn with a single call.
+ */
+
+#ifndef UBITRACK_UTPERFORMANCEHUD_H
+#define UBITRACK_UTPERFORMANCEHUD_H
+
+#include <string>
+#include <vector>
+
+#include <utVisualization/Config.h>
+#include <utVisualization/utOpenGL.h>
+
+namespace Ubitrack {
+    namespace Visualization {
+
+        class UBITRACK_EXPORT PerformanceHud {
+
+        public:
+
+            struct Statistics {
+                double fps;
+                /** milliseconds, averaged over the refresh interval */
+                double renderTime;
+                double swapTime;
+                /** GPU execution time of the render pass, negative if unknown */
+                double gpuTime;
+                /** age of the newest rendered measurement in milliseconds, negative if unknown */
+                double dataAge;
+                unsigned long long droppedFrames;
+                unsigned int queueDepth;
+
+                Statistics();
+            };
+
+            PerformanceHud();
+            ~PerformanceHud();
+
+            bool visible() const {
+                return m_bVisible;
+            }
+
+            void set_visible(bool visible);
+            void toggle();
+
+            /** feed the timing of a frame, time is a monotonic clock in seconds, durations are in milliseconds */
+            void record_frame(double time, double renderTime, double swapTime);
+
+            /** feed the state of the camera's data, see CameraHandle::dropped_frames() and queue_depth() */
+            void set_data_statistics(double dataAge, unsigned long long droppedFrames, unsigned int queueDepth);
+
+            /** feed the GPU time of the render pass in milliseconds, see RenderTiming */
+            void set_gpu_time(double gpuTime);
+
+            const Statistics& statistics() const {
+                return m_statistics;
+            }
+
+            /** draws the overlay into the top left corner of a framebuffer of the given size, with the window's context current */
+            void draw(int width, int height);
+
+            /** release the GL resources, call with the context current before it is destroyed */
+            void release_gl();
+
+        protected:
+            void update_text();
+            void append_text(const std::string& text, float x, float y, float scale, const float color[4]);
+            void append_quad(float x0, float y0, float x1, float y1, int glyph, const float color[4]);
+
+            bool m_bVisible;
+            Statistics m_statistics;
+
+            // accumulated since the last refresh
+            double m_intervalStart;
+            unsigned int m_intervalFrames;
+            double m_intervalRender;
+            double m_intervalSwap;
+
+            bool m_bTextDirty;
+            float m_layoutScale;
+            /** interleaved x y u v r g b a per vertex, two triangles per glyph */
+            std::vector< float > m_vertices;
+            GLuint m_atlas;
+        };
+
+    }
+}
+
+#endif //UBITRACK_UTPERFORMANCEHUD_H
@@ -0,0 +1,287 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+#include "utPointCloud.h"
+#include "utGLStateCache.h"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <boost/unordered_map.hpp>
+
+#include <log4cpp/Category.hh>
+
+using namespace Ubitrack;
+using namespace Ubitrack::Visualization;
+
+static log4cpp::Category& logger(log4cpp::Category::getInstance("utVisualization.PointCloud"));
+
+// cells per axis of the voxel key, 21 bits each
+static const float g_maxVoxelCells = 2097151.0f;
+
+
+namespace {
+
+    // depth sensors report missing measurements as NaN, infinity or zero depth
+    bool validPoint(const float* p) {
+        if (!std::isfinite(p[0]) || !std::isfinite(p[1]) || !std::isfinite(p[2]))
+            return false;
+        return !(p[0] == 0.0f && p[1] == 0.0f && p[2] == 0.0f);
+    }
+
+}
+
+
+PointCloud::PointCloud(std::size_t pointBudget)
+        : m_bPending(false)
+        , m_pointBudget(pointBudget)
+        , m_minVoxelSize(0.0f)
+        , m_inputPoints(0)
+        , m_outputPoints(0)
+        , m_droppedClouds(0)
+        , m_current(0)
+        , m_drawCount(0)
+        , m_pointSize(1.0f)
+{
+    for (unsigned int i = 0; i < RING_SIZE; i++) {
+        m_buffers[i] = 0;
+        m_bufferCapacity[i] = 0;
+    }
+    m_defaultColor[0] = m_defaultColor[1] = m_defaultColor[2] = m_defaultColor[3] = 255;
+}
+
+PointCloud::~PointCloud() {
+    // GL resources must be released explicitly with release_gl(), the context may be gone here
+}
+
+void PointCloud::reduce(const float* xyz, std::size_t count, const unsigned char* rgb, std::vector< Point >& out) {
+    std::size_t budget;
+    float minVoxel;
+    unsigned char defaultColor[4];
+    {
+        boost::mutex::scoped_lock lock( m_mutex );
+        budget = m_pointBudget;
+        minVoxel = m_minVoxelSize;
+        std::memcpy(defaultColor, m_defaultColor, 4);
+    }
+
+    // bounding box of the valid points
+    float lo[3] = { 0, 0, 0 };
+    float hi[3] = { 0, 0, 0 };
+    std::size_t valid = 0;
+    for (std::size_t i = 0; i < count; i++) {
+        const float* p = xyz + 3 * i;
+        if (!validPoint(p))
+            continue;
+        for (int k = 0; k < 3; k++) {
+            lo[k] = (valid == 0) ? p[k] : std::min(lo[k], p[k]);
+            hi[k] = (valid == 0) ? p[k] : std::max(hi[k], p[k]);
+        }
+        valid++;
+    }
+
+    out.clear();
+    out.reserve(std::min(valid, budget));
+
+    // start with the voxel size that would fit the budget for uniformly filled space and grow until it fits
+    float extent = std::max(hi[0] - lo[0], std::max(hi[1] - lo[1], hi[2] - lo[2]));
+    float voxel = minVoxel;
+    if (valid > budget && budget > 0) {
+        float volume = std::max((hi[0] - lo[0]) * (hi[1] - lo[1]) * (hi[2] - lo[2]), 1e-9f);
+        voxel = std::max(voxel, std::pow(volume / budget, 1.0f / 3.0f));
+    }
+    // flat clouds get a tiny volume estimate, keep every axis within the key range so distant voxels never merge
+    if (voxel > 0.0f)
+        voxel = std::max(voxel, extent / g_maxVoxelCells);
+
+    boost::unordered_map< unsigned long long, std::size_t > grid;
+    while (true) {
+        out.clear();
+        grid.clear();
+        bool useGrid = voxel > 0.0f && extent > 0.0f;
+        for (std::size_t i = 0; i < count; i++) {
+            const float* p = xyz + 3 * i;
+            if (!validPoint(p))
+                continue;
+
+            if (useGrid) {
+                // 21 bits per axis, one representative point per voxel
+                unsigned long long key = 0;
+                for (int k = 0; k < 3; k++) {
+                    unsigned long long c = std::min(static_cast< unsigned long long >((p[k] - lo[k]) / voxel), 0x1FFFFFULL);
+                    key = (key << 21) | c;
+                }
+                if (!grid.insert(std::make_pair(key, out.size())).second)
+                    continue;
+            }
+
+            Point pt;
+            std::memcpy(pt.position, p, 3 * sizeof(float));
+            if (rgb) {
+                std::memcpy(pt.color, rgb + 3 * i, 3);
+                pt.color[3] = 255;
+            } else {
+                std::memcpy(pt.color, defaultColor, 4);
+            }
+            out.push_back(pt);
+        }
+
+        if (budget == 0 || out.size() <= budget || !useGrid)
+            break;
+        voxel *= 1.5f;
+    }
+
+    // without a grid, thin out by stride as a last resort
+    if (budget > 0 && out.size() > budget) {
+        std::size_t stride = (out.size() + budget - 1) / budget;
+        std::size_t n = 0;
+        for (std::size_t i = 0; i < out.size(); i += stride)
+            out[n++] = out[i];
+        out.resize(n);
+    }
+}
+
+void PointCloud::push(const float* xyz, std::size_t count, const unsigned char* rgb) {
+    // the producer only copies, clouds replaced before the next frame are never reduced
+    std::vector< float > points(xyz, xyz + 3 * count);
+    std::vector< unsigned char > colors;
+    if (rgb)
+        colors.assign(rgb, rgb + 3 * count);
+
+    boost::mutex::scoped_lock lock( m_mutex );
+    if (m_bPending)
+        m_droppedClouds++;
+    m_pendingXyz.swap(points);
+    m_pendingRgb.swap(colors);
+    m_bPending = true;
+    m_inputPoints = count;
+}
+
+void PointCloud::draw() {
+    bool upload = false;
+    {
+        boost::mutex::scoped_lock lock( m_mutex );
+        if (m_bPending) {
+            m_xyz.swap(m_pendingXyz);
+            m_rgb.swap(m_pendingRgb);
+            m_bPending = false;
+            upload = true;
+        }
+    }
+
+    if (upload) {
+        std::size_t count = m_xyz.size() / 3;
+        reduce(count > 0 ? &m_xyz[0] : NULL, count, m_rgb.empty() ? NULL : &m_rgb[0], m_upload);
+        {
+            boost::mutex::scoped_lock lock( m_mutex );
+            m_outputPoints = m_upload.size();
+        }
+
+        // write into the next buffer of the ring, the previous one may still be in use by the GPU
+        m_current = (m_current + 1) % RING_SIZE;
+        if (m_buffers[m_current] == 0)
+            glGenBuffers(1, &m_buffers[m_current]);
+        glBindBuffer(GL_ARRAY_BUFFER, m_buffers[m_current]);
+        std::size_t bytes = m_upload.size() * sizeof(Point);
+        if (bytes > m_bufferCapacity[m_current]) {
+            glBufferData(GL_ARRAY_BUFFER, bytes, m_upload.empty() ? NULL : &m_upload[0], GL_STREAM_DRAW);
+            m_bufferCapacity[m_current] = bytes;
+        } else if (bytes > 0) {
+            glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, &m_upload[0]);
+        }
+        m_drawCount = static_cast< GLsizei >(m_upload.size());
+    } else {
+        glBindBuffer(GL_ARRAY_BUFFER, m_buffers[m_current]);
+    }
+
+    if (m_drawCount > 0 && m_buffers[m_current] != 0) {
+        glPushAttrib(GL_LIGHTING_BIT | GL_POINT_BIT);
+        glDisable(GL_LIGHTING);
+        glPointSize(m_pointSize);
+
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glEnableClientState(GL_COLOR_ARRAY);
+        glVertexPointer(3, GL_FLOAT, sizeof(Point), 0);
+        glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(Point), reinterpret_cast< const GLvoid* >(3 * sizeof(float)));
+        glDrawArrays(GL_POINTS, 0, m_drawCount);
+        glDisableClientState(GL_COLOR_ARRAY);
+        glDisableClientState(GL_VERTEX_ARRAY);
+
+        glPopAttrib();
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    GLStateCache::invalidate_current(GLStateCache::STATE_BUFFERS);
+}
+
+void PointCloud::release_gl() {
+    for (unsigned int i = 0; i < RING_SIZE; i++) {
+        if (m_buffers[i] != 0)
+            glDeleteBuffers(1, &m_buffers[i]);
+        m_buffers[i] = 0;
+        m_bufferCapacity[i] = 0;
+    }
+    m_drawCount = 0;
+    GLStateCache::invalidate_current(GLStateCache::STATE_BUFFERS);
+}
+
+void PointCloud::set_point_budget(std::size_t points) {
+    boost::mutex::scoped_lock lock( m_mutex );
+    LOG4CPP_DEBUG(logger, "Point budget set to " << points);
+    m_pointBudget = points;
+}
+
+std::size_t PointCloud::point_budget() {
+    boost::mutex::scoped_lock lock( m_mutex );
+    return m_pointBudget;
+}
+
+void PointCloud::set_min_voxel_size(float size) {
+    boost::mutex::scoped_lock lock( m_mutex );
+    m_minVoxelSize = size;
+}
+
+void PointCloud::set_point_size(float size) {
+    m_pointSize = size;
+}
+
+void PointCloud::set_default_color(unsigned char r, unsigned char g, unsigned char b) {
+    boost::mutex::scoped_lock lock( m_mutex );
+    m_defaultColor[0] = r;
+    m_defaultColor[1] = g;
+    m_defaultColor[2] = b;
+}
+
+std::size_t PointCloud::input_points() {
+    boost::mutex::scoped_lock lock( m_mutex );
+    return m_inputPoints;
+}
+
+std::size_t PointCloud::output_points() {
+    boost::mutex::scoped_lock lock( m_mutex );
+    return m_outputPoints;
+}
+
+unsigned long PointCloud::dropped_clouds() {
+    boost::mutex::scoped_lock lock( m_mutex );
+    return m_droppedClouds;
+}
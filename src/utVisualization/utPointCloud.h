@@ -0,0 +1,122 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @ingroup visualization
+ * @file
+ * Streaming point cloud renderable with a bounded per-frame cost.
+ *
+ * Sensor threads push complete point clouds at any rate, pushing only copies
+ * them and only the newest cloud is kept. The render thread reduces it with a
+ * voxel grid until it fits the point budget of the window and uploads it into
+ * the next buffer of a small VBO ring so uploads never wait for the buffer
+ * that is still being drawn.
+ */
+
+#ifndef UBITRACK_UTPOINTCLOUD_H
+#define UBITRACK_UTPOINTCLOUD_H
+
+#include <vector>
+#include <boost/thread/mutex.hpp>
+
+#include <utVisualization/Config.h>
+#include <utVisualization/utOpenGL.h>
+
+namespace Ubitrack {
+    namespace Visualization {
+
+        class UBITRACK_EXPORT PointCloud {
+
+        public:
+            /** number of vertex buffers the uploads rotate through */
+            static const unsigned int RING_SIZE = 3;
+
+            /** interleaved vertex as uploaded to the GPU */
+            struct Point {
+                float position[3];
+                unsigned char color[4];
+            };
+
+            /** @param pointBudget maximum number of points drawn per frame */
+            PointCloud(std::size_t pointBudget = 250000);
+            ~PointCloud();
+
+            /**
+             * replaces the displayed cloud, may be called from any thread.
+             * @param xyz count * 3 floats
+             * @param rgb count * 3 bytes or NULL to use the default colour
+             */
+            void push(const float* xyz, std::size_t count, const unsigned char* rgb = NULL);
+
+            /** reduces and uploads the newest cloud if there is one and draws it, render thread only */
+            void draw();
+
+            /** release the GL resources, call with the context current before it is destroyed */
+            void release_gl();
+
+            void set_point_budget(std::size_t points);
+            std::size_t point_budget();
+
+            /** edge length of the smallest voxel used for level of detail, 0 disables the minimum */
+            void set_min_voxel_size(float size);
+
+            void set_point_size(float size);
+            void set_default_color(unsigned char r, unsigned char g, unsigned char b);
+
+            /** number of points of the last pushed cloud, and of the last drawn cloud after level of detail reduction */
+            std::size_t input_points();
+            std::size_t output_points();
+
+            /** number of pushed clouds that were replaced before they were drawn */
+            unsigned long dropped_clouds();
+
+        protected:
+
+            void reduce(const float* xyz, std::size_t count, const unsigned char* rgb, std::vector< Point >& out);
+
+            boost::mutex m_mutex;
+            std::vector< float > m_pendingXyz;
+            std::vector< unsigned char > m_pendingRgb;
+            bool m_bPending;
+            std::size_t m_pointBudget;
+            float m_minVoxelSize;
+            unsigned char m_defaultColor[4];
+            std::size_t m_inputPoints;
+            std::size_t m_outputPoints;
+            unsigned long m_droppedClouds;
+
+            // render thread state
+            std::vector< float > m_xyz;
+            std::vector< unsigned char > m_rgb;
+            std::vector< Point > m_upload;
+            GLuint m_buffers[RING_SIZE];
+            std::size_t m_bufferCapacity[RING_SIZE];
+            unsigned int m_current;
+            GLsizei m_drawCount;
+            float m_pointSize;
+        };
+
+    }
+}
+
+#endif //UBITRACK_UTPOINTCLOUD_H
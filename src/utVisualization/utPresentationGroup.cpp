@@ -0,0 +1,99 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+#include "utPresentationGroup.h"
+#include "utRenderAPI.h"
+
+#include <algorithm>
+
+#include <log4cpp/Category.hh>
+
+using namespace Ubitrack;
+using namespace Ubitrack::Visualization;
+
+static log4cpp::Category& logger(log4cpp::Category::getInstance("utVisualization.PresentationGroup"));
+
+
+PresentationGroup::PresentationGroup(const std::string& name)
+        : m_name(name)
+        , m_lastSkew(0.0)
+        , m_maxSkew(0.0)
+        , m_sumSkew(0.0)
+        , m_frames(0)
+{
+}
+
+unsigned long long PresentationGroup::latch(const std::vector< boost::shared_ptr< CameraHandle > >& members) {
+    // the oldest of the newest measurements is available to every member
+    unsigned long long timestamp = 0;
+    for (std::vector< boost::shared_ptr< CameraHandle > >::const_iterator it = members.begin(); it != members.end(); ++it) {
+        unsigned long long latest = (*it)->latest_timestamp();
+        if (latest != 0 && (timestamp == 0 || latest < timestamp))
+            timestamp = latest;
+    }
+    for (std::vector< boost::shared_ptr< CameraHandle > >::const_iterator it = members.begin(); it != members.end(); ++it) {
+        (*it)->set_render_timestamp(timestamp);
+    }
+    return timestamp;
+}
+
+void PresentationGroup::record_swaps(const std::vector< double >& swapTimes) {
+    if (swapTimes.size() < 2)
+        return;
+    double skew = (*std::max_element(swapTimes.begin(), swapTimes.end()) - *std::min_element(swapTimes.begin(), swapTimes.end())) * 1000.0;
+
+    boost::mutex::scoped_lock lock( m_mutex );
+    m_lastSkew = skew;
+    m_maxSkew = std::max(m_maxSkew, skew);
+    m_sumSkew += skew;
+    m_frames++;
+    LOG4CPP_TRACE(logger, "Presentation group " << m_name << " swap skew: " << skew << " ms");
+}
+
+double PresentationGroup::last_skew() {
+    boost::mutex::scoped_lock lock( m_mutex );
+    return m_lastSkew;
+}
+
+double PresentationGroup::max_skew() {
+    boost::mutex::scoped_lock lock( m_mutex );
+    return m_maxSkew;
+}
+
+double PresentationGroup::mean_skew() {
+    boost::mutex::scoped_lock lock( m_mutex );
+    return m_frames > 0 ? m_sumSkew / m_frames : 0.0;
+}
+
+unsigned long PresentationGroup::frames() {
+    boost::mutex::scoped_lock lock( m_mutex );
+    return m_frames;
+}
+
+void PresentationGroup::reset_statistics() {
+    boost::mutex::scoped_lock lock( m_mutex );
+    m_lastSkew = 0.0;
+    m_maxSkew = 0.0;
+    m_sumSkew = 0.0;
+    m_frames = 0;
+}
@@ -0,0 +1,87 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @ingroup visualization
+ * @file
+ * Synchronized presentation of several windows, e.g. the eyes of a stereo HMD
+ * or the projectors of a display wall.
+ *
+ * All cameras of a group render data of the same latched measurement time and
+ * their buffers are swapped back to back. The group records the skew between
+ * the first and the last swap of every frame.
+ */
+
+#ifndef UBITRACK_UTPRESENTATIONGROUP_H
+#define UBITRACK_UTPRESENTATIONGROUP_H
+
+#include <string>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <utVisualization/Config.h>
+
+namespace Ubitrack {
+    namespace Visualization {
+
+        class CameraHandle;
+
+        class UBITRACK_EXPORT PresentationGroup {
+
+        public:
+            PresentationGroup(const std::string& name);
+
+            const std::string& name() const {
+                return m_name;
+            }
+
+            /**
+             * determine the newest measurement time every member can render and hand it to all members.
+             * Returns 0 if no member reports measurement times.
+             */
+            unsigned long long latch(const std::vector< boost::shared_ptr< CameraHandle > >& members);
+
+            /** record the completion times (in seconds) of the buffer swaps of one frame */
+            void record_swaps(const std::vector< double >& swapTimes);
+
+            /** skew between first and last swap in milliseconds */
+            double last_skew();
+            double max_skew();
+            double mean_skew();
+            unsigned long frames();
+            void reset_statistics();
+
+        protected:
+            std::string m_name;
+            double m_lastSkew;
+            double m_maxSkew;
+            double m_sumSkew;
+            unsigned long m_frames;
+            boost::mutex m_mutex;
+        };
+
+    }
+}
+
+#endif //UBITRACK_UTPRESENTATIONGROUP_H
@@ -0,0 +1,320 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+#include "utRemoteCamera.h"
+#include "utGLStateCache.h"
+
+#include <cstring>
+
+#include <log4cpp/Category.hh>
+
+using namespace Ubitrack;
+using namespace Ubitrack::Visualization;
+
+static log4cpp::Category& logger(log4cpp::Category::getInstance("utVisualization.RemoteCamera"));
+
+// frames buffered in a ring, the reader always takes the newest
+static const unsigned int g_ringSlots = 4;
+
+
+namespace {
+
+    bool pixelFormat(unsigned int channels, GLenum& internalFormat, GLenum& format) {
+        switch (channels) {
+            case 1:
+                internalFormat = GL_LUMINANCE8;
+                format = GL_LUMINANCE;
+                return true;
+            case 3:
+                internalFormat = GL_RGB8;
+                format = GL_BGR;
+                return true;
+            case 4:
+                internalFormat = GL_RGBA8;
+                format = GL_BGRA;
+                return true;
+            default:
+                return false;
+        }
+    }
+
+}
+
+
+RemoteCameraHandle::RemoteCameraHandle(std::string& _name, int _width, int _height, std::size_t maxImageBytes)
+        : CameraHandle(_name, _width, _height, NULL)
+        , m_maxImageBytes(maxImageBytes > 0 ? maxImageBytes : static_cast< std::size_t >(_width) * _height * 4)
+{
+}
+
+RemoteCameraHandle::~RemoteCameraHandle() {
+}
+
+bool RemoteCameraHandle::setup(boost::shared_ptr<VirtualWindow>& /*window*/) {
+    boost::mutex::scoped_lock lock( m_mutex );
+    if (!m_pRegistry)
+        m_pRegistry = SharedFrameRegistry::open(true);
+    if (!m_pRegistry)
+        return false;
+
+    std::string name = m_pRegistry->unique_ring_name(m_sWindowName);
+    m_pRing = SharedFrameRing::create(name, g_ringSlots, m_maxImageBytes);
+    if (!m_pRing)
+        return false;
+    if (!m_pRegistry->add(name, m_sWindowName, m_initial_width, m_initial_height)) {
+        m_pRing.reset();
+        return false;
+    }
+    m_bSetupNeeded = false;
+    LOG4CPP_INFO(logger, "Camera " << m_sWindowName << " publishes to the render server through " << name);
+    return true;
+}
+
+void RemoteCameraHandle::teardown() {
+    boost::mutex::scoped_lock lock( m_mutex );
+    if (m_pRing && m_pRegistry)
+        m_pRegistry->remove(m_pRing->name());
+    // the ring is removed when the last reference goes, the server keeps its mapping until it notices
+    m_pRing.reset();
+}
+
+void RemoteCameraHandle::set_projection(const float projection[16]) {
+    boost::mutex::scoped_lock lock( m_mutex );
+    std::memcpy(m_frame.projection, projection, sizeof(m_frame.projection));
+    m_frame.hasProjection = 1;
+}
+
+void RemoteCameraHandle::set_poses(const float poses[][16], unsigned int count) {
+    boost::mutex::scoped_lock lock( m_mutex );
+    if (count > SharedFrameRing::MAX_POSES) {
+        LOG4CPP_WARN(logger, "Camera " << m_sWindowName << " publishes only " << SharedFrameRing::MAX_POSES << " of " << count << " poses");
+        count = SharedFrameRing::MAX_POSES;
+    }
+    std::memcpy(m_frame.poses, poses, count * sizeof(m_frame.poses[0]));
+    m_frame.poseCount = count;
+}
+
+bool RemoteCameraHandle::publish(unsigned long long timestamp) {
+    boost::mutex::scoped_lock lock( m_mutex );
+    m_frame.width = 0;
+    m_frame.height = 0;
+    m_frame.channels = 0;
+    return publish_frame(timestamp, NULL);
+}
+
+bool RemoteCameraHandle::publish_image(unsigned long long timestamp, int width, int height, int channels, const void* pixels) {
+    boost::mutex::scoped_lock lock( m_mutex );
+    m_frame.width = width;
+    m_frame.height = height;
+    m_frame.channels = channels;
+    return publish_frame(timestamp, pixels);
+}
+
+bool RemoteCameraHandle::publish_frame(unsigned long long timestamp, const void* pixels) {
+    // frames before setup or without a server are dropped, tracking goes on regardless
+    if (!m_pRing)
+        return false;
+    m_frame.timestamp = timestamp;
+    if (!m_pRing->publish(m_frame, pixels))
+        return false;
+    RenderManager::singleton().notify_camera_ready(m_iCameraId);
+    return true;
+}
+
+unsigned long long RemoteCameraHandle::latest_timestamp() {
+    boost::mutex::scoped_lock lock( m_mutex );
+    return m_frame.timestamp;
+}
+
+
+SharedFrameCamera::SharedFrameCamera(std::string& _name, int _width, int _height, const std::string& ring, unsigned int generation)
+        : CameraHandle(_name, _width, _height, NULL)
+        , m_sRing(ring)
+        , m_iGeneration(generation)
+        , m_lastFrame(0)
+        , m_droppedFrames(0)
+        , m_bImageDirty(false)
+        , m_imageWidth(0)
+        , m_imageHeight(0)
+        , m_imageChannels(0)
+        , m_axisLength(0.1f)
+        , m_viewportWidth(0)
+        , m_viewportHeight(0)
+{
+}
+
+SharedFrameCamera::~SharedFrameCamera() {
+}
+
+void SharedFrameCamera::teardown() {
+    // the pool deletes the texture once a context of the share group is current again
+    m_pTexture.reset();
+    m_pRing.reset();
+    CameraHandle::teardown();
+}
+
+void SharedFrameCamera::set_axis_length(float length) {
+    m_axisLength = length;
+}
+
+void SharedFrameCamera::on_window_size(int w, int h) {
+    CameraHandle::on_window_size(w, h);
+    // the resize callback may run while the context of another window is current
+    m_viewportWidth = w;
+    m_viewportHeight = h;
+}
+
+void SharedFrameCamera::render(int /*ellapsed_time*/) {
+    if (!m_pRing) {
+        m_pRing = SharedFrameRing::open(m_sRing);
+        m_lastFrame = 0;
+    }
+    if (m_pRing) {
+        unsigned long long frameNumber = m_pRing->read_latest(m_frame, m_readBuffer, m_lastFrame);
+        if (frameNumber > 0) {
+            if (m_lastFrame > 0)
+                m_droppedFrames += frameNumber - m_lastFrame - 1;
+            m_lastFrame = frameNumber;
+            if (m_frame.width > 0) {
+                m_pixels.swap(m_readBuffer);
+                m_imageWidth = m_frame.width;
+                m_imageHeight = m_frame.height;
+                m_imageChannels = m_frame.channels;
+                m_bImageDirty = true;
+            }
+        }
+    }
+
+    if (m_viewportWidth > 0 && m_viewportHeight > 0) {
+        glViewport(0, 0, m_viewportWidth, m_viewportHeight);
+        GLStateCache::invalidate_current(GLStateCache::STATE_VIEWPORT);
+    }
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    upload_image();
+    draw_background();
+    draw_poses();
+}
+
+void SharedFrameCamera::upload_image() {
+    if (!m_bImageDirty || !m_pVirtualWindow)
+        return;
+    m_bImageDirty = false;
+
+    GLenum internalFormat, format;
+    if (!pixelFormat(m_imageChannels, internalFormat, format)) {
+        LOG4CPP_WARN(logger, "Camera " << m_sWindowName << " received an image with " << m_imageChannels << " channels");
+        return;
+    }
+    if (!m_pTexture || m_pTexture->width() != m_imageWidth || m_pTexture->height() != m_imageHeight ||
+        m_pTexture->internal_format() != internalFormat) {
+        m_pTexture = ResourcePool::singleton().acquire_texture(m_pVirtualWindow->share_group(), internalFormat,
+            m_imageWidth, m_imageHeight, m_sWindowName);
+    }
+    if (!m_pTexture)
+        return;
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glBindTexture(GL_TEXTURE_2D, m_pTexture->id());
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, m_imageWidth, m_imageHeight, format, GL_UNSIGNED_BYTE, &m_pixels[0]);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    GLStateCache::invalidate_current(GLStateCache::STATE_TEXTURES);
+}
+
+void SharedFrameCamera::draw_background() {
+    if (!m_pTexture)
+        return;
+
+    glPushAttrib(GL_ENABLE_BIT | GL_DEPTH_BUFFER_BIT);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_LIGHTING);
+    glDepthMask(GL_FALSE);
+    glEnable(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, m_pTexture->id());
+    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadIdentity();
+
+    // images are stored top row first
+    glBegin(GL_QUADS);
+    glTexCoord2f(0, 1); glVertex2f(-1, -1);
+    glTexCoord2f(1, 1); glVertex2f(1, -1);
+    glTexCoord2f(1, 0); glVertex2f(1, 1);
+    glTexCoord2f(0, 0); glVertex2f(-1, 1);
+    glEnd();
+
+    glPopMatrix();
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glPopAttrib();
+    GLStateCache::invalidate_current(GLStateCache::STATE_TEXTURES);
+}
+
+void SharedFrameCamera::draw_poses() {
+    if (!m_frame.hasProjection || m_frame.poseCount == 0)
+        return;
+
+    glPushAttrib(GL_ENABLE_BIT | GL_LINE_BIT);
+    glDisable(GL_LIGHTING);
+    glDisable(GL_TEXTURE_2D);
+    glEnable(GL_DEPTH_TEST);
+    glLineWidth(2.0f);
+
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadMatrixf(m_frame.projection);
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+
+    for (unsigned int i = 0; i < m_frame.poseCount; i++) {
+        glLoadMatrixf(m_frame.poses[i]);
+        glBegin(GL_LINES);
+        glColor3f(1, 0, 0); glVertex3f(0, 0, 0); glVertex3f(m_axisLength, 0, 0);
+        glColor3f(0, 1, 0); glVertex3f(0, 0, 0); glVertex3f(0, m_axisLength, 0);
+        glColor3f(0, 0, 1); glVertex3f(0, 0, 0); glVertex3f(0, 0, m_axisLength);
+        glEnd();
+    }
+    glColor3f(1, 1, 1);
+
+    glPopMatrix();
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+    glPopAttrib();
+}
+
+unsigned long long SharedFrameCamera::latest_timestamp() {
+    return m_frame.timestamp;
+}
+
+unsigned long long SharedFrameCamera::dropped_frames() {
+    return m_droppedFrames;
+}
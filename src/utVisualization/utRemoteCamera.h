@@ -0,0 +1,145 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @ingroup visualization
+ * @file
+ * Camera handles of the split mode, where the dataflow and the windows run in separate processes.
+ *
+ * In the dataflow process a RemoteCameraHandle stands in for the camera and
+ * publishes its images and poses into a SharedFrameRing; it never opens a
+ * window or touches GL, so tracking threads never wait on the GPU. The render
+ * server creates a SharedFrameCamera for every ring in the SharedFrameRegistry
+ * and draws the newest frame into its window.
+ */
+
+#ifndef UBITRACK_UTREMOTECAMERA_H
+#define UBITRACK_UTREMOTECAMERA_H
+
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <utVisualization/Config.h>
+#include <utVisualization/utRenderAPI.h>
+#include <utVisualization/utResourcePool.h>
+#include <utVisualization/utSharedFrameRing.h>
+
+namespace Ubitrack {
+    namespace Visualization {
+
+        class UBITRACK_EXPORT RemoteCameraHandle : public CameraHandle {
+
+        public:
+            /** maxImageBytes bounds the images published, 0 for RGBA images of the initial size */
+            RemoteCameraHandle(std::string& _name, int _width, int _height, std::size_t maxImageBytes = 0);
+            ~RemoteCameraHandle();
+
+            /** creates and announces the ring, the window is not used and may be empty */
+            virtual bool setup(boost::shared_ptr<VirtualWindow>& window);
+            virtual void teardown();
+
+            /** state sent with every following frame, may be called from any thread */
+            void set_projection(const float projection[16]);
+            void set_poses(const float poses[][16], unsigned int count);
+
+            /** publish the current poses, keeping the last image */
+            bool publish(unsigned long long timestamp);
+
+            /** publish a tightly packed 8 bit image with the current poses */
+            bool publish_image(unsigned long long timestamp, int width, int height, int channels, const void* pixels);
+
+            virtual unsigned long long latest_timestamp();
+
+        protected:
+            bool publish_frame(unsigned long long timestamp, const void* pixels);
+
+            std::size_t m_maxImageBytes;
+            boost::mutex m_mutex;
+            boost::shared_ptr< SharedFrameRing > m_pRing;
+            boost::shared_ptr< SharedFrameRegistry > m_pRegistry;
+            SharedFrameRing::Frame m_frame;
+        };
+
+
+        class UBITRACK_EXPORT SharedFrameCamera : public CameraHandle {
+
+        public:
+            SharedFrameCamera(std::string& _name, int _width, int _height, const std::string& ring, unsigned int generation);
+            ~SharedFrameCamera();
+
+            virtual void teardown();
+
+            /** draws the newest frame: image as background, poses as coordinate axes */
+            virtual void render(int ellapsed_time);
+            virtual void on_window_size(int w, int h);
+
+            /** length of the drawn axes in the units of the poses */
+            void set_axis_length(float length);
+
+            const std::string& ring_name() const {
+                return m_sRing;
+            }
+
+            /** registry generation of the ring this camera reads, see SharedFrameRegistry::Entry */
+            unsigned int generation() const {
+                return m_iGeneration;
+            }
+
+            virtual unsigned long long latest_timestamp();
+
+            /** frames published while the server was busy with earlier ones */
+            virtual unsigned long long dropped_frames();
+
+        protected:
+            void upload_image();
+            void draw_background();
+            void draw_poses();
+
+            std::string m_sRing;
+            unsigned int m_iGeneration;
+            boost::shared_ptr< SharedFrameRing > m_pRing;
+
+            SharedFrameRing::Frame m_frame;
+            std::vector< unsigned char > m_pixels;
+            std::vector< unsigned char > m_readBuffer;
+            unsigned long long m_lastFrame;
+            unsigned long long m_droppedFrames;
+            bool m_bImageDirty;
+
+            // layout of the image in m_pixels and the texture
+            int m_imageWidth;
+            int m_imageHeight;
+            unsigned int m_imageChannels;
+            boost::shared_ptr< PooledResource > m_pTexture;
+            float m_axisLength;
+
+            // window size of the last resize event, applied by render() where the context is current
+            int m_viewportWidth;
+            int m_viewportHeight;
+        };
+
+    }
+}
+
+#endif //UBITRACK_UTREMOTECAMERA_H
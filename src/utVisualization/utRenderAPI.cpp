@@ -1,10 +1,19 @@
 #include "utRenderAPI.h"
+#include "utEmbeddedWindow.h"
+#include "utAdaptiveResolution.h"
+#include "utGLStateCache.h"
+#include "utPerformanceHud.h"
+#include "utPresentationGroup.h"
+#include "utRenderTiming.h"
 
 #include <boost/thread.hpp>
 #include <boost/bind.hpp>
 #include <boost/scoped_ptr.hpp>
 #include <boost/interprocess/sync/scoped_lock.hpp>
 #include <boost/function.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <algorithm>
 
 #include <log4cpp/Category.hh>
 #include <utVision/OpenCLManager.h>
@@ -18,16 +27,49 @@ log4cpp::Category& logger(log4cpp::Category::getInstance("utVisualization.Render
 static boost::scoped_ptr< RenderManager > g_pRenderManager;
 static int g_RefRenderManager = 0;
 
+// default retry delays of failed camera setups in milliseconds
+static const unsigned int g_defaultSetupInitialDelay = 100;
+static const unsigned int g_defaultSetupMaxDelay = 5000;
+
 
 
 VirtualWindow::VirtualWindow(int _width, int _height, const std::string &_title)
-        : m_width(_width), m_height(_height), m_title(_title) {
+        : m_width(_width), m_height(_height), m_title(_title)
+        , m_adaptiveResolution(new AdaptiveResolution())
+        , m_stateCache(new GLStateCache())
+        , m_performanceHud(new PerformanceHud())
+        , m_renderTiming(new RenderTiming())
+{
 }
 
 VirtualWindow::~VirtualWindow() {
 
 }
 
+AdaptiveResolution& VirtualWindow::adaptive_resolution() {
+    return *m_adaptiveResolution;
+}
+
+int VirtualWindow::render_width() {
+    return (m_adaptiveResolution->enabled() && m_adaptiveResolution->render_width() > 0) ? m_adaptiveResolution->render_width() : m_width;
+}
+
+int VirtualWindow::render_height() {
+    return (m_adaptiveResolution->enabled() && m_adaptiveResolution->render_height() > 0) ? m_adaptiveResolution->render_height() : m_height;
+}
+
+GLStateCache& VirtualWindow::state_cache() {
+    return *m_stateCache;
+}
+
+PerformanceHud& VirtualWindow::performance_hud() {
+    return *m_performanceHud;
+}
+
+RenderTiming& VirtualWindow::render_timing() {
+    return *m_renderTiming;
+}
+
 bool VirtualWindow::is_valid() {
     return false;
 }
@@ -45,6 +87,11 @@ void VirtualWindow::initGL(boost::shared_ptr<CameraHandle>& cam) {
 }
 
 void VirtualWindow::reshape(int w, int h) {
+    m_width = w;
+    m_height = h;
+}
+
+void VirtualWindow::release_handler() {
 }
 
 void VirtualWindow::setFullscreen(bool fullscreen) {
@@ -53,6 +100,20 @@ void VirtualWindow::setFullscreen(bool fullscreen) {
 void VirtualWindow::onExit() {
 }
 
+void* VirtualWindow::share_group() {
+    // by default every window has its own context
+    return this;
+}
+
+CameraHandle::SetupStatistics::SetupStatistics()
+        : attempts(0)
+        , failures(0)
+        , latency(-1.0)
+        , lastAttemptTime(0.0)
+        , retryDelay(0.0)
+{
+}
+
 CameraHandle::CameraHandle(std::string &_name, int _width, int _height, Drivers::VirtualCamera* _handle)
         : m_sWindowName(_name)
         , m_initial_width(_width)
@@ -61,6 +122,8 @@ CameraHandle::CameraHandle(std::string &_name, int _width, int _height, Drivers:
 		, m_bIsFullScreen(false)
         , m_pVirtualWindow()
         , m_pVirtualCamera(_handle)
+        , m_renderTimestamp(0)
+        , m_iCameraId(0)
 {
 
 }
@@ -95,6 +158,13 @@ bool CameraHandle::setup(boost::shared_ptr<VirtualWindow>& window) {
     return false;
 }
 
+boost::shared_ptr<VirtualWindow> CameraHandle::detach_window() {
+    boost::shared_ptr<VirtualWindow> window = m_pVirtualWindow;
+    m_pVirtualWindow.reset();
+    m_bSetupNeeded = true;
+    return window;
+}
+
 void CameraHandle::teardown() {
 	LOG4CPP_DEBUG(logger, "CameraHandle teardown.");
     if (m_pVirtualWindow) {
@@ -106,6 +176,36 @@ void CameraHandle::render(int ellapsed_time) {
     // extend in subclass
 }
 
+bool CameraHandle::render_to_target(const RenderTarget& target, int ellapsed_time) {
+    boost::shared_ptr<EmbeddedWindow> embedded = boost::dynamic_pointer_cast<EmbeddedWindow>(m_pVirtualWindow);
+    if (!embedded) {
+        if (m_pVirtualWindow) {
+            LOG4CPP_ERROR(logger, "Camera " << m_sWindowName << " already renders into a window.");
+            return false;
+        }
+        embedded.reset(new EmbeddedWindow(target.width, target.height, m_sWindowName,
+            RenderManager::singleton().getSharedOpenGLContext()));
+        boost::shared_ptr<VirtualWindow> window(embedded);
+        if (!setup(window)) {
+            m_pVirtualWindow.reset();
+            return false;
+        }
+        m_bSetupNeeded = false;
+        // the host has set the camera up, the render loop must not create a window for it as well
+        RenderManager::singleton().setup_remove(m_iCameraId);
+        on_window_size(target.width, target.height);
+    }
+    else if (target.width != embedded->width() || target.height != embedded->height()) {
+        on_window_size(target.width, target.height);
+    }
+    if (!embedded->bind(target)) {
+        return false;
+    }
+    render(ellapsed_time);
+    embedded->unbind();
+    return true;
+}
+
 
 
 void CameraHandle::on_window_size(int w, int h) {
@@ -120,7 +220,12 @@ void CameraHandle::on_window_close() {
 }
 
 int CameraHandle::on_keypress(int key, int scancode, int action, int mods) {
-	// event is not handled by default;
+	// GLFW_PRESS, GLFW_MOD_ALT and GLFW_KEY_H, the library itself does not depend on GLFW
+	if ((action == 1) && (mods & 0x0004) && (key == 'H')) {
+		on_toggle_hud();
+		return 1;
+	}
+	// other events are not handled by default;
 	return 0;
 }
 
@@ -154,13 +259,56 @@ void CameraHandle::on_exit() {
 	}
 }
 
+void CameraHandle::on_toggle_hud() {
+	if (m_pVirtualWindow) {
+		m_pVirtualWindow->performance_hud().toggle();
+	}
+}
+
 void CameraHandle::post_redraw() {
+    // only hosts that asked for it are notified, windows of the render loop do not need a wake-up
+    RenderManager::singleton().notify_camera_callback(m_iCameraId);
+}
+
+void CameraHandle::set_camera_id(unsigned int cam_id) {
+    m_iCameraId = cam_id;
 }
 
 void CameraHandle::keyboard(unsigned char key, int x, int y) {
     // extend in subclass
 }
 
+void CameraHandle::set_presentation_group(const std::string& group) {
+    m_sPresentationGroup = group;
+}
+
+const std::string& CameraHandle::presentation_group() {
+    return m_sPresentationGroup;
+}
+
+unsigned long long CameraHandle::latest_timestamp() {
+    // extend in subclass
+    return 0;
+}
+
+void CameraHandle::set_render_timestamp(unsigned long long timestamp) {
+    m_renderTimestamp = timestamp;
+}
+
+unsigned long long CameraHandle::render_timestamp() {
+    return m_renderTimestamp;
+}
+
+unsigned long long CameraHandle::dropped_frames() {
+    // extend in subclass
+    return 0;
+}
+
+unsigned int CameraHandle::queue_depth() {
+    // extend in subclass
+    return 0;
+}
+
 
 
 RenderManager& RenderManager::singleton()
@@ -180,7 +328,11 @@ RenderManager& RenderManager::singleton()
 
 RenderManager::RenderManager()
         : m_iCameraCount(0)
+        , m_iNextCameraId(0)
+        , m_iSetupInitialDelay(g_defaultSetupInitialDelay)
+        , m_iSetupMaxDelay(g_defaultSetupMaxDelay)
 		, m_sharedOpenGLContext(NULL)
+        , m_bSplitMode(false)
 {
 }
 
@@ -196,44 +348,183 @@ void* RenderManager::getSharedOpenGLContext() {
 	return m_sharedOpenGLContext;
 }
 
+void RenderManager::set_split_mode(bool split) {
+    m_bSplitMode = split;
+}
+
+bool RenderManager::split_mode() {
+    return m_bSplitMode;
+}
+
 void RenderManager::setup() {
     // anything to do here ... most setup should be done in the client
 
 }
 
 bool RenderManager::need_setup() {
-    return (m_mCamerasNeedSetup.size() > 0);
+    // cameras may register from the dataflow loading thread
+    boost::mutex::scoped_lock lock( m_mutex );
+    boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+    for (std::deque< boost::shared_ptr<CameraHandle> >::iterator it = m_mCamerasNeedSetup.begin(); it != m_mCamerasNeedSetup.end(); ++it) {
+        if ((*it)->m_nextSetupAttempt <= now)
+            return true;
+    }
+    return false;
 }
 
+unsigned int RenderManager::pending_setup_count() {
+    boost::mutex::scoped_lock lock( m_mutex );
+    return static_cast< unsigned int >(m_mCamerasNeedSetup.size());
+}
 
 bool RenderManager::any_windows_valid() {
     boost::mutex::scoped_lock lock( m_mutex );
     bool awv = false;
     for (CameraHandleMap::iterator it=m_mRegisteredCameras.begin(); it != m_mRegisteredCameras.end(); ++it) {
-        awv |= it->second->get_window()->is_valid();
+        if (it->second->get_window()) {
+            awv |= it->second->get_window()->is_valid();
+        }
     }
     return awv;
 }
 
+bool RenderManager::setup_pending(unsigned int cam_id) {
+    boost::mutex::scoped_lock lock( m_mutex );
+    for (std::deque< boost::shared_ptr<CameraHandle> >::iterator it = m_mCamerasNeedSetup.begin(); it != m_mCamerasNeedSetup.end(); ++it) {
+        if ((*it)->camera_id() == cam_id)
+            return true;
+    }
+    return false;
+}
+
+void RenderManager::setup_remove(unsigned int cam_id) {
+    boost::mutex::scoped_lock lock( m_mutex );
+    remove_from_setup(cam_id);
+}
+
+void RenderManager::remove_from_setup(unsigned int cam_id) {
+    for (std::deque< boost::shared_ptr<CameraHandle> >::iterator it = m_mCamerasNeedSetup.begin(); it != m_mCamerasNeedSetup.end(); ) {
+        if ((*it)->camera_id() == cam_id)
+            it = m_mCamerasNeedSetup.erase(it);
+        else
+            ++it;
+    }
+}
+
 boost::shared_ptr<CameraHandle> RenderManager::setup_pop_front() {
     boost::mutex::scoped_lock lock( m_mutex );
     boost::shared_ptr<CameraHandle> cam;
-    if (m_mCamerasNeedSetup.size() > 0) {
-        cam = m_mCamerasNeedSetup.front();
-        m_mCamerasNeedSetup.pop_front();
+    boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+    for (std::deque< boost::shared_ptr<CameraHandle> >::iterator it = m_mCamerasNeedSetup.begin(); it != m_mCamerasNeedSetup.end(); ++it) {
+        if ((*it)->m_nextSetupAttempt <= now) {
+            cam = *it;
+            m_mCamerasNeedSetup.erase(it);
+            break;
+        }
     }
     return cam;
 }
 
 void RenderManager::setup_push_back(boost::shared_ptr<CameraHandle>& handle) {
     boost::mutex::scoped_lock lock( m_mutex );
+    handle->m_nextSetupAttempt = boost::posix_time::microsec_clock::universal_time();
+    if (handle->m_setupQueued.is_not_a_date_time())
+        handle->m_setupQueued = handle->m_nextSetupAttempt;
     m_mCamerasNeedSetup.push_back(handle);
 }
 
+unsigned int RenderManager::process_setup(SetupFunction setupFunction, unsigned int maxSetups) {
+    unsigned int succeeded = 0;
+    // each camera is tried at most once per call, a failed one is not due again before its delay has passed
+    boost::shared_ptr<CameraHandle> cam;
+    while ((maxSetups == 0 || succeeded < maxSetups) && (cam = setup_pop_front())) {
+        CameraHandle::SetupStatistics& stats = cam->m_setupStatistics;
+        boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+        bool ok = setupFunction(cam);
+        boost::posix_time::ptime end = boost::posix_time::microsec_clock::universal_time();
+
+        boost::mutex::scoped_lock lock( m_mutex );
+        stats.attempts++;
+        stats.lastAttemptTime = (end - start).total_microseconds() * 1e-3;
+        if (ok) {
+            stats.latency = (end - cam->m_setupQueued).total_microseconds() * 1e-3;
+            stats.retryDelay = 0.0;
+            succeeded++;
+            LOG4CPP_INFO(logger, "Camera " << cam->title() << " set up after " << stats.latency << " ms, "
+                << stats.attempts << " attempt(s)");
+            continue;
+        }
+
+        stats.failures++;
+        stats.retryDelay = (stats.retryDelay <= 0.0) ? m_iSetupInitialDelay : std::min(stats.retryDelay * 2.0, static_cast< double >(m_iSetupMaxDelay));
+        cam->m_nextSetupAttempt = end + boost::posix_time::milliseconds(static_cast< long >(stats.retryDelay));
+        // the camera may have unregistered while its setup ran
+        if (m_mRegisteredCameras.find(cam->camera_id()) == m_mRegisteredCameras.end())
+            continue;
+        m_mCamerasNeedSetup.push_back(cam);
+        LOG4CPP_WARN(logger, "Setup of camera " << cam->title() << " failed (" << stats.failures << " failure(s)), retrying in "
+            << stats.retryDelay << " ms");
+    }
+    return succeeded;
+}
+
+void RenderManager::set_setup_backoff(unsigned int initialDelay, unsigned int maxDelay) {
+    boost::mutex::scoped_lock lock( m_mutex );
+    m_iSetupInitialDelay = std::max(1u, initialDelay);
+    m_iSetupMaxDelay = std::max(m_iSetupInitialDelay, maxDelay);
+}
+
 void RenderManager::teardown() {
     for (CameraHandleMap::iterator it=m_mRegisteredCameras.begin(); it != m_mRegisteredCameras.end(); ++it) {
         it->second->teardown();
     }
+    // windows of a reload that is still waiting for its cameras
+    end_reload();
+}
+
+void RenderManager::begin_reload() {
+	LOG4CPP_INFO(logger, "RenderManager begin_reload.");
+	boost::mutex::scoped_lock lock(m_mutex);
+    for (CameraHandleMap::iterator it=m_mRegisteredCameras.begin(); it != m_mRegisteredCameras.end(); ++it) {
+        boost::shared_ptr<VirtualWindow> window = it->second->detach_window();
+        if (window && window->is_valid()) {
+            // the old handle goes away with its component
+            window->release_handler();
+            m_mKeptWindows.insert(std::make_pair(it->second->title(), window));
+        }
+    }
+    m_mRegisteredCameras.clear();
+    m_mCamerasNeedSetup.clear();
+    m_mCameraSlots.clear();
+    m_iCameraCount = 0;
+}
+
+boost::shared_ptr<VirtualWindow> RenderManager::take_kept_window(const std::string& title) {
+	boost::mutex::scoped_lock lock(m_mutex);
+    boost::shared_ptr<VirtualWindow> window;
+    std::multimap< std::string, boost::shared_ptr<VirtualWindow> >::iterator it = m_mKeptWindows.find(title);
+    if (it != m_mKeptWindows.end()) {
+        window = it->second;
+        m_mKeptWindows.erase(it);
+    }
+    return window;
+}
+
+void RenderManager::return_kept_window(const std::string& title, boost::shared_ptr<VirtualWindow>& window) {
+	boost::mutex::scoped_lock lock(m_mutex);
+    m_mKeptWindows.insert(std::make_pair(title, window));
+}
+
+void RenderManager::end_reload() {
+    std::multimap< std::string, boost::shared_ptr<VirtualWindow> > unclaimed;
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        unclaimed.swap(m_mKeptWindows);
+    }
+    for (std::multimap< std::string, boost::shared_ptr<VirtualWindow> >::iterator it = unclaimed.begin(); it != unclaimed.end(); ++it) {
+        LOG4CPP_INFO(logger, "No camera for window " << it->first << " after reload, closing it.");
+        it->second->destroy();
+    }
 }
 
 CameraHandleMap::iterator RenderManager::cameras_begin() {
@@ -244,6 +535,23 @@ CameraHandleMap::iterator RenderManager::cameras_end() {
     return m_mRegisteredCameras.end();
 }
 
+void RenderManager::presentation_groups(std::map< std::string, std::vector< boost::shared_ptr<CameraHandle> > >& groups) {
+    boost::mutex::scoped_lock lock( m_mutex );
+    groups.clear();
+    for (CameraHandleMap::iterator it=m_mRegisteredCameras.begin(); it != m_mRegisteredCameras.end(); ++it) {
+        if ((it->second) && (!it->second->presentation_group().empty()))
+            groups[it->second->presentation_group()].push_back(it->second);
+    }
+}
+
+boost::shared_ptr<PresentationGroup> RenderManager::get_presentation_group(const std::string& name) {
+    boost::mutex::scoped_lock lock( m_mutex );
+    boost::shared_ptr<PresentationGroup>& group = m_mPresentationGroups[name];
+    if (!group)
+        group.reset(new PresentationGroup(name));
+    return group;
+}
+
 void RenderManager::notify_ready() {
     boost::mutex::scoped_lock lock( g_globalMutex );
     g_continue.notify_all();
@@ -272,12 +580,47 @@ void RenderManager::unregister_notify_callback() {
 #endif
 }
 
+void RenderManager::register_camera_callback(unsigned int cam_id, CameraCallbackType cb) {
+    boost::mutex::scoped_lock lock( m_mutex );
+    m_mCameraSlots[cam_id] = cb;
+}
+
+void RenderManager::unregister_camera_callback(unsigned int cam_id) {
+    boost::mutex::scoped_lock lock( m_mutex );
+    m_mCameraSlots.erase(cam_id);
+}
+
+void RenderManager::notify_camera_ready(unsigned int cam_id) {
+    notify_camera_callback(cam_id);
+    notify_ready();
+}
+
+void RenderManager::notify_camera_callback(unsigned int cam_id) {
+    CameraCallbackType slot;
+    {
+        boost::mutex::scoped_lock lock( m_mutex );
+        std::map< unsigned int, CameraCallbackType >::iterator it = m_mCameraSlots.find(cam_id);
+        if (it != m_mCameraSlots.end())
+            slot = it->second;
+    }
+    // call outside the lock, the host may query the render manager from the callback
+    if (slot) {
+        slot(cam_id);
+    }
+}
+
 
 unsigned int RenderManager::register_camera(boost::shared_ptr<CameraHandle>& handle) {
 	LOG4CPP_DEBUG(logger, "RenderManager register_camera.");
 	boost::mutex::scoped_lock lock(m_mutex);
-    unsigned int new_id = m_iCameraCount++;
+    // ids are never reused, the count shrinks when cameras unregister
+    unsigned int new_id = m_iNextCameraId++;
+    m_iCameraCount++;
     m_mRegisteredCameras[new_id] = handle;
+    handle->set_camera_id(new_id);
+    handle->m_setupStatistics = CameraHandle::SetupStatistics();
+    handle->m_setupQueued = boost::posix_time::microsec_clock::universal_time();
+    handle->m_nextSetupAttempt = handle->m_setupQueued;
     m_mCamerasNeedSetup.push_back(handle);
     return new_id;
 }
@@ -287,8 +630,10 @@ void RenderManager::unregister_camera(unsigned int cam_id) {
 	boost::mutex::scoped_lock lock(m_mutex);
     if (m_mRegisteredCameras.find(cam_id) != m_mRegisteredCameras.end()) {
         m_mRegisteredCameras.erase(cam_id);
+        m_mCameraSlots.erase(cam_id);
+        remove_from_setup(cam_id);
+        m_iCameraCount--;
     }
-    m_iCameraCount--;
 }
 
 unsigned int RenderManager::camera_count() {
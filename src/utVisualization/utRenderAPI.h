@@ -7,12 +7,15 @@
 
 #include <string>
 #include <map>
+#include <vector>
 #include <deque>
 #include <functional>
 #include <memory>
 #include <boost/shared_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/thread.hpp>
 #include <boost/thread/condition.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
 
 #include <utVisualization/Config.h>
 
@@ -23,6 +26,13 @@ namespace Ubitrack {
     namespace Visualization {
 
         class CameraHandle;
+        struct RenderTarget;
+        // held by pointer, so this header stays free of GL headers
+        class AdaptiveResolution;
+        class GLStateCache;
+        class PerformanceHud;
+        class PresentationGroup;
+        class RenderTiming;
 
         class UBITRACK_EXPORT VirtualWindow {
 
@@ -37,10 +47,16 @@ namespace Ubitrack {
 
             virtual void reshape( int w, int h);
 
+            /** stop delivering events to the camera handle, e.g. while the window is kept across a dataflow reload */
+            virtual void release_handler();
+
 			// custom extensions
 			virtual void setFullscreen(bool fullscreen);
 			virtual void onExit();
 
+            /** identifies the set of GL contexts sharing objects with this window (see GeometryCache) */
+            virtual void* share_group();
+
             //virtual void post_redraw();
 
             int width() {
@@ -55,10 +71,30 @@ namespace Ubitrack {
                 return m_title;
             }
 
+            /** dynamic resolution scaling, disabled unless a frame time budget is configured */
+            AdaptiveResolution& adaptive_resolution();
+
+            /** size of the render target of the current frame, smaller than the window if resolution is scaled down */
+            int render_width();
+            int render_height();
+
+            /** state cache of the window's context, camera handles should change GL state through it */
+            GLStateCache& state_cache();
+
+            /** performance overlay, hidden until toggled through CameraHandle::on_toggle_hud() */
+            PerformanceHud& performance_hud();
+
+            /** CPU and GPU time of the window's render pass, measured by the windowing frontend */
+            RenderTiming& render_timing();
+
         protected:
             int m_width;
             int m_height;
             std::string m_title;
+            boost::scoped_ptr< AdaptiveResolution > m_adaptiveResolution;
+            boost::scoped_ptr< GLStateCache > m_stateCache;
+            boost::scoped_ptr< PerformanceHud > m_performanceHud;
+            boost::scoped_ptr< RenderTiming > m_renderTiming;
 
         };
 
@@ -66,33 +102,78 @@ namespace Ubitrack {
         class UBITRACK_EXPORT CameraHandle {
 
         public:
+
+            /** progress of the window setup, maintained by RenderManager::process_setup() */
+            struct SetupStatistics {
+                unsigned int attempts;
+                unsigned int failures;
+                /** milliseconds from registration until the window was set up, negative while pending */
+                double latency;
+                /** duration of the last setup attempt in milliseconds */
+                double lastAttemptTime;
+                /** delay before the next attempt after a failure in milliseconds, 0 if none is scheduled */
+                double retryDelay;
+
+                SetupStatistics();
+            };
+
             CameraHandle(std::string& _name, int _width, int _height, Drivers::VirtualCamera* _handle);
             ~CameraHandle();
 
             bool need_setup();
             virtual bool setup(boost::shared_ptr<VirtualWindow>& window);
+
+            const SetupStatistics& setup_statistics() {
+                return m_setupStatistics;
+            }
+
             boost::shared_ptr<VirtualWindow> get_window();
             virtual void teardown();
 
+            /** hand the window over to someone else, a later teardown() no longer destroys it */
+            boost::shared_ptr<VirtualWindow> detach_window();
+
             /** render GL context, called from main GL thread _only_ */
             virtual void render(int ellapsed_time);
 
+            /**
+             * render into a framebuffer or texture of the host application instead of a window.
+             * Called from the host's render thread with its context current; the first call sets the camera up
+             * with an EmbeddedWindow, cameras that already have a window are rejected.
+             */
+            virtual bool render_to_target(const RenderTarget& target, int ellapsed_time);
+
 
             // virtual callbacks for implementation
             virtual void on_window_size(int w, int h);
             virtual void on_window_close();
             virtual void on_render(int ellapsed_time);
+            /**
+             * key events with GLFW key codes. The default handles Alt+H (performance overlay),
+             * subclasses that override it forward unhandled keys here. Returns 1 if the event was handled.
+             */
             virtual int on_keypress(int key, int scancode, int action, int mods);
             virtual int on_cursorpos(double xpos, double ypos);
 
 			// extended commands from frontend
 			virtual void on_fullscreen();
 			virtual void on_exit();
+			virtual void on_toggle_hud();
 
 
-            // maybe needed for external renderloop synchronization
+            /**
+             * new data is ready to be rendered. Calls the callback a host registered for this camera
+             * with RenderManager::register_camera_callback(), does nothing if there is none.
+             */
             virtual void post_redraw();
 
+            /** id assigned by RenderManager::register_camera() */
+            unsigned int camera_id() {
+                return m_iCameraId;
+            }
+
+            void set_camera_id(unsigned int cam_id);
+
             /** keyboard callback - legacy of ubitrack rendermodule */
             virtual void keyboard( unsigned char key, int x, int y );
 
@@ -109,6 +190,21 @@ namespace Ubitrack {
                 return m_sWindowName;
             }
 
+            /** name of the presentation group this camera is presented with, empty if it is presented on its own */
+            void set_presentation_group(const std::string& group);
+            const std::string& presentation_group();
+
+            /** timestamp of the newest measurement that can be rendered, 0 if unknown. Extend in subclass. */
+            virtual unsigned long long latest_timestamp();
+
+            /** measurement time latched by the presentation group for the next render() call, 0 for the newest data */
+            virtual void set_render_timestamp(unsigned long long timestamp);
+            unsigned long long render_timestamp();
+
+            /** measurements dropped since the camera started and measurements waiting to be rendered. Extend in subclass. */
+            virtual unsigned long long dropped_frames();
+            virtual unsigned int queue_depth();
+
         protected:
             int m_initial_width;
             int m_initial_height;
@@ -118,6 +214,16 @@ namespace Ubitrack {
             bool m_bSetupNeeded;
 			bool m_bIsFullScreen;
             Drivers::VirtualCamera* m_pVirtualCamera;
+            std::string m_sPresentationGroup;
+            unsigned long long m_renderTimestamp;
+            unsigned int m_iCameraId;
+
+        private:
+            friend class RenderManager;
+
+            SetupStatistics m_setupStatistics;
+            boost::posix_time::ptime m_setupQueued;
+            boost::posix_time::ptime m_nextSetupAttempt;
         };
 
 
@@ -130,6 +236,9 @@ namespace Ubitrack {
         public:
 
             typedef std::function<void()> CallbackType;
+            typedef std::function<void(unsigned int)> CameraCallbackType;
+            /** creates the window of a camera on the render thread, returns false if it failed */
+            typedef std::function<bool(boost::shared_ptr<CameraHandle>&)> SetupFunction;
 
             RenderManager();
             ~RenderManager();
@@ -137,10 +246,38 @@ namespace Ubitrack {
 			void setSharedOpenGLContext(void* ctx);
 			void* getSharedOpenGLContext();
 
+            /**
+             * split mode: the windows run in a separate render server process.
+             * Components register a RemoteCameraHandle instead of their own camera handle,
+             * it publishes frames and poses through shared memory and never touches GL.
+             */
+            void set_split_mode(bool split);
+            bool split_mode();
+
+            /** true if a camera is waiting for setup and its next attempt is due */
             bool need_setup();
+            /** number of cameras waiting for setup, including those waiting for a retry */
+            unsigned int pending_setup_count();
+            /** true while the camera waits for its first setup or for a retry */
+            bool setup_pending(unsigned int cam_id);
+            /** take a camera out of the setup queue, e.g. when the host has set it up itself */
+            void setup_remove(unsigned int cam_id);
+            /** the first camera whose setup is due, or an empty pointer */
             boost::shared_ptr<CameraHandle> setup_pop_front();
+            /** queue a camera for setup, it is due immediately */
             void setup_push_back(boost::shared_ptr<CameraHandle>& handle);
 
+            /**
+             * runs the setup function for the cameras that are due, without waiting for any.
+             * Failed setups are queued again and retried after an exponentially growing delay,
+             * so a window that cannot be created does not hold up rendering of the others.
+             * At most maxSetups cameras are set up per call, 0 for no limit. Returns the number of successful setups.
+             */
+            unsigned int process_setup(SetupFunction setupFunction, unsigned int maxSetups = 0);
+
+            /** retry delay after the first failure and upper bound of the delay, in milliseconds */
+            void set_setup_backoff(unsigned int initialDelay, unsigned int maxDelay);
+
             CameraHandleMap::iterator cameras_begin();
             CameraHandleMap::iterator cameras_end();
 
@@ -153,27 +290,69 @@ namespace Ubitrack {
             bool any_windows_valid();
             void teardown();
 
+            /**
+             * start replacing the dataflow: all registered cameras are dropped, their windows are kept
+             * and handed to new cameras with the same title during setup.
+             */
+            void begin_reload();
+
+            /** returns a window kept by begin_reload() for a camera title, or an empty pointer */
+            boost::shared_ptr<VirtualWindow> take_kept_window(const std::string& title);
+
+            /** gives a window taken with take_kept_window() back, e.g. when the camera failed to set it up */
+            void return_kept_window(const std::string& title, boost::shared_ptr<VirtualWindow>& window);
+
+            /** finish the reload, windows that no new camera claimed are destroyed */
+            void end_reload();
+
+            /** snapshot of the registered cameras that belong to a presentation group, sorted by group */
+            void presentation_groups(std::map< std::string, std::vector< boost::shared_ptr<CameraHandle> > >& groups);
+
+            /** synchronization settings and swap statistics of a presentation group, created on first access */
+            boost::shared_ptr<PresentationGroup> get_presentation_group(const std::string& name);
+
             void notify_ready();
             bool wait_for_event(int timeout);
             void register_notify_callback(CallbackType cb);
             void unregister_notify_callback();
 
+            /**
+             * per camera ready notification for hosts driving rendering with render_to_target().
+             * The callback receives the camera id and is called from the thread that produced the data.
+             * Callbacks are dropped when the camera unregisters or the dataflow is reloaded.
+             */
+            void register_camera_callback(unsigned int cam_id, CameraCallbackType cb);
+            void unregister_camera_callback(unsigned int cam_id);
+            /** calls the camera's callback, if one is registered, and wakes wait_for_event() */
+            void notify_camera_ready(unsigned int cam_id);
+            /** calls the camera's callback, if one is registered, and nothing else */
+            void notify_camera_callback(unsigned int cam_id);
+
 
 
             /** get the main rendermanager object */
             static RenderManager& singleton();
 
         private:
+            /** erase a camera from m_mCamerasNeedSetup, m_mutex must be held */
+            void remove_from_setup(unsigned int cam_id);
 
 			CameraHandleMap m_mRegisteredCameras;
             std::deque< boost::shared_ptr<CameraHandle> > m_mCamerasNeedSetup;
             boost::mutex g_globalMutex;
             boost::condition g_continue;
+            std::multimap< std::string, boost::shared_ptr<VirtualWindow> > m_mKeptWindows;
+            std::map< std::string, boost::shared_ptr<PresentationGroup> > m_mPresentationGroups;
             unsigned int m_iCameraCount;
+            unsigned int m_iNextCameraId;
+            unsigned int m_iSetupInitialDelay;
+            unsigned int m_iSetupMaxDelay;
             boost::mutex m_mutex;
 			CallbackType m_notification_slot;
+            std::map< unsigned int, CameraCallbackType > m_mCameraSlots;
 
 			void* m_sharedOpenGLContext;
+            bool m_bSplitMode;
 
         };
 
@@ -0,0 +1,124 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+#include "utRenderTiming.h"
+
+#include <log4cpp/Category.hh>
+
+using namespace Ubitrack;
+using namespace Ubitrack::Visualization;
+
+static log4cpp::Category& logger(log4cpp::Category::getInstance("utVisualization.RenderTiming"));
+
+// weight of the newest sample in the averages
+static const double g_smoothing = 0.1;
+
+
+namespace {
+
+    void smooth(double& average, double sample) {
+        average = (average < 0.0) ? sample : (1.0 - g_smoothing) * average + g_smoothing * sample;
+    }
+
+}
+
+
+RenderTiming::RenderTiming(unsigned int queryCount)
+        : m_queryCount(queryCount < 2 ? 2 : queryCount)
+        , m_first(0)
+        , m_pending(0)
+        , m_bActive(false)
+        , m_bInitialized(false)
+        , m_bSupported(false)
+        , m_cpuTime(-1.0)
+        , m_gpuTime(-1.0)
+        , m_skipped(0)
+{
+}
+
+RenderTiming::~RenderTiming() {
+    // GL resources must be released explicitly with release_gl(), the context may be gone here
+}
+
+void RenderTiming::init_gl() {
+    m_bInitialized = true;
+    m_bSupported = hasGLVersion(3, 3) || hasGLExtension("GL_ARB_timer_query");
+    if (!m_bSupported) {
+        LOG4CPP_INFO(logger, "Timer queries are not supported, GPU times are not available");
+        return;
+    }
+    m_queries.resize(m_queryCount);
+    glGenQueries(m_queryCount, &m_queries[0]);
+}
+
+void RenderTiming::begin() {
+    if (!m_bInitialized)
+        init_gl();
+    if (!m_bSupported || m_bActive)
+        return;
+
+    // all queries still in flight: skip this frame rather than wait
+    if (m_pending == m_queryCount) {
+        m_skipped++;
+        return;
+    }
+    glBeginQuery(GL_TIME_ELAPSED, m_queries[(m_first + m_pending) % m_queryCount]);
+    m_bActive = true;
+}
+
+void RenderTiming::end(double cpuTime) {
+    smooth(m_cpuTime, cpuTime);
+    if (!m_bActive)
+        return;
+    glEndQuery(GL_TIME_ELAPSED);
+    m_bActive = false;
+    m_pending++;
+}
+
+void RenderTiming::poll() {
+    while (m_pending > 0) {
+        GLuint query = m_queries[m_first];
+        GLint available = 0;
+        glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            break;
+
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+        smooth(m_gpuTime, elapsed * 1e-6);
+        m_first = (m_first + 1) % m_queryCount;
+        m_pending--;
+    }
+}
+
+void RenderTiming::release_gl() {
+    if (m_bActive)
+        glEndQuery(GL_TIME_ELAPSED);
+    if (!m_queries.empty())
+        glDeleteQueries(static_cast< GLsizei >(m_queries.size()), &m_queries[0]);
+    m_queries.clear();
+    m_first = 0;
+    m_pending = 0;
+    m_bActive = false;
+    m_bInitialized = false;
+}
@@ -0,0 +1,105 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @ingroup visualization
+ * @file
+ * CPU and GPU time of a window's render pass.
+ *
+ * The CPU time covers command submission only. The GPU time is measured
+ * with GL_TIME_ELAPSED queries from a small rotating pool; results are
+ * collected a few frames later when they are available, so reading them
+ * never stalls the pipeline. Comparing both tells whether a slow window is
+ * bound by submission or by GPU work such as fill rate.
+ */
+
+#ifndef UBITRACK_UTRENDERTIMING_H
+#define UBITRACK_UTRENDERTIMING_H
+
+#include <vector>
+
+#include <utVisualization/Config.h>
+#include <utVisualization/utOpenGL.h>
+
+namespace Ubitrack {
+    namespace Visualization {
+
+        class UBITRACK_EXPORT RenderTiming {
+
+        public:
+            /** queryCount bounds how many frames may be in flight before a measurement is skipped */
+            explicit RenderTiming(unsigned int queryCount = 4);
+            ~RenderTiming();
+
+            /** start the GPU measurement of a frame, with the window's context current */
+            void begin();
+
+            /** stop the GPU measurement and record the CPU time of the frame in milliseconds */
+            void end(double cpuTime);
+
+            /** collect finished GPU measurements, never waits for the GPU */
+            void poll();
+
+            /** smoothed times in milliseconds, the GPU time is negative until the first result arrives */
+            double cpu_time() const {
+                return m_cpuTime;
+            }
+
+            double gpu_time() const {
+                return m_gpuTime;
+            }
+
+            /** false if the context has no timer queries, known after the first begin() */
+            bool gpu_supported() const {
+                return m_bSupported;
+            }
+
+            /** frames not measured on the GPU because all queries were still in flight */
+            unsigned long long skipped_frames() const {
+                return m_skipped;
+            }
+
+            /** release the GL resources, call with the context current before it is destroyed */
+            void release_gl();
+
+        protected:
+            void init_gl();
+
+            unsigned int m_queryCount;
+            std::vector< GLuint > m_queries;
+            // ring of issued queries, results are read oldest first
+            unsigned int m_first;
+            unsigned int m_pending;
+            bool m_bActive;
+
+            bool m_bInitialized;
+            bool m_bSupported;
+            double m_cpuTime;
+            double m_gpuTime;
+            unsigned long long m_skipped;
+        };
+
+    }
+}
+
+#endif //UBITRACK_UTRENDERTIMING_H
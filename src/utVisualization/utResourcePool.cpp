@@ -0,0 +1,471 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+#include "utResourcePool.h"
+#include "utGLStateCache.h"
+
+#include <algorithm>
+
+#include <boost/scoped_ptr.hpp>
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+
+#include <log4cpp/Category.hh>
+
+using namespace Ubitrack;
+using namespace Ubitrack::Visualization;
+
+static log4cpp::Category& logger(log4cpp::Category::getInstance("utVisualization.ResourcePool"));
+
+// the singleton resource pool object
+static boost::scoped_ptr< ResourcePool > g_pResourcePool;
+
+// default budget for pooled render targets: 512 MB
+static const std::size_t g_defaultMemoryBudget = 512 * 1024 * 1024;
+
+
+namespace {
+
+    // drivers pad three component and 24 bit formats, so those count as four bytes
+    std::size_t bytesPerPixel(GLenum internalFormat) {
+        switch (internalFormat) {
+            case GL_ALPHA8:
+            case GL_LUMINANCE8:
+            case GL_R8:
+                return 1;
+            case GL_LUMINANCE8_ALPHA8:
+            case GL_RG8:
+            case GL_DEPTH_COMPONENT16:
+            case GL_R16F:
+                return 2;
+            case GL_RGBA16F:
+            case GL_RGB16F:
+            case GL_DEPTH32F_STENCIL8:
+                return 8;
+            case GL_RGBA32F:
+            case GL_RGB32F:
+                return 16;
+            default:
+                return 4;
+        }
+    }
+
+    // pixel transfer format and type matching an internal format, needed to allocate texture storage
+    void transferFormat(GLenum internalFormat, GLenum& format, GLenum& type) {
+        switch (internalFormat) {
+            case GL_DEPTH_COMPONENT:
+            case GL_DEPTH_COMPONENT16:
+            case GL_DEPTH_COMPONENT24:
+            case GL_DEPTH_COMPONENT32:
+                format = GL_DEPTH_COMPONENT;
+                type = GL_UNSIGNED_INT;
+                break;
+            case GL_DEPTH_COMPONENT32F:
+                format = GL_DEPTH_COMPONENT;
+                type = GL_FLOAT;
+                break;
+            case GL_DEPTH_STENCIL:
+            case GL_DEPTH24_STENCIL8:
+                format = GL_DEPTH_STENCIL;
+                type = GL_UNSIGNED_INT_24_8;
+                break;
+            case GL_RGBA16F:
+            case GL_RGBA32F:
+                format = GL_RGBA;
+                type = GL_FLOAT;
+                break;
+            case GL_RGB16F:
+            case GL_RGB32F:
+                format = GL_RGB;
+                type = GL_FLOAT;
+                break;
+            case GL_RGB:
+            case GL_RGB8:
+                format = GL_RGB;
+                type = GL_UNSIGNED_BYTE;
+                break;
+            case GL_R8:
+            case GL_R16F:
+                format = GL_RED;
+                type = GL_UNSIGNED_BYTE;
+                break;
+            case GL_RG8:
+                format = GL_RG;
+                type = GL_UNSIGNED_BYTE;
+                break;
+            case GL_LUMINANCE:
+            case GL_LUMINANCE8:
+                format = GL_LUMINANCE;
+                type = GL_UNSIGNED_BYTE;
+                break;
+            default:
+                format = GL_RGBA;
+                type = GL_UNSIGNED_BYTE;
+                break;
+        }
+    }
+
+    // returns the object of a handle to the pool
+    struct ResourceReleaser {
+        unsigned long long serial;
+        boost::function< void ( unsigned long long ) > release;
+
+        void operator()(PooledResource* resource) {
+            delete resource;
+            release(serial);
+        }
+    };
+
+}
+
+
+PooledResource::PooledResource()
+        : m_type(TEXTURE)
+        , m_id(0)
+        , m_internalFormat(0)
+        , m_width(0)
+        , m_height(0)
+        , m_samples(0)
+        , m_byteSize(0)
+{
+}
+
+
+bool ResourcePool::Key::operator<(const Key& other) const {
+    if (shareGroup != other.shareGroup)
+        return shareGroup < other.shareGroup;
+    if (type != other.type)
+        return type < other.type;
+    if (internalFormat != other.internalFormat)
+        return internalFormat < other.internalFormat;
+    if (width != other.width)
+        return width < other.width;
+    if (height != other.height)
+        return height < other.height;
+    return samples < other.samples;
+}
+
+
+ResourcePool& ResourcePool::singleton()
+{
+    // prevent from race condition
+    static boost::mutex singletonMutex;
+    boost::mutex::scoped_lock l( singletonMutex );
+
+    // create a new singleton if necessary
+    if ( !g_pResourcePool )
+        g_pResourcePool.reset( new ResourcePool() );
+
+    return *g_pResourcePool;
+}
+
+ResourcePool::ResourcePool()
+        : m_nextSerial(0)
+        , m_memoryBudget(g_defaultMemoryBudget)
+        , m_memoryUsage(0)
+        , m_idleMemory(0)
+        , m_allocations(0)
+        , m_reuses(0)
+        , m_bOverBudget(false)
+{
+}
+
+ResourcePool::~ResourcePool() {
+    // the contexts are gone at this point, GL objects die with them
+}
+
+boost::shared_ptr< PooledResource > ResourcePool::acquire_texture(void* share_group, GLenum internalFormat,
+    int width, int height, const std::string& owner) {
+    Key key;
+    key.shareGroup = share_group;
+    key.type = PooledResource::TEXTURE;
+    key.internalFormat = internalFormat;
+    key.width = width;
+    key.height = height;
+    key.samples = 0;
+    return acquire(key, owner);
+}
+
+boost::shared_ptr< PooledResource > ResourcePool::acquire_renderbuffer(void* share_group, GLenum internalFormat,
+    int width, int height, int samples, const std::string& owner) {
+    Key key;
+    key.shareGroup = share_group;
+    key.type = PooledResource::RENDERBUFFER;
+    key.internalFormat = internalFormat;
+    key.width = width;
+    key.height = height;
+    key.samples = samples;
+    return acquire(key, owner);
+}
+
+boost::shared_ptr< PooledResource > ResourcePool::acquire_framebuffer(void* context, const std::string& owner) {
+    Key key;
+    key.shareGroup = context;
+    key.type = PooledResource::FRAMEBUFFER;
+    key.internalFormat = 0;
+    key.width = 0;
+    key.height = 0;
+    key.samples = 0;
+    return acquire(key, owner);
+}
+
+boost::shared_ptr< PooledResource > ResourcePool::acquire(const Key& key, const std::string& owner) {
+    boost::mutex::scoped_lock lock( m_mutex );
+
+    // objects evicted earlier can be deleted now that a context of the group is current
+    delete_pending(key.shareGroup);
+
+    unsigned long long serial;
+    std::multimap< Key, unsigned long long >::iterator idle = m_idle.find(key);
+    if (idle != m_idle.end()) {
+        serial = idle->second;
+        m_idle.erase(idle);
+        Record& record = m_records[serial];
+        m_lru.erase(record.lruPos);
+        record.lruPos = m_lru.end();
+        m_idleMemory -= record.byteSize;
+        m_reuses++;
+    } else {
+        Record record;
+        record.key = key;
+        record.byteSize = (key.type == PooledResource::FRAMEBUFFER) ? 0
+            : bytesPerPixel(key.internalFormat) * key.width * key.height * std::max(1, key.samples);
+
+        // make room by dropping idle objects before the driver has to
+        m_memoryUsage += record.byteSize;
+        enforce_budget();
+        if (m_memoryUsage > m_memoryBudget && !m_bOverBudget) {
+            LOG4CPP_WARN(logger, "Render targets in use exceed the memory budget: " << m_memoryUsage / (1024 * 1024)
+                << " of " << m_memoryBudget / (1024 * 1024) << " MB");
+            m_bOverBudget = true;
+        }
+
+        record.id = create(key);
+        record.lruPos = m_lru.end();
+        serial = m_nextSerial++;
+        m_records[serial] = record;
+        m_allocations++;
+    }
+
+    Record& record = m_records[serial];
+    record.inUse = true;
+    record.owner = owner;
+    m_ownerUsage[owner] += record.byteSize;
+
+    PooledResource* resource = new PooledResource();
+    resource->m_type = key.type;
+    resource->m_id = record.id;
+    resource->m_internalFormat = key.internalFormat;
+    resource->m_width = key.width;
+    resource->m_height = key.height;
+    resource->m_samples = key.samples;
+    resource->m_byteSize = record.byteSize;
+
+    ResourceReleaser releaser;
+    releaser.serial = serial;
+    releaser.release = boost::bind(&ResourcePool::release, this, _1);
+    return boost::shared_ptr< PooledResource >(resource, releaser);
+}
+
+GLuint ResourcePool::create(const Key& key) {
+    GLuint id = 0;
+    switch (key.type) {
+        case PooledResource::TEXTURE: {
+            GLenum format, type;
+            transferFormat(key.internalFormat, format, type);
+            glGenTextures(1, &id);
+            glBindTexture(GL_TEXTURE_2D, id);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexImage2D(GL_TEXTURE_2D, 0, key.internalFormat, key.width, key.height, 0, format, type, NULL);
+            glBindTexture(GL_TEXTURE_2D, 0);
+            GLStateCache::invalidate_current(GLStateCache::STATE_TEXTURES);
+            break;
+        }
+        case PooledResource::RENDERBUFFER:
+            glGenRenderbuffers(1, &id);
+            glBindRenderbuffer(GL_RENDERBUFFER, id);
+            if (key.samples > 0)
+                glRenderbufferStorageMultisample(GL_RENDERBUFFER, key.samples, key.internalFormat, key.width, key.height);
+            else
+                glRenderbufferStorage(GL_RENDERBUFFER, key.internalFormat, key.width, key.height);
+            glBindRenderbuffer(GL_RENDERBUFFER, 0);
+            break;
+        case PooledResource::FRAMEBUFFER:
+            glGenFramebuffers(1, &id);
+            break;
+    }
+    LOG4CPP_DEBUG(logger, "Created pooled object " << id << " (type " << key.type << ", " << key.width << "x" << key.height << ")");
+    return id;
+}
+
+void ResourcePool::release(unsigned long long serial) {
+    boost::mutex::scoped_lock lock( m_mutex );
+    RecordMap::iterator it = m_records.find(serial);
+    if (it == m_records.end() || !it->second.inUse)
+        return;
+
+    Record& record = it->second;
+    m_ownerUsage[record.owner] -= record.byteSize;
+    if (m_ownerUsage[record.owner] == 0)
+        m_ownerUsage.erase(record.owner);
+    record.inUse = false;
+    record.owner.clear();
+
+    m_idle.insert(std::make_pair(record.key, serial));
+    record.lruPos = m_lru.insert(m_lru.end(), serial);
+    m_idleMemory += record.byteSize;
+    enforce_budget();
+}
+
+void ResourcePool::enforce_budget() {
+    // called with m_mutex held, evicts idle objects starting with the least recently released
+    while (m_memoryUsage > m_memoryBudget && !m_lru.empty()) {
+        RecordMap::iterator it = m_records.find(m_lru.front());
+        if (it == m_records.end()) {
+            m_lru.pop_front();
+            continue;
+        }
+        evict(it);
+    }
+    if (m_memoryUsage <= m_memoryBudget)
+        m_bOverBudget = false;
+}
+
+void ResourcePool::evict(RecordMap::iterator it) {
+    // called with m_mutex held, the object is deleted when a context of its group is current again
+    Record& record = it->second;
+    PendingDeletes& pending = m_pendingDeletes[record.key.shareGroup];
+    switch (record.key.type) {
+        case PooledResource::TEXTURE:
+            pending.textures.push_back(record.id);
+            break;
+        case PooledResource::RENDERBUFFER:
+            pending.renderbuffers.push_back(record.id);
+            break;
+        case PooledResource::FRAMEBUFFER:
+            pending.framebuffers.push_back(record.id);
+            break;
+    }
+
+    std::pair< std::multimap< Key, unsigned long long >::iterator, std::multimap< Key, unsigned long long >::iterator > range
+        = m_idle.equal_range(record.key);
+    for (std::multimap< Key, unsigned long long >::iterator idle = range.first; idle != range.second; ++idle) {
+        if (idle->second == it->first) {
+            m_idle.erase(idle);
+            break;
+        }
+    }
+    if (record.lruPos != m_lru.end())
+        m_lru.erase(record.lruPos);
+    m_memoryUsage -= record.byteSize;
+    m_idleMemory -= record.byteSize;
+    m_records.erase(it);
+}
+
+void ResourcePool::delete_pending(void* share_group) {
+    // called with m_mutex held and a context of the group current
+    std::map< void*, PendingDeletes >::iterator pending = m_pendingDeletes.find(share_group);
+    if (pending == m_pendingDeletes.end())
+        return;
+    PendingDeletes& objects = pending->second;
+    if (!objects.textures.empty())
+        glDeleteTextures(static_cast< GLsizei >(objects.textures.size()), &objects.textures[0]);
+    if (!objects.renderbuffers.empty())
+        glDeleteRenderbuffers(static_cast< GLsizei >(objects.renderbuffers.size()), &objects.renderbuffers[0]);
+    if (!objects.framebuffers.empty())
+        glDeleteFramebuffers(static_cast< GLsizei >(objects.framebuffers.size()), &objects.framebuffers[0]);
+    m_pendingDeletes.erase(pending);
+}
+
+void ResourcePool::collect_garbage(void* share_group) {
+    boost::mutex::scoped_lock lock( m_mutex );
+    delete_pending(share_group);
+}
+
+void ResourcePool::drop_share_group(void* share_group) {
+    boost::mutex::scoped_lock lock( m_mutex );
+    m_pendingDeletes.erase(share_group);
+    RecordMap::iterator it = m_records.begin();
+    while (it != m_records.end()) {
+        RecordMap::iterator current = it++;
+        Record& record = current->second;
+        if (record.key.shareGroup != share_group)
+            continue;
+        if (record.inUse) {
+            LOG4CPP_WARN(logger, "Share group destroyed while a render target of " << record.owner << " is still in use");
+            m_ownerUsage[record.owner] -= record.byteSize;
+            if (m_ownerUsage[record.owner] == 0)
+                m_ownerUsage.erase(record.owner);
+            // the handle's release finds no record and does nothing
+            m_idleMemory += record.byteSize;
+            record.lruPos = m_lru.end();
+        }
+        evict(current);
+    }
+    // the objects died with the context, there is nothing left to delete
+    m_pendingDeletes.erase(share_group);
+}
+
+void ResourcePool::set_memory_budget(std::size_t bytes) {
+    boost::mutex::scoped_lock lock( m_mutex );
+    m_memoryBudget = bytes;
+    enforce_budget();
+}
+
+std::size_t ResourcePool::memory_budget() {
+    return m_memoryBudget;
+}
+
+std::size_t ResourcePool::memory_usage() {
+    boost::mutex::scoped_lock lock( m_mutex );
+    return m_memoryUsage;
+}
+
+std::size_t ResourcePool::idle_memory() {
+    boost::mutex::scoped_lock lock( m_mutex );
+    return m_idleMemory;
+}
+
+std::size_t ResourcePool::owner_usage(const std::string& owner) {
+    boost::mutex::scoped_lock lock( m_mutex );
+    std::map< std::string, std::size_t >::iterator it = m_ownerUsage.find(owner);
+    return it != m_ownerUsage.end() ? it->second : 0;
+}
+
+void ResourcePool::usage_by_owner(std::map< std::string, std::size_t >& usage) {
+    boost::mutex::scoped_lock lock( m_mutex );
+    usage = m_ownerUsage;
+}
+
+unsigned long long ResourcePool::allocations() {
+    boost::mutex::scoped_lock lock( m_mutex );
+    return m_allocations;
+}
+
+unsigned long long ResourcePool::reuses() {
+    boost::mutex::scoped_lock lock( m_mutex );
+    return m_reuses;
+}
@@ -0,0 +1,209 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @ingroup visualization
+ * @file
+ * Pool of textures, renderbuffers and framebuffer objects.
+ *
+ * Render targets are requested with their format and size and returned to
+ * the pool instead of being deleted when the last handle goes away, so
+ * resizing windows and replacing cameras reuse earlier allocations. Idle
+ * objects are deleted in LRU order whenever the estimated memory of all
+ * pooled objects exceeds the budget. Memory in use is accounted per owner,
+ * usually the title of the camera.
+ */
+
+#ifndef UBITRACK_UTRESOURCEPOOL_H
+#define UBITRACK_UTRESOURCEPOOL_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <list>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <utVisualization/Config.h>
+#include <utVisualization/utOpenGL.h>
+
+namespace Ubitrack {
+    namespace Visualization {
+
+        /** a pooled GL object, goes back to the pool when the last shared_ptr is released */
+        class UBITRACK_EXPORT PooledResource {
+
+        public:
+            enum Type {
+                TEXTURE,
+                RENDERBUFFER,
+                FRAMEBUFFER
+            };
+
+            PooledResource();
+
+            Type type() const {
+                return m_type;
+            }
+
+            GLuint id() const {
+                return m_id;
+            }
+
+            GLenum internal_format() const {
+                return m_internalFormat;
+            }
+
+            int width() const {
+                return m_width;
+            }
+
+            int height() const {
+                return m_height;
+            }
+
+            int samples() const {
+                return m_samples;
+            }
+
+            /** estimated GPU memory, 0 for framebuffer objects */
+            std::size_t byte_size() const {
+                return m_byteSize;
+            }
+
+        protected:
+            friend class ResourcePool;
+
+            Type m_type;
+            GLuint m_id;
+            GLenum m_internalFormat;
+            int m_width;
+            int m_height;
+            int m_samples;
+            std::size_t m_byteSize;
+        };
+
+
+        class UBITRACK_EXPORT ResourcePool {
+
+        public:
+            ResourcePool();
+            ~ResourcePool();
+
+            /**
+             * returns a 2D texture without mipmaps, linear filtering and clamped to edge.
+             * The content is undefined. A context of the share group must be current.
+             */
+            boost::shared_ptr< PooledResource > acquire_texture(void* share_group, GLenum internalFormat,
+                int width, int height, const std::string& owner);
+
+            /** returns a renderbuffer with storage allocated, samples > 0 for multisampling */
+            boost::shared_ptr< PooledResource > acquire_renderbuffer(void* share_group, GLenum internalFormat,
+                int width, int height, int samples, const std::string& owner);
+
+            /**
+             * returns a framebuffer object, attachments of its previous user may still be set.
+             * Framebuffer objects are not shared between contexts, pass the context (e.g. the window) instead of the share group.
+             */
+            boost::shared_ptr< PooledResource > acquire_framebuffer(void* context, const std::string& owner);
+
+            /** delete idle objects evicted from the pool, call with a context of the share group (or the context) current */
+            void collect_garbage(void* share_group);
+
+            /** forget all objects of a share group or context that has been destroyed */
+            void drop_share_group(void* share_group);
+
+            void set_memory_budget(std::size_t bytes);
+            std::size_t memory_budget();
+
+            /** estimated memory of all pooled objects, in use and idle */
+            std::size_t memory_usage();
+            std::size_t idle_memory();
+
+            /** memory of the objects in use by one owner, and by all owners */
+            std::size_t owner_usage(const std::string& owner);
+            void usage_by_owner(std::map< std::string, std::size_t >& usage);
+
+            /** number of requests served by creating a new object and from an idle one */
+            unsigned long long allocations();
+            unsigned long long reuses();
+
+            /** get the process-wide resource pool */
+            static ResourcePool& singleton();
+
+        private:
+
+            struct Key {
+                void* shareGroup;
+                PooledResource::Type type;
+                GLenum internalFormat;
+                int width;
+                int height;
+                int samples;
+
+                bool operator<(const Key& other) const;
+            };
+
+            struct Record {
+                Key key;
+                GLuint id;
+                std::size_t byteSize;
+                std::string owner;
+                bool inUse;
+                std::list< unsigned long long >::iterator lruPos;
+            };
+
+            struct PendingDeletes {
+                std::vector< GLuint > textures;
+                std::vector< GLuint > renderbuffers;
+                std::vector< GLuint > framebuffers;
+            };
+
+            typedef std::map< unsigned long long, Record > RecordMap;
+
+            boost::shared_ptr< PooledResource > acquire(const Key& key, const std::string& owner);
+            GLuint create(const Key& key);
+            void release(unsigned long long serial);
+            void delete_pending(void* share_group);
+            void enforce_budget();
+            void evict(RecordMap::iterator it);
+
+            RecordMap m_records;
+            std::multimap< Key, unsigned long long > m_idle;
+            std::list< unsigned long long > m_lru;
+            std::map< void*, PendingDeletes > m_pendingDeletes;
+            std::map< std::string, std::size_t > m_ownerUsage;
+            unsigned long long m_nextSerial;
+            std::size_t m_memoryBudget;
+            std::size_t m_memoryUsage;
+            std::size_t m_idleMemory;
+            unsigned long long m_allocations;
+            unsigned long long m_reuses;
+            bool m_bOverBudget;
+            boost::mutex m_mutex;
+        };
+
+    }
+}
+
+#endif //UBITRACK_UTRESOURCEPOOL_H
@@ -0,0 +1,411 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+#include "utSceneIndex.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+
+#include <log4cpp/Category.hh>
+
+using namespace Ubitrack;
+using namespace Ubitrack::Visualization;
+
+static log4cpp::Category& logger(log4cpp::Category::getInstance("utVisualization.SceneIndex"));
+
+// objects per leaf, small leaves keep the per object tests cheap
+static const unsigned int g_leafSize = 4;
+
+// rebuild once refitting has grown the summed node surface by this factor
+static const double g_rebuildFactor = 2.0;
+
+
+namespace {
+
+    // plane test of a box: -1 outside, 1 fully inside, 0 intersecting
+    int classify(const float plane[4], const float min[3], const float max[3]) {
+        float p = plane[3];
+        float n = plane[3];
+        for (int i = 0; i < 3; i++) {
+            if (plane[i] >= 0.0f) {
+                p += plane[i] * max[i];
+                n += plane[i] * min[i];
+            } else {
+                p += plane[i] * min[i];
+                n += plane[i] * max[i];
+            }
+        }
+        if (p < 0.0f)
+            return -1;
+        return n >= 0.0f ? 1 : 0;
+    }
+
+    // planes of the clip space frustum, pointing inwards (Gribb and Hartmann)
+    void extract_planes(const float m[16], float planes[6][4]) {
+        for (int i = 0; i < 4; i++) {
+            float row0 = m[i * 4 + 0];
+            float row1 = m[i * 4 + 1];
+            float row2 = m[i * 4 + 2];
+            float row3 = m[i * 4 + 3];
+            planes[0][i] = row3 + row0;
+            planes[1][i] = row3 - row0;
+            planes[2][i] = row3 + row1;
+            planes[3][i] = row3 - row1;
+            planes[4][i] = row3 + row2;
+            planes[5][i] = row3 - row2;
+        }
+    }
+
+}
+
+
+// orders objects by the centre of their bounds along an axis
+struct SceneIndex::CentreLess {
+    const std::vector< Object >& objects;
+    int axis;
+
+    CentreLess(const std::vector< Object >& _objects, int _axis)
+            : objects(_objects), axis(_axis) {
+    }
+
+    bool operator()(ObjectId a, ObjectId b) const {
+        return objects[a].min[axis] + objects[a].max[axis] < objects[b].min[axis] + objects[b].max[axis];
+    }
+};
+
+
+SceneIndex::SceneIndex()
+        : m_liveCount(0)
+        , m_bRebuild(false)
+        , m_buildCost(0.0)
+        , m_cost(0.0)
+        , m_builds(0)
+{
+}
+
+SceneIndex::~SceneIndex() {
+}
+
+SceneIndex::ObjectId SceneIndex::insert(InstanceBatch::Shape shape, const float pose[16], const float scale[3], const float color[4]) {
+    boost::mutex::scoped_lock lock( m_mutex );
+    ObjectId id;
+    if (!m_freeIds.empty()) {
+        id = m_freeIds.back();
+        m_freeIds.pop_back();
+    } else {
+        id = static_cast< ObjectId >(m_objects.size());
+        m_objects.push_back(Object());
+    }
+
+    Object& object = m_objects[id];
+    object.shape = shape;
+    std::memcpy(object.pose, pose, sizeof(object.pose));
+    std::memcpy(object.scale, scale, sizeof(object.scale));
+    std::memcpy(object.color, color, sizeof(object.color));
+    object.leaf = -1;
+    object.alive = true;
+    update_bounds(object);
+
+    m_liveCount++;
+    m_bRebuild = true;
+    return id;
+}
+
+void SceneIndex::remove(ObjectId id) {
+    boost::mutex::scoped_lock lock( m_mutex );
+    if (id >= m_objects.size() || !m_objects[id].alive)
+        return;
+    m_objects[id].alive = false;
+    m_objects[id].leaf = -1;
+    m_freeIds.push_back(id);
+    m_liveCount--;
+    m_bRebuild = true;
+}
+
+void SceneIndex::clear() {
+    boost::mutex::scoped_lock lock( m_mutex );
+    m_objects.clear();
+    m_freeIds.clear();
+    m_liveCount = 0;
+    m_nodes.clear();
+    m_order.clear();
+    m_dirtyNodes.clear();
+    m_bRebuild = false;
+    m_buildCost = 0.0;
+    m_cost = 0.0;
+}
+
+void SceneIndex::set_pose(ObjectId id, const float pose[16]) {
+    boost::mutex::scoped_lock lock( m_mutex );
+    if (id >= m_objects.size() || !m_objects[id].alive)
+        return;
+    Object& object = m_objects[id];
+    std::memcpy(object.pose, pose, sizeof(object.pose));
+    update_bounds(object);
+    if (!m_bRebuild && object.leaf >= 0)
+        mark_dirty(object.leaf);
+}
+
+void SceneIndex::set_color(ObjectId id, const float color[4]) {
+    boost::mutex::scoped_lock lock( m_mutex );
+    if (id >= m_objects.size() || !m_objects[id].alive)
+        return;
+    std::memcpy(m_objects[id].color, color, sizeof(m_objects[id].color));
+}
+
+std::size_t SceneIndex::size() {
+    boost::mutex::scoped_lock lock( m_mutex );
+    return m_liveCount;
+}
+
+void SceneIndex::update_bounds(Object& object) {
+    // all shapes fit into [-1, 1] scaled along the axes of the pose
+    for (int i = 0; i < 3; i++) {
+        float extent = 0.0f;
+        for (int j = 0; j < 3; j++)
+            extent += std::fabs(object.pose[j * 4 + i]) * object.scale[j];
+        object.min[i] = object.pose[12 + i] - extent;
+        object.max[i] = object.pose[12 + i] + extent;
+    }
+}
+
+void SceneIndex::mark_dirty(int leaf) {
+    for (int node = leaf; node >= 0 && !m_nodes[node].dirty; node = m_nodes[node].parent) {
+        m_nodes[node].dirty = true;
+        m_dirtyNodes.push_back(node);
+    }
+}
+
+float SceneIndex::surface_area(const Node& node) {
+    float dx = node.max[0] - node.min[0];
+    float dy = node.max[1] - node.min[1];
+    float dz = node.max[2] - node.min[2];
+    return 2.0f * (dx * dy + dy * dz + dz * dx);
+}
+
+void SceneIndex::build() {
+    m_order.clear();
+    m_order.reserve(m_liveCount);
+    for (std::size_t i = 0; i < m_objects.size(); i++) {
+        if (m_objects[i].alive)
+            m_order.push_back(static_cast< ObjectId >(i));
+    }
+
+    m_nodes.clear();
+    m_nodes.reserve(2 * m_order.size() / g_leafSize + 1);
+    m_dirtyNodes.clear();
+    if (!m_order.empty())
+        build_node(0, static_cast< unsigned int >(m_order.size()), -1);
+
+    m_cost = 0.0;
+    for (std::size_t i = 0; i < m_nodes.size(); i++)
+        m_cost += surface_area(m_nodes[i]);
+    m_buildCost = m_cost;
+    m_bRebuild = false;
+    m_builds++;
+    LOG4CPP_DEBUG(logger, "Built hierarchy of " << m_nodes.size() << " nodes over " << m_order.size() << " objects");
+}
+
+int SceneIndex::build_node(unsigned int first, unsigned int count, int parent) {
+    int index = static_cast< int >(m_nodes.size());
+    m_nodes.push_back(Node());
+    Node& node = m_nodes.back();
+    node.parent = parent;
+    node.right = -1;
+    node.first = first;
+    node.count = count;
+    node.dirty = false;
+    refit_node(node);
+
+    if (count <= g_leafSize) {
+        for (unsigned int i = first; i < first + count; i++)
+            m_objects[m_order[i]].leaf = index;
+        return index;
+    }
+
+    // median split along the longest axis of the object centres
+    float centreMin[3] = { 1e30f, 1e30f, 1e30f };
+    float centreMax[3] = { -1e30f, -1e30f, -1e30f };
+    for (unsigned int i = first; i < first + count; i++) {
+        const Object& object = m_objects[m_order[i]];
+        for (int k = 0; k < 3; k++) {
+            float centre = object.min[k] + object.max[k];
+            centreMin[k] = std::min(centreMin[k], centre);
+            centreMax[k] = std::max(centreMax[k], centre);
+        }
+    }
+    int axis = 0;
+    for (int k = 1; k < 3; k++) {
+        if (centreMax[k] - centreMin[k] > centreMax[axis] - centreMin[axis])
+            axis = k;
+    }
+
+    unsigned int half = count / 2;
+    std::nth_element(m_order.begin() + first, m_order.begin() + first + half, m_order.begin() + first + count,
+        CentreLess(m_objects, axis));
+
+    // node is not used past here, children may reallocate m_nodes
+    m_nodes[index].count = 0;
+    build_node(first, half, index);
+    int right = build_node(first + half, count - half, index);
+    m_nodes[index].right = right;
+    return index;
+}
+
+void SceneIndex::refit_node(Node& node) {
+    for (int k = 0; k < 3; k++) {
+        node.min[k] = 1e30f;
+        node.max[k] = -1e30f;
+    }
+    if (node.count > 0) {
+        for (unsigned int i = node.first; i < node.first + node.count; i++) {
+            const Object& object = m_objects[m_order[i]];
+            for (int k = 0; k < 3; k++) {
+                node.min[k] = std::min(node.min[k], object.min[k]);
+                node.max[k] = std::max(node.max[k], object.max[k]);
+            }
+        }
+        return;
+    }
+    const Node& left = *(&node + 1);
+    const Node& right = m_nodes[node.right];
+    for (int k = 0; k < 3; k++) {
+        node.min[k] = std::min(left.min[k], right.min[k]);
+        node.max[k] = std::max(left.max[k], right.max[k]);
+    }
+}
+
+void SceneIndex::refit() {
+    // children are stored after their parents, so refitting in descending order visits them first
+    std::sort(m_dirtyNodes.begin(), m_dirtyNodes.end(), std::greater< int >());
+    for (std::size_t i = 0; i < m_dirtyNodes.size(); i++) {
+        Node& node = m_nodes[m_dirtyNodes[i]];
+        m_cost -= surface_area(node);
+        refit_node(node);
+        m_cost += surface_area(node);
+        node.dirty = false;
+    }
+    m_dirtyNodes.clear();
+}
+
+void SceneIndex::update_tree() {
+    if (!m_bRebuild && !m_dirtyNodes.empty()) {
+        refit();
+        if (m_cost > g_rebuildFactor * m_buildCost) {
+            LOG4CPP_DEBUG(logger, "Refitted hierarchy degraded, rebuilding");
+            m_bRebuild = true;
+        }
+    }
+    if (m_bRebuild)
+        build();
+}
+
+void SceneIndex::collect_all(int index, std::vector< ObjectId >& visible) {
+    const Node& node = m_nodes[index];
+    if (node.count > 0) {
+        visible.insert(visible.end(), m_order.begin() + node.first, m_order.begin() + node.first + node.count);
+        return;
+    }
+    collect_all(index + 1, visible);
+    collect_all(node.right, visible);
+}
+
+void SceneIndex::collect(int index, const float planes[6][4], unsigned int mask, std::vector< ObjectId >& visible) {
+    const Node& node = m_nodes[index];
+    for (int p = 0; p < 6; p++) {
+        if (!(mask & (1u << p)))
+            continue;
+        int side = classify(planes[p], node.min, node.max);
+        if (side < 0)
+            return;
+        if (side > 0)
+            mask &= ~(1u << p);
+    }
+
+    if (mask == 0) {
+        collect_all(index, visible);
+        return;
+    }
+    if (node.count == 0) {
+        collect(index + 1, planes, mask, visible);
+        collect(node.right, planes, mask, visible);
+        return;
+    }
+
+    for (unsigned int i = node.first; i < node.first + node.count; i++) {
+        const Object& object = m_objects[m_order[i]];
+        bool inside = true;
+        for (int p = 0; p < 6 && inside; p++) {
+            if ((mask & (1u << p)) && classify(planes[p], object.min, object.max) < 0)
+                inside = false;
+        }
+        if (inside)
+            visible.push_back(m_order[i]);
+    }
+}
+
+void SceneIndex::cull(const float viewProjection[16], std::vector< ObjectId >& visible) {
+    float planes[6][4];
+    extract_planes(viewProjection, planes);
+
+    boost::mutex::scoped_lock lock( m_mutex );
+    update_tree();
+    if (!m_nodes.empty())
+        collect(0, planes, 0x3f, visible);
+}
+
+std::size_t SceneIndex::submit(InstanceBatch& batch, const float viewProjection[16]) {
+    float planes[6][4];
+    extract_planes(viewProjection, planes);
+
+    std::vector< ObjectId > visible;
+    boost::mutex::scoped_lock lock( m_mutex );
+    update_tree();
+    if (!m_nodes.empty())
+        collect(0, planes, 0x3f, visible);
+    for (std::size_t i = 0; i < visible.size(); i++) {
+        const Object& object = m_objects[visible[i]];
+        batch.add(object.shape, object.pose, object.scale, object.color);
+    }
+    return visible.size();
+}
+
+std::size_t SceneIndex::submit(InstanceBatch& batch) {
+    float projection[16];
+    float modelview[16];
+    glGetFloatv(GL_PROJECTION_MATRIX, projection);
+    glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+
+    float viewProjection[16];
+    for (int c = 0; c < 4; c++) {
+        for (int r = 0; r < 4; r++) {
+            float sum = 0.0f;
+            for (int k = 0; k < 4; k++)
+                sum += projection[k * 4 + r] * modelview[c * 4 + k];
+            viewProjection[c * 4 + r] = sum;
+        }
+    }
+    return submit(batch, viewProjection);
+}
@@ -0,0 +1,147 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @ingroup visualization
+ * @file
+ * Spatial index of the objects of a large overlay scene.
+ *
+ * Objects are kept in a bounding volume hierarchy over their world space
+ * bounding boxes. Tracked poses only refit the boxes along the path to the
+ * root; the tree is rebuilt when objects are added or removed, or when
+ * refitting has degraded it too far. Camera handles submit the scene to an
+ * InstanceBatch through submit(), which only adds the objects intersecting
+ * the view frustum of that camera.
+ */
+
+#ifndef UBITRACK_UTSCENEINDEX_H
+#define UBITRACK_UTSCENEINDEX_H
+
+#include <vector>
+#include <boost/thread/mutex.hpp>
+
+#include <utVisualization/Config.h>
+#include <utVisualization/utInstanceBatch.h>
+
+namespace Ubitrack {
+    namespace Visualization {
+
+        class UBITRACK_EXPORT SceneIndex {
+
+        public:
+            typedef unsigned int ObjectId;
+
+            SceneIndex();
+            ~SceneIndex();
+
+            /**
+             * adds an object, may be called from any thread.
+             * pose, scale and colour are used as in InstanceBatch::add(), the shape's extent gives the bounds
+             */
+            ObjectId insert(InstanceBatch::Shape shape, const float pose[16], const float scale[3], const float color[4]);
+
+            void remove(ObjectId id);
+            void clear();
+
+            /** moves an object, may be called from any thread, only refits the hierarchy */
+            void set_pose(ObjectId id, const float pose[16]);
+            void set_color(ObjectId id, const float color[4]);
+
+            std::size_t size();
+
+            /**
+             * collects the objects intersecting a view frustum.
+             * @param viewProjection column major projection times view matrix mapping world to clip space
+             */
+            void cull(const float viewProjection[16], std::vector< ObjectId >& visible);
+
+            /** adds the objects inside the frustum to the batch, returns their number */
+            std::size_t submit(InstanceBatch& batch, const float viewProjection[16]);
+
+            /** culls against the current projection and modelview matrix, call from a camera handle's render() */
+            std::size_t submit(InstanceBatch& batch);
+
+            /** number of tree builds, including rebuilds after refitting degraded the tree */
+            unsigned long long builds() const {
+                return m_builds;
+            }
+
+        protected:
+
+            struct Object {
+                InstanceBatch::Shape shape;
+                float pose[16];
+                float scale[3];
+                float color[4];
+                float min[3];
+                float max[3];
+                int leaf;
+                bool alive;
+            };
+
+            struct Node {
+                float min[3];
+                float max[3];
+                int parent;
+                // children of inner nodes, the left child directly follows its parent
+                int right;
+                // range of m_order referenced by a leaf, count is 0 for inner nodes
+                unsigned int first;
+                unsigned int count;
+                bool dirty;
+            };
+
+            struct CentreLess;
+
+            void update_bounds(Object& object);
+            void mark_dirty(int leaf);
+            void build();
+            int build_node(unsigned int first, unsigned int count, int parent);
+            void refit();
+            void refit_node(Node& node);
+            void update_tree();
+            void collect(int node, const float planes[6][4], unsigned int mask, std::vector< ObjectId >& visible);
+            void collect_all(int node, std::vector< ObjectId >& visible);
+
+            static float surface_area(const Node& node);
+
+            boost::mutex m_mutex;
+            std::vector< Object > m_objects;
+            std::vector< ObjectId > m_freeIds;
+            std::size_t m_liveCount;
+
+            std::vector< Node > m_nodes;
+            std::vector< ObjectId > m_order;
+            std::vector< int > m_dirtyNodes;
+            bool m_bRebuild;
+
+            // summed surface area of all nodes, at the last build and now
+            double m_buildCost;
+            double m_cost;
+            unsigned long long m_builds;
+        };
+
+    }
+}
+
+#endif //UBITRACK_UTSCENEINDEX_H
@@ -0,0 +1,296 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+#include "utShaderManager.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <vector>
+#include <boost/scoped_ptr.hpp>
+#include <boost/filesystem.hpp>
+
+#include <log4cpp/Category.hh>
+
+using namespace Ubitrack;
+using namespace Ubitrack::Visualization;
+
+static log4cpp::Category& logger(log4cpp::Category::getInstance("utVisualization.ShaderManager"));
+
+// the singleton shader manager object
+static boost::scoped_ptr< ShaderManager > g_pShaderManager;
+
+// identifies program binary files written by this class
+static const char g_binaryMagic[4] = { 'U', 'T', 'P', 'B' };
+
+
+namespace {
+
+    unsigned long long fnv1a(const std::string& data, unsigned long long h = 14695981039346656037ULL) {
+        for (std::string::const_iterator it = data.begin(); it != data.end(); ++it) {
+            h ^= static_cast< unsigned char >(*it);
+            h *= 1099511628211ULL;
+        }
+        return h;
+    }
+
+    std::string glString(GLenum name) {
+        const GLubyte* s = glGetString(name);
+        return s ? std::string(reinterpret_cast< const char* >(s)) : std::string();
+    }
+
+    bool supportsProgramBinary() {
+        if (!hasGLVersion(4, 1) && !hasGLExtension("GL_ARB_get_program_binary"))
+            return false;
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        return formats > 0;
+    }
+
+}
+
+
+ShaderManager& ShaderManager::singleton()
+{
+    // prevent from race condition
+    static boost::mutex singletonMutex;
+    boost::mutex::scoped_lock l( singletonMutex );
+
+    // create a new singleton if necessary
+    if ( !g_pShaderManager )
+        g_pShaderManager.reset( new ShaderManager() );
+
+    return *g_pShaderManager;
+}
+
+ShaderManager::ShaderManager()
+        : m_binaryHits(0)
+        , m_compilations(0)
+{
+}
+
+ShaderManager::~ShaderManager() {
+    // programs die with their contexts
+}
+
+void ShaderManager::set_cache_directory(const std::string& directory) {
+    boost::mutex::scoped_lock lock( m_mutex );
+    m_cacheDirectory = directory;
+    if (directory.empty())
+        return;
+
+    boost::system::error_code ec;
+    boost::filesystem::create_directories(directory, ec);
+    if (ec) {
+        LOG4CPP_WARN(logger, "Cannot create shader cache directory " << directory << ": " << ec.message());
+        m_cacheDirectory.clear();
+    }
+}
+
+std::string ShaderManager::cache_directory() {
+    boost::mutex::scoped_lock lock( m_mutex );
+    return m_cacheDirectory;
+}
+
+void ShaderManager::register_program(const std::string& name, const std::string& vertexSource, const std::string& fragmentSource) {
+    boost::mutex::scoped_lock lock( m_mutex );
+    Source& source = m_sources[name];
+    source.vertex = vertexSource;
+    source.fragment = fragmentSource;
+}
+
+GLuint ShaderManager::program(const std::string& name, const std::string& vertexSource, const std::string& fragmentSource, void* share_group) {
+    register_program(name, vertexSource, fragmentSource);
+    return program(name, share_group);
+}
+
+GLuint ShaderManager::program(const std::string& name, void* share_group) {
+    boost::mutex::scoped_lock lock( m_mutex );
+    std::map< std::string, GLuint >& programs = m_programs[share_group];
+    std::map< std::string, GLuint >::iterator it = programs.find(name);
+    if (it != programs.end())
+        return it->second;
+
+    std::map< std::string, Source >::iterator source = m_sources.find(name);
+    if (source == m_sources.end()) {
+        LOG4CPP_ERROR(logger, "Unknown shader program " << name);
+        return 0;
+    }
+
+    bool fromBinary = false;
+    GLuint id = build(name, source->second, m_cacheDirectory, fromBinary);
+    (fromBinary ? m_binaryHits : m_compilations)++;
+    programs[name] = id;
+    return id;
+}
+
+void ShaderManager::warm_up(void* share_group) {
+    // build without holding the lock, render threads keep looking up their programs meanwhile
+    std::map< std::string, Source > missing;
+    std::string cacheDirectory;
+    {
+        boost::mutex::scoped_lock lock( m_mutex );
+        std::map< std::string, GLuint >& programs = m_programs[share_group];
+        for (std::map< std::string, Source >::iterator it = m_sources.begin(); it != m_sources.end(); ++it) {
+            if (programs.find(it->first) == programs.end())
+                missing.insert(*it);
+        }
+        cacheDirectory = m_cacheDirectory;
+    }
+
+    std::map< std::string, GLuint > built;
+    unsigned int binaryHits = 0;
+    unsigned int compilations = 0;
+    for (std::map< std::string, Source >::iterator it = missing.begin(); it != missing.end(); ++it) {
+        bool fromBinary = false;
+        built[it->first] = build(it->first, it->second, cacheDirectory, fromBinary);
+        (fromBinary ? binaryHits : compilations)++;
+    }
+    // other contexts of the share group may only use the programs once they are complete
+    glFinish();
+
+    boost::mutex::scoped_lock lock( m_mutex );
+    m_binaryHits += binaryHits;
+    m_compilations += compilations;
+    std::map< std::string, GLuint >& programs = m_programs[share_group];
+    for (std::map< std::string, GLuint >::iterator it = built.begin(); it != built.end(); ++it) {
+        // a render thread built the same program in the meantime, keep the one in use
+        if (!programs.insert(*it).second && it->second != 0)
+            glDeleteProgram(it->second);
+    }
+}
+
+void ShaderManager::drop_share_group(void* share_group) {
+    boost::mutex::scoped_lock lock( m_mutex );
+    m_programs.erase(share_group);
+}
+
+unsigned int ShaderManager::binary_hits() {
+    boost::mutex::scoped_lock lock( m_mutex );
+    return m_binaryHits;
+}
+
+unsigned int ShaderManager::compilations() {
+    boost::mutex::scoped_lock lock( m_mutex );
+    return m_compilations;
+}
+
+std::string ShaderManager::binary_path(const Source& source, const std::string& cacheDirectory) {
+    // binaries are only valid for the same driver and sources
+    unsigned long long key = fnv1a(glString(GL_VENDOR));
+    key = fnv1a(glString(GL_RENDERER), key);
+    key = fnv1a(glString(GL_VERSION), key);
+    key = fnv1a(source.vertex, key);
+    key = fnv1a(source.fragment, key);
+
+    char name[32];
+    std::sprintf(name, "%016llx.bin", key);
+    return (boost::filesystem::path(cacheDirectory) / name).string();
+}
+
+GLuint ShaderManager::build(const std::string& name, const Source& source, const std::string& cacheDirectory, bool& fromBinary) {
+    // touches no members, callers count hits and compilations under m_mutex
+    fromBinary = false;
+    bool binaries = !cacheDirectory.empty() && supportsProgramBinary();
+    std::string path;
+    if (binaries) {
+        path = binary_path(source, cacheDirectory);
+        GLuint program = load_binary(path);
+        if (program != 0) {
+            LOG4CPP_DEBUG(logger, "Loaded program " << name << " from " << path);
+            fromBinary = true;
+            return program;
+        }
+    }
+
+    std::string log;
+    GLuint program = compileGLProgram(source.vertex.c_str(), source.fragment.c_str(), log, binaries);
+    if (program == 0) {
+        LOG4CPP_ERROR(logger, "Cannot build program " << name << ": " << log);
+        return 0;
+    }
+    LOG4CPP_DEBUG(logger, "Compiled program " << name);
+
+    if (binaries)
+        store_binary(path, program);
+    return program;
+}
+
+GLuint ShaderManager::load_binary(const std::string& path) {
+    std::ifstream file(path.c_str(), std::ios::in | std::ios::binary);
+    if (!file)
+        return 0;
+
+    char magic[4];
+    GLenum format = 0;
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast< char* >(&format), sizeof(format));
+    if (!file || std::string(magic, 4) != std::string(g_binaryMagic, 4))
+        return 0;
+    std::vector< char > binary((std::istreambuf_iterator< char >(file)), std::istreambuf_iterator< char >());
+    if (binary.empty())
+        return 0;
+
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, format, &binary[0], static_cast< GLsizei >(binary.size()));
+    GLint status = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (status != GL_TRUE) {
+        // e.g. after a driver update that did not change the version string
+        LOG4CPP_INFO(logger, "Discarding stale program binary " << path);
+        glDeleteProgram(program);
+        boost::system::error_code ec;
+        boost::filesystem::remove(path, ec);
+        return 0;
+    }
+    return program;
+}
+
+void ShaderManager::store_binary(const std::string& path, GLuint program) {
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+
+    std::vector< char > binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(program, length, NULL, &format, &binary[0]);
+
+    // write to a temporary file first so concurrent starts never read a partial binary
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream file(tmp.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+        file.write(g_binaryMagic, sizeof(g_binaryMagic));
+        file.write(reinterpret_cast< const char* >(&format), sizeof(format));
+        file.write(&binary[0], length);
+        if (!file) {
+            LOG4CPP_WARN(logger, "Cannot write program binary " << tmp);
+            return;
+        }
+    }
+    boost::system::error_code ec;
+    boost::filesystem::rename(tmp, path, ec);
+    if (ec)
+        LOG4CPP_WARN(logger, "Cannot store program binary " << path << ": " << ec.message());
+}
@@ -0,0 +1,109 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @ingroup visualization
+ * @file
+ * Compiles GLSL programs once per share group and caches their binaries on disk.
+ *
+ * Linked programs are stored with glGetProgramBinary in a cache directory,
+ * keyed by GL vendor, renderer, version and a hash of the sources, and loaded
+ * with glProgramBinary on later startups. Programs registered up front can be
+ * built on a background context of the share group while the dataflow starts.
+ */
+
+#ifndef UBITRACK_UTSHADERMANAGER_H
+#define UBITRACK_UTSHADERMANAGER_H
+
+#include <string>
+#include <map>
+#include <boost/thread/mutex.hpp>
+
+#include <utVisualization/Config.h>
+#include <utVisualization/utOpenGL.h>
+
+namespace Ubitrack {
+    namespace Visualization {
+
+        class UBITRACK_EXPORT ShaderManager {
+
+        public:
+            ShaderManager();
+            ~ShaderManager();
+
+            /** directory for program binaries, an empty string disables the disk cache */
+            void set_cache_directory(const std::string& directory);
+            std::string cache_directory();
+
+            /** make a program known so warm_up() can build it before it is first used */
+            void register_program(const std::string& name, const std::string& vertexSource, const std::string& fragmentSource);
+
+            /**
+             * returns the program for the share group, building it on first use.
+             * Must be called with a context of the share group current. Returns 0 if building fails.
+             */
+            GLuint program(const std::string& name, const std::string& vertexSource, const std::string& fragmentSource, void* share_group);
+
+            /** returns a registered program, 0 if it is unknown or cannot be built */
+            GLuint program(const std::string& name, void* share_group);
+
+            /**
+             * builds all registered programs for the share group, e.g. from a background thread
+             * with a hidden context of the share group current.
+             */
+            void warm_up(void* share_group);
+
+            /** forget the programs of a share group whose last context has been destroyed */
+            void drop_share_group(void* share_group);
+
+            /** number of programs loaded from the disk cache and built from source */
+            unsigned int binary_hits();
+            unsigned int compilations();
+
+            /** get the process-wide shader manager */
+            static ShaderManager& singleton();
+
+        private:
+
+            struct Source {
+                std::string vertex;
+                std::string fragment;
+            };
+
+            GLuint build(const std::string& name, const Source& source, const std::string& cacheDirectory, bool& fromBinary);
+            GLuint load_binary(const std::string& path);
+            void store_binary(const std::string& path, GLuint program);
+            std::string binary_path(const Source& source, const std::string& cacheDirectory);
+
+            std::map< std::string, Source > m_sources;
+            std::map< void*, std::map< std::string, GLuint > > m_programs;
+            std::string m_cacheDirectory;
+            unsigned int m_binaryHits;
+            unsigned int m_compilations;
+            boost::mutex m_mutex;
+        };
+
+    }
+}
+
+#endif //UBITRACK_UTSHADERMANAGER_H
@@ -0,0 +1,433 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+#include "utSharedFrameRing.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <new>
+#include <sstream>
+
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/interprocess/exceptions.hpp>
+
+#include <log4cpp/Category.hh>
+
+using namespace Ubitrack;
+using namespace Ubitrack::Visualization;
+namespace ipc = boost::interprocess;
+
+static log4cpp::Category& logger(log4cpp::Category::getInstance("utVisualization.SharedFrameRing"));
+
+// both processes must agree on the layout, bump the version when it changes
+static const unsigned int g_ringMagic = 0x55545246;
+static const unsigned int g_registryMagic = 0x55545252;
+static const unsigned int g_layoutVersion = 1;
+
+static const char* g_registryName = "ubitrack_render_registry";
+
+
+// the atomics live in memory shared by two processes, a lock based implementation would only lock within one of them
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "std::atomic< unsigned long long > must be lock free for shared memory");
+static_assert(ATOMIC_INT_LOCK_FREE == 2, "std::atomic< unsigned int > must be lock free for shared memory");
+
+
+namespace {
+
+    struct RingHeader {
+        unsigned int magic;
+        unsigned int version;
+        unsigned int slotCount;
+        unsigned int reserved;
+        unsigned long long slotStride;
+        unsigned long long maxImageBytes;
+        std::atomic< unsigned long long > published;
+    };
+
+    struct SlotHeader {
+        // odd while the writer fills the slot
+        std::atomic< unsigned long long > sequence;
+        SharedFrameRing::Frame frame;
+    };
+
+    enum EntryState {
+        ENTRY_FREE = 0,
+        ENTRY_WRITING,
+        ENTRY_ACTIVE
+    };
+
+    struct RegistryEntry {
+        std::atomic< unsigned int > state;
+        std::atomic< unsigned int > generation;
+        int width;
+        int height;
+        char ring[SharedFrameRegistry::MAX_NAME_LENGTH + 1];
+        char title[SharedFrameRegistry::MAX_NAME_LENGTH + 1];
+    };
+
+    struct RegistryHeader {
+        unsigned int magic;
+        unsigned int version;
+        RegistryEntry entries[SharedFrameRegistry::MAX_ENTRIES];
+    };
+
+    std::size_t align(std::size_t size) {
+        return (size + 63) & ~static_cast< std::size_t >(63);
+    }
+
+    void copy_name(char* target, const std::string& source) {
+        std::size_t length = std::min< std::size_t >(source.size(), SharedFrameRegistry::MAX_NAME_LENGTH);
+        std::memcpy(target, source.data(), length);
+        target[length] = '\0';
+    }
+
+}
+
+
+SharedFrameRing::Frame::Frame()
+        : timestamp(0)
+        , width(0)
+        , height(0)
+        , channels(0)
+        , poseCount(0)
+        , hasProjection(0)
+{
+    std::memset(poses, 0, sizeof(poses));
+    std::memset(projection, 0, sizeof(projection));
+}
+
+std::size_t SharedFrameRing::Frame::image_bytes() const {
+    return static_cast< std::size_t >(width) * height * channels;
+}
+
+
+SharedFrameRing::SharedFrameRing(const std::string& name)
+        : m_name(name)
+        , m_bOwner(false)
+{
+}
+
+SharedFrameRing::~SharedFrameRing() {
+    m_pRegion.reset();
+    m_pMemory.reset();
+    if (m_bOwner)
+        remove(m_name);
+}
+
+boost::shared_ptr< SharedFrameRing > SharedFrameRing::create(const std::string& name, unsigned int slotCount, std::size_t maxImageBytes) {
+    boost::shared_ptr< SharedFrameRing > ring(new SharedFrameRing(name));
+    if (slotCount < 3)
+        slotCount = 3;
+    std::size_t stride = align(sizeof(SlotHeader) + maxImageBytes);
+    std::size_t size = align(sizeof(RingHeader)) + slotCount * stride;
+
+    try {
+        // a ring left behind by a crashed writer is replaced, readers notice through the registry generation
+        ipc::shared_memory_object::remove(name.c_str());
+        ring->m_pMemory.reset(new ipc::shared_memory_object(ipc::create_only, name.c_str(), ipc::read_write));
+        ring->m_pMemory->truncate(size);
+        ring->m_pRegion.reset(new ipc::mapped_region(*ring->m_pMemory, ipc::read_write));
+    }
+    catch (ipc::interprocess_exception& e) {
+        LOG4CPP_ERROR(logger, "Cannot create shared frame ring " << name << ": " << e.what());
+        return boost::shared_ptr< SharedFrameRing >();
+    }
+    ring->m_bOwner = true;
+
+    unsigned char* base = static_cast< unsigned char* >(ring->m_pRegion->get_address());
+    RingHeader* header = new (base) RingHeader;
+    header->slotCount = slotCount;
+    header->reserved = 0;
+    header->slotStride = stride;
+    header->maxImageBytes = maxImageBytes;
+    header->published.store(0);
+    for (unsigned int i = 0; i < slotCount; i++) {
+        SlotHeader* slot = new (base + align(sizeof(RingHeader)) + i * stride) SlotHeader;
+        slot->sequence.store(0);
+    }
+    // readers check the magic last
+    header->version = g_layoutVersion;
+    std::atomic_thread_fence(std::memory_order_release);
+    header->magic = g_ringMagic;
+
+    LOG4CPP_INFO(logger, "Created shared frame ring " << name << " with " << slotCount << " slots of " << maxImageBytes << " bytes");
+    return ring;
+}
+
+boost::shared_ptr< SharedFrameRing > SharedFrameRing::open(const std::string& name) {
+    boost::shared_ptr< SharedFrameRing > ring(new SharedFrameRing(name));
+    try {
+        ring->m_pMemory.reset(new ipc::shared_memory_object(ipc::open_only, name.c_str(), ipc::read_write));
+        ring->m_pRegion.reset(new ipc::mapped_region(*ring->m_pMemory, ipc::read_write));
+    }
+    catch (ipc::interprocess_exception&) {
+        return boost::shared_ptr< SharedFrameRing >();
+    }
+
+    const RingHeader* header = static_cast< const RingHeader* >(ring->m_pRegion->get_address());
+    if (ring->m_pRegion->get_size() < sizeof(RingHeader) || header->magic != g_ringMagic || header->version != g_layoutVersion ||
+        ring->m_pRegion->get_size() < align(sizeof(RingHeader)) + header->slotCount * header->slotStride) {
+        LOG4CPP_WARN(logger, "Shared frame ring " << name << " has an incompatible layout");
+        return boost::shared_ptr< SharedFrameRing >();
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return ring;
+}
+
+void SharedFrameRing::remove(const std::string& name) {
+    ipc::shared_memory_object::remove(name.c_str());
+}
+
+unsigned char* SharedFrameRing::slot(unsigned long long frameNumber) {
+    unsigned char* base = static_cast< unsigned char* >(m_pRegion->get_address());
+    const RingHeader* header = reinterpret_cast< const RingHeader* >(base);
+    return base + align(sizeof(RingHeader)) + (frameNumber % header->slotCount) * header->slotStride;
+}
+
+bool SharedFrameRing::publish(const Frame& frame, const void* pixels) {
+    RingHeader* header = static_cast< RingHeader* >(m_pRegion->get_address());
+    std::size_t bytes = frame.image_bytes();
+    if (bytes > header->maxImageBytes) {
+        LOG4CPP_WARN(logger, "Image of " << bytes << " bytes does not fit into shared frame ring " << m_name);
+        return false;
+    }
+
+    unsigned long long frameNumber = header->published.load(std::memory_order_relaxed);
+    unsigned char* data = slot(frameNumber);
+    SlotHeader* slotHeader = reinterpret_cast< SlotHeader* >(data);
+
+    unsigned long long sequence = slotHeader->sequence.load(std::memory_order_relaxed);
+    slotHeader->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slotHeader->frame = frame;
+    if (bytes > 0)
+        std::memcpy(data + sizeof(SlotHeader), pixels, bytes);
+    slotHeader->sequence.store(sequence + 2, std::memory_order_release);
+
+    header->published.store(frameNumber + 1, std::memory_order_release);
+    return true;
+}
+
+unsigned long long SharedFrameRing::read_latest(Frame& frame, std::vector< unsigned char >& pixels, unsigned long long after) {
+    RingHeader* header = static_cast< RingHeader* >(m_pRegion->get_address());
+    unsigned long long published = header->published.load(std::memory_order_acquire);
+    if (published == 0 || published <= after)
+        return 0;
+
+    unsigned char* data = slot(published - 1);
+    SlotHeader* slotHeader = reinterpret_cast< SlotHeader* >(data);
+    unsigned long long sequence = slotHeader->sequence.load(std::memory_order_acquire);
+    if (sequence & 1)
+        return 0;
+
+    // the writer may fill the slot again while we copy, frame is only assigned once the sequence is confirmed
+    Frame copy = slotHeader->frame;
+    if (copy.poseCount > MAX_POSES)
+        copy.poseCount = MAX_POSES;
+    copy.channels = (copy.channels <= 1) ? 1 : ((copy.channels <= 3) ? 3 : 4);
+    if (copy.height != 0 && copy.width > header->maxImageBytes / copy.height / copy.channels)
+        return 0;
+    std::size_t bytes = copy.image_bytes();
+    pixels.resize(bytes);
+    if (bytes > 0)
+        std::memcpy(&pixels[0], data + sizeof(SlotHeader), bytes);
+
+    // the writer lapped the ring while we copied
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slotHeader->sequence.load(std::memory_order_relaxed) != sequence)
+        return 0;
+    frame = copy;
+    return published;
+}
+
+unsigned long long SharedFrameRing::published() {
+    return static_cast< RingHeader* >(m_pRegion->get_address())->published.load(std::memory_order_acquire);
+}
+
+std::size_t SharedFrameRing::max_image_bytes() const {
+    return static_cast< std::size_t >(static_cast< const RingHeader* >(m_pRegion->get_address())->maxImageBytes);
+}
+
+
+SharedFrameRegistry::SharedFrameRegistry() {
+}
+
+SharedFrameRegistry::~SharedFrameRegistry() {
+    // the registry outlives both processes, entries are removed by their writers
+}
+
+boost::shared_ptr< SharedFrameRegistry > SharedFrameRegistry::open(bool create) {
+    boost::shared_ptr< SharedFrameRegistry > registry(new SharedFrameRegistry());
+    bool created = false;
+    try {
+        if (create) {
+            try {
+                registry->m_pMemory.reset(new ipc::shared_memory_object(ipc::create_only, g_registryName, ipc::read_write));
+                registry->m_pMemory->truncate(sizeof(RegistryHeader));
+                created = true;
+            }
+            catch (ipc::interprocess_exception&) {
+                registry->m_pMemory.reset(new ipc::shared_memory_object(ipc::open_only, g_registryName, ipc::read_write));
+            }
+        } else {
+            registry->m_pMemory.reset(new ipc::shared_memory_object(ipc::open_only, g_registryName, ipc::read_write));
+        }
+        registry->m_pRegion.reset(new ipc::mapped_region(*registry->m_pMemory, ipc::read_write));
+    }
+    catch (ipc::interprocess_exception& e) {
+        if (create) {
+            LOG4CPP_ERROR(logger, "Cannot open the render registry: " << e.what());
+        }
+        return boost::shared_ptr< SharedFrameRegistry >();
+    }
+
+    RegistryHeader* header = static_cast< RegistryHeader* >(registry->m_pRegion->get_address());
+    if (created) {
+        for (unsigned int i = 0; i < MAX_ENTRIES; i++) {
+            RegistryEntry* entry = new (&header->entries[i]) RegistryEntry;
+            entry->state.store(ENTRY_FREE);
+            entry->generation.store(0);
+        }
+        header->version = g_layoutVersion;
+        std::atomic_thread_fence(std::memory_order_release);
+        header->magic = g_registryMagic;
+    }
+    else if (registry->m_pRegion->get_size() < sizeof(RegistryHeader) || header->magic != g_registryMagic || header->version != g_layoutVersion) {
+        LOG4CPP_WARN(logger, "The render registry has an incompatible layout");
+        return boost::shared_ptr< SharedFrameRegistry >();
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return registry;
+}
+
+bool SharedFrameRegistry::add(const std::string& ring, const std::string& title, int width, int height) {
+    RegistryHeader* header = static_cast< RegistryHeader* >(m_pRegion->get_address());
+
+    // claim the entry of the same ring left by an earlier run, or a free one
+    RegistryEntry* claimed = NULL;
+    for (unsigned int i = 0; i < MAX_ENTRIES && !claimed; i++) {
+        unsigned int active = ENTRY_ACTIVE;
+        if (std::strncmp(header->entries[i].ring, ring.c_str(), MAX_NAME_LENGTH) == 0 &&
+            header->entries[i].state.compare_exchange_strong(active, ENTRY_WRITING))
+            claimed = &header->entries[i];
+    }
+    // titles that map to the same ring name must not take over each other's ring
+    if (claimed && std::strncmp(claimed->title, title.c_str(), MAX_NAME_LENGTH) != 0) {
+        LOG4CPP_ERROR(logger, "Ring " << ring << " is announced for camera " << claimed->title << ", cannot announce it for " << title);
+        claimed->state.store(ENTRY_ACTIVE, std::memory_order_release);
+        return false;
+    }
+    for (unsigned int i = 0; i < MAX_ENTRIES && !claimed; i++) {
+        unsigned int free = ENTRY_FREE;
+        if (header->entries[i].state.compare_exchange_strong(free, ENTRY_WRITING))
+            claimed = &header->entries[i];
+    }
+    if (!claimed) {
+        LOG4CPP_ERROR(logger, "The render registry is full, cannot announce " << ring);
+        return false;
+    }
+
+    copy_name(claimed->ring, ring);
+    copy_name(claimed->title, title);
+    claimed->width = width;
+    claimed->height = height;
+    claimed->generation.fetch_add(1, std::memory_order_relaxed);
+    claimed->state.store(ENTRY_ACTIVE, std::memory_order_release);
+    return true;
+}
+
+void SharedFrameRegistry::remove(const std::string& ring) {
+    RegistryHeader* header = static_cast< RegistryHeader* >(m_pRegion->get_address());
+    for (unsigned int i = 0; i < MAX_ENTRIES; i++) {
+        unsigned int active = ENTRY_ACTIVE;
+        if (std::strncmp(header->entries[i].ring, ring.c_str(), MAX_NAME_LENGTH) == 0 &&
+            header->entries[i].state.compare_exchange_strong(active, ENTRY_WRITING)) {
+            header->entries[i].ring[0] = '\0';
+            header->entries[i].state.store(ENTRY_FREE, std::memory_order_release);
+        }
+    }
+}
+
+void SharedFrameRegistry::list(std::vector< Entry >& entries) {
+    RegistryHeader* header = static_cast< RegistryHeader* >(m_pRegion->get_address());
+    entries.clear();
+    for (unsigned int i = 0; i < MAX_ENTRIES; i++) {
+        RegistryEntry& shared = header->entries[i];
+        unsigned int generation = shared.generation.load(std::memory_order_acquire);
+        if (shared.state.load(std::memory_order_acquire) != ENTRY_ACTIVE)
+            continue;
+
+        Entry entry;
+        char name[MAX_NAME_LENGTH + 1];
+        std::memcpy(name, shared.ring, sizeof(name));
+        name[MAX_NAME_LENGTH] = '\0';
+        entry.ring = name;
+        std::memcpy(name, shared.title, sizeof(name));
+        name[MAX_NAME_LENGTH] = '\0';
+        entry.title = name;
+        entry.width = shared.width;
+        entry.height = shared.height;
+        entry.generation = generation;
+
+        // skip entries rewritten while we copied, they are picked up on the next poll
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (shared.state.load(std::memory_order_relaxed) == ENTRY_ACTIVE && shared.generation.load(std::memory_order_relaxed) == generation)
+            entries.push_back(entry);
+    }
+}
+
+std::string SharedFrameRegistry::ring_name(const std::string& title) {
+    // shared memory names allow no path separators or spaces on all platforms
+    std::string name = "ubitrack_render_";
+    for (std::string::const_iterator it = title.begin(); it != title.end(); ++it) {
+        char c = *it;
+        bool plain = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '-';
+        name += plain ? c : '_';
+    }
+    return name.substr(0, MAX_NAME_LENGTH);
+}
+
+std::string SharedFrameRegistry::unique_ring_name(const std::string& title) {
+    std::string base = ring_name(title);
+    std::string announced = title.substr(0, MAX_NAME_LENGTH);
+    std::vector< Entry > entries;
+    list(entries);
+
+    // at most one candidate per entry can be taken
+    std::string name = base;
+    for (unsigned int n = 2; n <= MAX_ENTRIES + 1; n++) {
+        bool taken = false;
+        for (std::size_t i = 0; i < entries.size() && !taken; i++)
+            taken = entries[i].ring == name && entries[i].title != announced;
+        if (!taken)
+            break;
+        std::ostringstream suffix;
+        suffix << "_" << n;
+        name = base.substr(0, MAX_NAME_LENGTH - suffix.str().size()) + suffix.str();
+    }
+    if (name != base)
+        LOG4CPP_INFO(logger, "Camera " << title << " publishes through " << name << ", " << base << " is used by another camera");
+    return name;
+}
@@ -0,0 +1,169 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @ingroup visualization
+ * @file
+ * Shared memory channel between a dataflow process and a render server.
+ *
+ * A SharedFrameRing carries the images and poses of one camera from the
+ * dataflow process to the render server. It has a single writer, which never
+ * waits: every slot is guarded by a sequence number that is odd while the
+ * slot is written, and a reader that finds a slot changed under it simply
+ * tries again with the next frame. Neither side holds a lock in shared
+ * memory, so a crash or restart of one process never blocks the other.
+ *
+ * The SharedFrameRegistry lists the rings published by the dataflow process,
+ * the render server polls it to open and close its windows.
+ */
+
+#ifndef UBITRACK_UTSHAREDFRAMERING_H
+#define UBITRACK_UTSHAREDFRAMERING_H
+
+#include <string>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include <utVisualization/Config.h>
+
+namespace boost {
+    namespace interprocess {
+        class shared_memory_object;
+        class mapped_region;
+    }
+}
+
+namespace Ubitrack {
+    namespace Visualization {
+
+        class UBITRACK_EXPORT SharedFrameRing {
+
+        public:
+            static const unsigned int MAX_POSES = 16;
+
+            /** metadata of a published frame, the pixels follow it in the slot */
+            struct Frame {
+                unsigned long long timestamp;
+                /** tightly packed 8 bit image, a width of 0 publishes poses only and keeps the last image */
+                unsigned int width;
+                unsigned int height;
+                unsigned int channels;
+                unsigned int poseCount;
+                /** column major 4x4 model view matrices */
+                float poses[MAX_POSES][16];
+                /** column major projection matrix, only valid if hasProjection is set */
+                float projection[16];
+                unsigned int hasProjection;
+
+                Frame();
+                std::size_t image_bytes() const;
+            };
+
+            ~SharedFrameRing();
+
+            /** creates a ring for the writer, replacing a stale ring of the same name, empty on failure */
+            static boost::shared_ptr< SharedFrameRing > create(const std::string& name, unsigned int slotCount, std::size_t maxImageBytes);
+
+            /** opens an existing ring for reading, empty if it does not exist or has a different layout */
+            static boost::shared_ptr< SharedFrameRing > open(const std::string& name);
+
+            static void remove(const std::string& name);
+
+            /** writer only, never waits. Returns false if the image does not fit into a slot */
+            bool publish(const Frame& frame, const void* pixels);
+
+            /**
+             * reader, copies the newest frame if it was published after the frame number given in after.
+             * Returns the number of the frame read, or 0 if there is no new frame or it was overwritten while copying.
+             */
+            unsigned long long read_latest(Frame& frame, std::vector< unsigned char >& pixels, unsigned long long after);
+
+            /** number of frames published so far */
+            unsigned long long published();
+
+            std::size_t max_image_bytes() const;
+
+            const std::string& name() const {
+                return m_name;
+            }
+
+        protected:
+            SharedFrameRing(const std::string& name);
+
+            unsigned char* slot(unsigned long long frameNumber);
+
+            std::string m_name;
+            boost::scoped_ptr< boost::interprocess::shared_memory_object > m_pMemory;
+            boost::scoped_ptr< boost::interprocess::mapped_region > m_pRegion;
+            bool m_bOwner;
+        };
+
+
+        class UBITRACK_EXPORT SharedFrameRegistry {
+
+        public:
+            static const unsigned int MAX_ENTRIES = 32;
+            static const unsigned int MAX_NAME_LENGTH = 63;
+
+            struct Entry {
+                std::string ring;
+                std::string title;
+                int width;
+                int height;
+                /** changes whenever the ring is created again, readers must reopen it */
+                unsigned int generation;
+            };
+
+            ~SharedFrameRegistry();
+
+            /** the registry of this machine, created by the dataflow process, empty if it does not exist yet */
+            static boost::shared_ptr< SharedFrameRegistry > open(bool create);
+
+            /**
+             * announces a ring, replacing an entry of the same ring name and title.
+             * Returns false if the registry is full or another camera announced the ring.
+             */
+            bool add(const std::string& ring, const std::string& title, int width, int height);
+            void remove(const std::string& ring);
+
+            /** the rings currently announced */
+            void list(std::vector< Entry >& entries);
+
+            /** shared memory name of the ring of a camera */
+            static std::string ring_name(const std::string& title);
+
+            /** ring_name(), with a numbered suffix if the name is announced for a camera of another title */
+            std::string unique_ring_name(const std::string& title);
+
+        protected:
+            SharedFrameRegistry();
+
+            boost::scoped_ptr< boost::interprocess::shared_memory_object > m_pMemory;
+            boost::scoped_ptr< boost::interprocess::mapped_region > m_pRegion;
+        };
+
+    }
+}
+
+#endif //UBITRACK_UTSHAREDFRAMERING_H
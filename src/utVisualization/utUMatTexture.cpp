@@ -0,0 +1,352 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+#include "utUMatTexture.h"
+#include "utGLStateCache.h"
+
+// defines HAVE_OPENCL when utVision is built with OpenCL
+#include <utVision/OpenCLManager.h>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#ifdef HAVE_OPENCL
+#include <opencv2/core/ocl.hpp>
+#ifdef __APPLE__
+#include "OpenCL/cl_gl.h"
+#else
+#include "CL/cl_gl.h"
+#endif
+#endif
+
+#include <log4cpp/Category.hh>
+
+using namespace Ubitrack;
+using namespace Ubitrack::Visualization;
+
+static log4cpp::Category& logger(log4cpp::Category::getInstance("utVisualization.UMatTexture"));
+
+
+namespace {
+
+    // texture and pixel transfer format of the pixel buffer path
+    bool pixelFormat(int type, GLenum& internalFormat, GLenum& format) {
+        switch (type) {
+            case CV_8UC1:
+                internalFormat = GL_LUMINANCE8;
+                format = GL_LUMINANCE;
+                return true;
+            case CV_8UC3:
+                internalFormat = GL_RGB8;
+                format = GL_BGR;
+                return true;
+            case CV_8UC4:
+                internalFormat = GL_RGBA8;
+                format = GL_BGRA;
+                return true;
+            default:
+                return false;
+        }
+    }
+
+}
+
+
+UMatTexture::UMatTexture()
+        : m_pShareGroup(NULL)
+        , m_bInteropEnabled(true)
+        , m_bInteropFailed(false)
+        , m_width(0)
+        , m_height(0)
+        , m_type(-1)
+        , m_path(PATH_NONE)
+        , m_clImage(NULL)
+        , m_bImplicitSync(false)
+        , m_pixelBuffer(0)
+        , m_frameSize(0)
+        , m_pMapped(NULL)
+        , m_segment(0)
+{
+    for (unsigned int i = 0; i < RING_SEGMENTS; i++)
+        m_fences[i] = 0;
+}
+
+UMatTexture::~UMatTexture() {
+    // GL resources must be released explicitly with release_gl(), the context may be gone here
+}
+
+void UMatTexture::set_resource_owner(void* share_group, const std::string& owner) {
+    m_pShareGroup = share_group;
+    m_sOwner = owner;
+}
+
+void UMatTexture::set_interop_enabled(bool enabled) {
+    m_bInteropEnabled = enabled;
+}
+
+GLuint UMatTexture::texture() const {
+    return m_pTexture ? m_pTexture->id() : 0;
+}
+
+const char* UMatTexture::path_name(Path path) {
+    switch (path) {
+        case PATH_CL_GL:
+            return "cl_gl interop";
+        case PATH_PERSISTENT_PBO:
+            return "persistently mapped pixel buffer";
+        case PATH_STREAMING_PBO:
+            return "streamed pixel buffer";
+        default:
+            return "none";
+    }
+}
+
+void UMatTexture::select_path(Path path) {
+    if (path == m_path)
+        return;
+    m_path = path;
+    LOG4CPP_INFO(logger, "Texture for " << (m_sOwner.empty() ? "unnamed owner" : m_sOwner) << " is updated through " << path_name(path));
+}
+
+bool UMatTexture::update(const cv::UMat& image) {
+    if (image.empty() || image.depth() != CV_8U || (image.channels() != 1 && image.channels() != 3 && image.channels() != 4)) {
+        LOG4CPP_ERROR(logger, "Unsupported image for texture upload: type " << image.type());
+        return false;
+    }
+
+    if (image.cols != m_width || image.rows != m_height || image.type() != m_type) {
+        if (!allocate(image))
+            return false;
+    }
+
+    if (m_path == PATH_CL_GL) {
+        if (update_interop(image))
+            return true;
+        // the shared path failed at runtime, the pixel buffers take over for good
+        m_bInteropFailed = true;
+        if (!allocate(image))
+            return false;
+    }
+    return update_pixel_buffer(image);
+}
+
+bool UMatTexture::allocate(const cv::UMat& image) {
+    release_gl();
+    m_width = image.cols;
+    m_height = image.rows;
+    m_type = image.type();
+    void* shareGroup = m_pShareGroup ? m_pShareGroup : this;
+
+#ifdef HAVE_OPENCL
+    Vision::OpenCLManager& oclManager = Vision::OpenCLManager::singleton();
+    if (m_bInteropEnabled && !m_bInteropFailed && oclManager.isInitialized() && cv::ocl::useOpenCL()) {
+        cv::ocl::Device device = cv::ocl::Device::getDefault();
+        const std::string extensions = device.extensions();
+        if (extensions.find("cl_khr_gl_sharing") != std::string::npos || extensions.find("cl_APPLE_gl_sharing") != std::string::npos) {
+            // CL images of shared textures need four channels, the conversion happens on the device
+            m_pTexture = ResourcePool::singleton().acquire_texture(shareGroup, GL_RGBA8, m_width, m_height, m_sOwner);
+            cl_int err = CL_SUCCESS;
+            cl_context context = static_cast< cl_context >(cv::ocl::Context::getDefault().ptr());
+            m_clImage = clCreateFromGLTexture(context, CL_MEM_WRITE_ONLY, GL_TEXTURE_2D, 0, m_pTexture->id(), &err);
+            if (err == CL_SUCCESS && m_clImage != NULL) {
+                m_bImplicitSync = extensions.find("cl_khr_gl_event") != std::string::npos;
+                select_path(PATH_CL_GL);
+                return true;
+            }
+            // typically the CL context was created for a context outside this share group
+            LOG4CPP_WARN(logger, "Cannot share texture with OpenCL (error " << err << "), using pixel buffers");
+            m_clImage = NULL;
+            m_bInteropFailed = true;
+            m_pTexture.reset();
+        }
+    }
+#endif
+
+    GLenum internalFormat, format;
+    if (!pixelFormat(m_type, internalFormat, format))
+        return false;
+    m_pTexture = ResourcePool::singleton().acquire_texture(shareGroup, internalFormat, m_width, m_height, m_sOwner);
+    m_frameSize = static_cast< std::size_t >(m_width) * m_height * image.elemSize();
+
+    glGenBuffers(1, &m_pixelBuffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pixelBuffer);
+    if (hasGLVersion(4, 4) || (hasGLExtension("GL_ARB_buffer_storage") && hasGLVersion(3, 2))) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        GLsizeiptr size = static_cast< GLsizeiptr >(RING_SEGMENTS * m_frameSize);
+        glBufferStorage(GL_PIXEL_UNPACK_BUFFER, size, NULL, flags);
+        m_pMapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags);
+    }
+    if (m_pMapped != NULL) {
+        select_path(PATH_PERSISTENT_PBO);
+    } else {
+        // buffer storage is immutable, start over with a plain buffer
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glDeleteBuffers(1, &m_pixelBuffer);
+        glGenBuffers(1, &m_pixelBuffer);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pixelBuffer);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, m_frameSize, NULL, GL_STREAM_DRAW);
+        select_path(PATH_STREAMING_PBO);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    GLStateCache::invalidate_current(GLStateCache::STATE_BUFFERS);
+    m_segment = 0;
+    return true;
+}
+
+bool UMatTexture::update_interop(const cv::UMat& image) {
+#ifdef HAVE_OPENCL
+    cv::UMat rgba;
+    switch (image.channels()) {
+        case 1:
+            cv::cvtColor(image, rgba, cv::COLOR_GRAY2RGBA);
+            break;
+        case 3:
+            cv::cvtColor(image, rgba, cv::COLOR_BGR2RGBA);
+            break;
+        default:
+            cv::cvtColor(image, rgba, cv::COLOR_BGRA2RGBA);
+            break;
+    }
+    if (!rgba.isContinuous())
+        rgba = rgba.clone();
+
+    cl_command_queue queue = static_cast< cl_command_queue >(cv::ocl::Queue::getDefault().ptr());
+    cl_mem source = static_cast< cl_mem >(rgba.handle(cv::ACCESS_READ));
+    cl_mem target = static_cast< cl_mem >(m_clImage);
+
+    // GL must be done with the texture before CL writes it
+    if (m_bImplicitSync)
+        glFlush();
+    else
+        glFinish();
+
+    size_t origin[3] = { 0, 0, 0 };
+    size_t region[3] = { static_cast< size_t >(m_width), static_cast< size_t >(m_height), 1 };
+    cl_int err = clEnqueueAcquireGLObjects(queue, 1, &target, 0, NULL, NULL);
+    if (err == CL_SUCCESS) {
+        err = clEnqueueCopyBufferToImage(queue, source, target, rgba.offset, origin, region, 0, NULL, NULL);
+        cl_int releaseErr = clEnqueueReleaseGLObjects(queue, 1, &target, 0, NULL, NULL);
+        if (err == CL_SUCCESS)
+            err = releaseErr;
+    }
+    // the copy has to be complete before GL samples the texture
+    clFinish(queue);
+
+    if (err != CL_SUCCESS) {
+        LOG4CPP_WARN(logger, "Copy into shared texture failed (error " << err << "), using pixel buffers");
+        return false;
+    }
+    return true;
+#else
+    (void)image;
+    return false;
+#endif
+}
+
+bool UMatTexture::update_pixel_buffer(const cv::UMat& image) {
+    GLenum internalFormat, format;
+    if (!pixelFormat(m_type, internalFormat, format) || !m_pTexture)
+        return false;
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pixelBuffer);
+    std::size_t offset = 0;
+    void* dst = NULL;
+    if (m_path == PATH_PERSISTENT_PBO) {
+        m_segment = (m_segment + 1) % RING_SEGMENTS;
+        // wait until the GPU has finished reading the segment from its last use
+        if (m_fences[m_segment] != 0) {
+            GLenum result = glClientWaitSync(m_fences[m_segment], GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+            if (result == GL_TIMEOUT_EXPIRED)
+                glClientWaitSync(m_fences[m_segment], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+            glDeleteSync(m_fences[m_segment]);
+            m_fences[m_segment] = 0;
+        }
+        offset = m_segment * m_frameSize;
+        dst = static_cast< char* >(m_pMapped) + offset;
+    } else {
+        // orphan the storage so the driver does not stall on the previous upload
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, m_frameSize, NULL, GL_STREAM_DRAW);
+        dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, m_frameSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if (dst == NULL) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            GLStateCache::invalidate_current(GLStateCache::STATE_BUFFERS);
+            LOG4CPP_ERROR(logger, "Cannot map pixel buffer");
+            return false;
+        }
+    }
+
+    // the only copy: device (or host) memory straight into the mapped buffer
+    cv::Mat mapped(m_height, m_width, m_type, dst);
+    image.copyTo(mapped);
+
+    if (m_path == PATH_STREAMING_PBO)
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+    // rows of odd widths are not padded, other uploads of the context expect the alignment they set
+    GLint alignment = 4;
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glBindTexture(GL_TEXTURE_2D, m_pTexture->id());
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, m_width, m_height, format, GL_UNSIGNED_BYTE, reinterpret_cast< const GLvoid* >(offset));
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+
+    if (m_path == PATH_PERSISTENT_PBO)
+        m_fences[m_segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    GLStateCache::invalidate_current(GLStateCache::STATE_BUFFERS | GLStateCache::STATE_TEXTURES);
+    return true;
+}
+
+void UMatTexture::release_interop() {
+#ifdef HAVE_OPENCL
+    if (m_clImage != NULL)
+        clReleaseMemObject(static_cast< cl_mem >(m_clImage));
+#endif
+    m_clImage = NULL;
+}
+
+void UMatTexture::release_gl() {
+    // the CL image refers to the texture, it goes first
+    release_interop();
+    if (m_pixelBuffer != 0) {
+        if (m_pMapped != NULL) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pixelBuffer);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        }
+        glDeleteBuffers(1, &m_pixelBuffer);
+        GLStateCache::invalidate_current(GLStateCache::STATE_BUFFERS);
+    }
+    for (unsigned int i = 0; i < RING_SEGMENTS; i++) {
+        if (m_fences[i] != 0)
+            glDeleteSync(m_fences[i]);
+        m_fences[i] = 0;
+    }
+    m_pixelBuffer = 0;
+    m_pMapped = NULL;
+    m_frameSize = 0;
+    m_pTexture.reset();
+    m_width = 0;
+    m_height = 0;
+    m_type = -1;
+}
@@ -0,0 +1,133 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @ingroup visualization
+ * @file
+ * Texture fed from cv::UMat images.
+ *
+ * If the OpenCL context of the OpenCLManager shares objects with the GL
+ * context, images are copied into the texture on the device with cl_gl
+ * interop and never reach host memory. Otherwise they are downloaded once,
+ * directly into a persistently mapped pixel buffer (a re-filled one where
+ * persistent mapping is unavailable), from which the texture is updated.
+ */
+
+#ifndef UBITRACK_UTUMATTEXTURE_H
+#define UBITRACK_UTUMATTEXTURE_H
+
+#include <string>
+#include <boost/shared_ptr.hpp>
+#include <opencv2/core/core.hpp>
+
+#include <utVisualization/Config.h>
+#include <utVisualization/utOpenGL.h>
+#include <utVisualization/utResourcePool.h>
+
+namespace Ubitrack {
+    namespace Visualization {
+
+        class UBITRACK_EXPORT UMatTexture {
+
+        public:
+
+            /** how images reach the texture */
+            enum Path {
+                PATH_NONE = 0,           // nothing uploaded yet
+                PATH_CL_GL,              // device side copy into a shared texture
+                PATH_PERSISTENT_PBO,     // one download into a persistently mapped pixel buffer ring
+                PATH_STREAMING_PBO       // one download into an orphaned and re-mapped pixel buffer
+            };
+
+            UMatTexture();
+            ~UMatTexture();
+
+            /** share group and owner name under which the texture is taken from the ResourcePool */
+            void set_resource_owner(void* share_group, const std::string& owner);
+
+            /** disable cl_gl interop, e.g. to compare against the pixel buffer path */
+            void set_interop_enabled(bool enabled);
+
+            /**
+             * copies an 8 bit image with 1, 3 (BGR) or 4 (BGRA) channels into the texture.
+             * Render thread only, with a context of the share group current. Returns false if the image cannot be uploaded.
+             */
+            bool update(const cv::UMat& image);
+
+            /** the texture, RGBA for the cl_gl path, otherwise with as many channels as the image */
+            GLuint texture() const;
+
+            int width() const {
+                return m_width;
+            }
+
+            int height() const {
+                return m_height;
+            }
+
+            Path path() const {
+                return m_path;
+            }
+
+            static const char* path_name(Path path);
+
+            /** number of segments in the persistently mapped ring, one is written while the others may still be read */
+            static const unsigned int RING_SEGMENTS = 3;
+
+            /** release the GL and CL resources, call with the context current before it is destroyed */
+            void release_gl();
+
+        protected:
+            bool allocate(const cv::UMat& image);
+            bool update_interop(const cv::UMat& image);
+            bool update_pixel_buffer(const cv::UMat& image);
+            void select_path(Path path);
+            void release_interop();
+
+            void* m_pShareGroup;
+            std::string m_sOwner;
+            bool m_bInteropEnabled;
+            bool m_bInteropFailed;
+
+            int m_width;
+            int m_height;
+            int m_type;
+            boost::shared_ptr< PooledResource > m_pTexture;
+            Path m_path;
+
+            // cl_gl interop
+            void* m_clImage;
+            bool m_bImplicitSync;
+
+            // pixel buffer ring
+            GLuint m_pixelBuffer;
+            std::size_t m_frameSize;
+            void* m_pMapped;
+            unsigned int m_segment;
+            GLsync m_fences[RING_SEGMENTS];
+        };
+
+    }
+}
+
+#endif //UBITRACK_UTUMATTEXTURE_H